@@ -0,0 +1,408 @@
+#include "../src/communication.hpp"
+#include "../src/config.hpp"
+#include "../src/data.hpp"
+#include "../src/input.hpp"
+#include "../src/logging.hpp"
+#include "../src/physical.hpp"
+#include "../src/space.hpp"
+#include "../src/tree.hpp"
+#include "../src/walk.hpp"
+#include "bodies.hpp"
+#include <algorithm>
+#include <boost/mpi.hpp>
+#include <boost/optional.hpp>
+#include <boost/program_options.hpp>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <numeric>
+#include <random>
+#include <string>
+#include <vector>
+
+// accuracy of the tree forces against their cost
+// the forces on a sample of the bodies are computed exactly by direct sum,
+// then by the tree walk for every configuration of the sweep, root reports
+// percentiles of the relative errors next to the interactions and the wall
+// time of the walk, and marks the configurations no other one beats on
+// both interactions and p99 error
+// the samples are divided between the ranks, every rank builds the whole
+// tree, so the results do not depend on the rank count
+
+namespace mpi = boost::mpi;
+namespace po = boost::program_options;
+namespace logging = n_body::logging;
+
+using Number = double;
+constexpr std::size_t DIMENSION = 3;
+constexpr int ROOT = 0;
+
+namespace n_body::bench {
+
+using namespace n_body::data;
+
+// ci:         small enough to run on every change
+// production: the size the runs are tuned at
+struct Preset {
+  std::string name;
+  std::size_t number;
+  std::size_t samples;
+  std::vector<Number> thetas;
+  std::vector<Number> tolerances;
+};
+
+const std::vector<Preset> PRESETS = {
+    {"ci", 4096, 256, {0.3, 0.5, 0.7, 1}, {0.00025, 0.001, 0.0025, 0.01, 0.05}},
+    {"production",
+     131072,
+     4096,
+     {0.2, 0.3, 0.4, 0.5, 0.6, 0.7, 0.8, 0.9, 1},
+     {0.0001, 0.00025, 0.0005, 0.001, 0.0025, 0.005, 0.01, 0.025, 0.05, 0.1}},
+};
+
+// one configuration of the sweep, theta or tolerance is none where the
+// criterion does not use it
+struct Case {
+  config::OpeningCriterion opening;
+  boost::optional<Number> theta;
+  boost::optional<Number> tolerance;
+};
+
+struct Result {
+  Case configuration;
+  std::size_t samples;
+  Number p50;
+  Number p90;
+  Number p99;
+  Number max;
+  // accepted nodes per sample
+  Number interactions;
+  // walk over all samples, maximum over ranks
+  Number seconds;
+  bool pareto;
+};
+
+// nearest rank percentile of sorted values
+Number percentile(const std::vector<Number> &sorted, Number fraction) {
+  auto rank = static_cast<std::size_t>(
+      std::ceil(fraction * static_cast<Number>(sorted.size())));
+  return sorted[std::max<std::size_t>(rank, 1) - 1];
+}
+
+// geometric:     every theta
+// salmon-warren: every tolerance, theta is not used
+// relative:      every theta as the safety with every tolerance
+std::vector<Case> sweep(const std::vector<config::OpeningCriterion> &openings,
+                        const std::vector<Number> &thetas,
+                        const std::vector<Number> &tolerances) {
+  std::vector<Case> cases;
+  for (auto opening : openings) {
+    switch (opening) {
+    case config::OpeningCriterion::Geometric:
+      for (auto theta : thetas)
+        cases.push_back({opening, theta, boost::none});
+      break;
+    case config::OpeningCriterion::SalmonWarren:
+      for (auto tolerance : tolerances)
+        cases.push_back({opening, boost::none, tolerance});
+      break;
+    case config::OpeningCriterion::Relative:
+      for (auto theta : thetas)
+        for (auto tolerance : tolerances)
+          cases.push_back({opening, theta, tolerance});
+      break;
+    }
+  }
+  return cases;
+}
+
+void mark_pareto(std::vector<Result> &results) {
+  for (auto &r : results) {
+    r.pareto = std::none_of(
+        results.begin(), results.end(), [&r](const Result &other) {
+          return other.interactions <= r.interactions && other.p99 <= r.p99 &&
+                 (other.interactions < r.interactions || other.p99 < r.p99);
+        });
+  }
+}
+
+void write_csv(std::ostream &os, const std::vector<Result> &results) {
+  os << "opening,theta,tolerance,samples,p50,p90,p99,max,interactions,"
+        "seconds,pareto\n";
+  for (const auto &r : results) {
+    os << r.configuration.opening << ',';
+    if (r.configuration.theta)
+      os << *r.configuration.theta;
+    os << ',';
+    if (r.configuration.tolerance)
+      os << *r.configuration.tolerance;
+    os << ',' << r.samples << ',' << r.p50 << ',' << r.p90 << ',' << r.p99
+       << ',' << r.max << ',' << r.interactions << ',' << r.seconds << ','
+       << r.pareto << '\n';
+  }
+}
+
+int main(int argc, char *argv[]) {
+  mpi::environment env(argc, argv, false);
+  mpi::communicator world;
+  mpi::timer timer;
+
+  logging::Configuration::instance().default_communicator = &world;
+  logging::Configuration::instance().timer = &timer;
+  // keep standard output for the results
+  logging::Configuration::instance().output = &std::cerr;
+
+  std::string input;
+  Distribution distribution = Distribution::Plummer;
+  std::uint64_t seed = 1;
+  std::vector<config::OpeningCriterion> openings{
+      config::OpeningCriterion::Geometric,
+      config::OpeningCriterion::SalmonWarren,
+      config::OpeningCriterion::Relative};
+  Number soften_length = 0;
+  // p99 error the cheapest configuration must meet, 0 to only report
+  Number budget = 0;
+  std::string output;
+  Preset preset = PRESETS.front();
+  bool show_help = false;
+
+  po::options_description description("options");
+  if (world.rank() == ROOT) {
+    description.add_options()("help,h", "print help message");
+    description.add_options()(
+        "preset", po::value<std::string>()->default_value(preset.name),
+        "ci or production, the defaults of the sizes and of the sweep");
+    description.add_options()("input,i", po::value<std::string>(),
+                              "bodies file to sample (default: generated)");
+    description.add_options()("distribution,d",
+                              po::value<Distribution>()->default_value(
+                                  distribution),
+                              "uniform, plummer or clustered, when generated");
+    description.add_options()("number,n", po::value<std::size_t>(),
+                              "number of generated bodies");
+    description.add_options()("samples,m", po::value<std::size_t>(),
+                              "number of sampled bodies");
+    description.add_options()("seed",
+                              po::value<std::uint64_t>()->default_value(seed),
+                              "seed of the generated bodies and the sample");
+    description.add_options()(
+        "theta,p", po::value<std::vector<Number>>()->multitoken(),
+        "Barnes-Hut approximation parameters");
+    description.add_options()(
+        "opening", po::value<std::vector<config::OpeningCriterion>>()
+                       ->multitoken(),
+        "geometric, salmon-warren or relative (default: all)");
+    description.add_options()(
+        "opening-tolerance", po::value<std::vector<Number>>()->multitoken(),
+        "tolerances of the salmon-warren and relative criteria");
+    description.add_options()(
+        "soften-length", po::value<Number>()->default_value(soften_length),
+        "soften length of the forces");
+    description.add_options()(
+        "budget", po::value<Number>()->default_value(budget),
+        "p99 relative error to meet, fail if no configuration meets it, "
+        "0 to only report");
+    description.add_options()("output,o", po::value<std::string>(),
+                              "output file (default: standard output)");
+
+    po::variables_map vm;
+    po::store(po::parse_command_line(argc, argv, description), vm);
+    po::notify(vm);
+
+    show_help = vm.count("help") != 0;
+    auto name = vm["preset"].as<std::string>();
+    auto found = std::find_if(PRESETS.begin(), PRESETS.end(),
+                              [&name](const auto &p) { return p.name == name; });
+    if (found == PRESETS.end()) {
+      logging::logger(logging::Level::Error)
+          << "unknown preset " << name << std::endl;
+      world.abort(MPI_ERR_ARG);
+    }
+    preset = *found;
+    if (vm.count("input"))
+      input = vm["input"].as<std::string>();
+    distribution = vm["distribution"].as<Distribution>();
+    if (vm.count("number"))
+      preset.number = vm["number"].as<std::size_t>();
+    if (vm.count("samples"))
+      preset.samples = vm["samples"].as<std::size_t>();
+    seed = vm["seed"].as<std::uint64_t>();
+    if (vm.count("theta"))
+      preset.thetas = vm["theta"].as<std::vector<Number>>();
+    if (vm.count("opening"))
+      openings = vm["opening"].as<std::vector<config::OpeningCriterion>>();
+    if (vm.count("opening-tolerance"))
+      preset.tolerances = vm["opening-tolerance"].as<std::vector<Number>>();
+    soften_length = vm["soften-length"].as<Number>();
+    budget = vm["budget"].as<Number>();
+    if (vm.count("output"))
+      output = vm["output"].as<std::string>();
+
+    if (preset.samples == 0) {
+      logging::logger(logging::Level::Error)
+          << "at least one sample is needed" << std::endl;
+      world.abort(MPI_ERR_ARG);
+    }
+  }
+  mpi::broadcast(world, show_help, ROOT);
+  if (show_help) {
+    if (world.rank() == ROOT) {
+      std::cout << description << std::endl;
+    }
+    return EXIT_SUCCESS;
+  }
+  mpi::broadcast(world, input, ROOT);
+  mpi::broadcast(world, distribution, ROOT);
+  mpi::broadcast(world, preset.number, ROOT);
+  mpi::broadcast(world, preset.samples, ROOT);
+  mpi::broadcast(world, seed, ROOT);
+  mpi::broadcast(world, preset.thetas, ROOT);
+  mpi::broadcast(world, openings, ROOT);
+  mpi::broadcast(world, preset.tolerances, ROOT);
+  mpi::broadcast(world, soften_length, ROOT);
+
+  data::Bodies<Number, DIMENSION> bodies;
+  if (input.empty()) {
+    bodies = make_bodies<Number, DIMENSION>(world, distribution, preset.number,
+                                            seed);
+  } else {
+    input::input_bodies(world, ROOT, input, bodies);
+  }
+  data::BodiesView<Number, DIMENSION> view(bodies);
+
+  // the same sample on all ranks, each rank takes its division of it, so
+  // it is rounded down to a multiple of the ranks
+  std::vector<std::size_t> sample(bodies.size());
+  std::iota(sample.begin(), sample.end(), 0);
+  std::mt19937_64 engine(seed);
+  std::shuffle(sample.begin(), sample.end(), engine);
+  auto samples = std::min(preset.samples, sample.size());
+  sample.resize(samples - samples % world.size());
+  if (sample.empty()) {
+    if (world.rank() == ROOT) {
+      logging::logger(logging::Level::Error)
+          << "fewer samples than processes(" << world.size() << ")"
+          << std::endl;
+    }
+    return EXIT_FAILURE;
+  }
+  communication::Division division(world, sample.size());
+
+  config::Configuration<Number> config;
+  config.G = 1;
+  config.soften_length = soften_length;
+  config.quantize_precision = 0;
+
+  std::vector<Vector<Number, DIMENSION>> exact;
+  std::vector<Number> magnitudes;
+  for (auto s = division.begin; s < division.end; ++s) {
+    const auto &position = bodies[sample[s]].position;
+    Vector<Number, DIMENSION> acceleration{};
+    for (const auto &body : view) {
+      acceleration += physical::gravity_per_unit_mass_position_to_position(
+          config, body.position, body.mass, position);
+    }
+    exact.push_back(acceleration);
+    magnitudes.push_back(module_of(acceleration));
+  }
+
+  auto root_space =
+      space::root_space<Number, DIMENSION>(bodies.begin(), bodies.end());
+  tree::BodyTree<Number, DIMENSION> body_tree;
+  for (std::size_t i = 0; i < bodies.size(); ++i) {
+    body_tree.push(bodies, root_space, i);
+  }
+  auto flat = body_tree.flatten();
+
+  std::vector<Result> results;
+  for (const auto &c : sweep(openings, preset.thetas, preset.tolerances)) {
+    config.opening = c.opening;
+    config.theta = c.theta.value_or(1);
+    config.opening_tolerance = c.tolerance.value_or(0);
+    auto walk_tree = walk::WalkTree<Number, DIMENSION>::from_flat(flat, config);
+
+    // the relative criterion gets the exact accelerations, as from a
+    // previous step that did not move the bodies
+    std::vector<Number> errors;
+    std::uint64_t interactions = 0;
+    world.barrier();
+    mpi::timer walk_timer;
+    for (std::size_t k = 0; k < division.count; ++k) {
+      auto acceleration = physical::gravity_per_unit_mass_tree_to_position(
+          config, walk_tree, bodies[sample[division.begin + k]].position,
+          walk::opening_scale(config, magnitudes[k]), &interactions);
+      errors.push_back(module_of(acceleration - exact[k]) / magnitudes[k]);
+    }
+    auto seconds = walk_timer.elapsed();
+
+    mpi::all_reduce(world, mpi::inplace(seconds), mpi::maximum<Number>());
+    mpi::all_reduce(world, mpi::inplace(interactions),
+                    std::plus<std::uint64_t>());
+    std::vector<std::vector<Number>> all_errors;
+    mpi::gather(world, errors, all_errors, ROOT);
+    if (world.rank() != ROOT)
+      continue;
+
+    errors.clear();
+    for (const auto &rank_errors : all_errors)
+      errors.insert(errors.end(), rank_errors.begin(), rank_errors.end());
+    std::sort(errors.begin(), errors.end());
+    results.push_back(Result{
+        c,
+        errors.size(),
+        percentile(errors, 0.5),
+        percentile(errors, 0.9),
+        percentile(errors, 0.99),
+        errors.back(),
+        static_cast<Number>(interactions) / errors.size(),
+        seconds,
+        false,
+    });
+    logging::logger(logging::Level::Info)
+        << c.opening << " p99 " << std::scientific << results.back().p99
+        << " interactions " << results.back().interactions << std::endl;
+  }
+
+  bool met = true;
+  if (world.rank() == ROOT) {
+    mark_pareto(results);
+    std::ofstream file;
+    if (!output.empty())
+      file.open(output);
+    std::ostream &os = output.empty() ? std::cout : file;
+    write_csv(os, results);
+
+    if (budget > 0) {
+      // the cheapest configuration meeting the budget
+      const Result *cheapest = nullptr;
+      for (const auto &r : results) {
+        if (r.p99 <= budget &&
+            (!cheapest || r.interactions < cheapest->interactions))
+          cheapest = &r;
+      }
+      met = cheapest != nullptr;
+      if (met) {
+        auto &log = logging::logger(logging::Level::Info);
+        log << "cheapest within the budget: " << cheapest->configuration.opening
+            << std::defaultfloat;
+        if (cheapest->configuration.theta)
+          log << " theta " << *cheapest->configuration.theta;
+        if (cheapest->configuration.tolerance)
+          log << " tolerance " << *cheapest->configuration.tolerance;
+        log << std::endl;
+      } else {
+        logging::logger(logging::Level::Error)
+            << "no configuration meets the budget " << budget << std::endl;
+      }
+    }
+  }
+  mpi::broadcast(world, met, ROOT);
+  return met ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+} // namespace n_body::bench
+
+int main(int argc, char *argv[]) { return n_body::bench::main(argc, argv); }
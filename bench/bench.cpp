@@ -0,0 +1,431 @@
+#include "../src/communication.hpp"
+#include "../src/config.hpp"
+#include "../src/data.hpp"
+#include "../src/logging.hpp"
+#include "../src/morton.hpp"
+#include "../src/physical.hpp"
+#include "../src/space.hpp"
+#include "../src/tree.hpp"
+#include "../src/walk.hpp"
+#include "bodies.hpp"
+#include <algorithm>
+#include <boost/mpi.hpp>
+#include <boost/mpi/packed_oarchive.hpp>
+#include <boost/optional.hpp>
+#include <boost/program_options.hpp>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// benchmarks of the hot paths
+// every repetition starts together on all ranks and takes as long as the
+// slowest rank, root reports statistics over the repetitions
+// the rank count is fixed by mpirun, util/bench.sh sweeps over it
+
+namespace mpi = boost::mpi;
+namespace po = boost::program_options;
+namespace logging = n_body::logging;
+
+using Number = double;
+constexpr std::size_t DIMENSION = 3;
+constexpr int ROOT = 0;
+
+namespace n_body::bench {
+
+using namespace n_body::data;
+
+struct Statistics {
+  Number min;
+  Number median;
+  Number mean;
+  Number stddev;
+};
+
+Statistics statistics_of(std::vector<Number> samples) {
+  std::sort(samples.begin(), samples.end());
+  auto n = samples.size();
+  Number sum = 0;
+  for (auto sample : samples)
+    sum += sample;
+  auto mean = sum / n;
+  Number squares = 0;
+  for (auto sample : samples)
+    squares += (sample - mean) * (sample - mean);
+  return {
+      samples.front(),
+      n % 2 == 1 ? samples[n / 2] : (samples[n / 2 - 1] + samples[n / 2]) / 2,
+      mean,
+      n > 1 ? std::sqrt(squares / (n - 1)) : 0,
+  };
+}
+
+// seconds of each repetition, maximum over ranks
+std::vector<Number> measure(const mpi::communicator &comm,
+                            std::size_t warmup, std::size_t repetitions,
+                            const std::function<void()> &run) {
+  for (std::size_t i = 0; i < warmup; ++i)
+    run();
+  std::vector<Number> samples;
+  for (std::size_t i = 0; i < repetitions; ++i) {
+    comm.barrier();
+    mpi::timer timer;
+    run();
+    auto elapsed = timer.elapsed();
+    mpi::all_reduce(comm, mpi::inplace(elapsed), mpi::maximum<Number>());
+    samples.push_back(elapsed);
+  }
+  return samples;
+}
+
+struct Result {
+  std::string benchmark;
+  Distribution distribution;
+  std::size_t number;
+  // none if the benchmark does not depend on theta
+  boost::optional<Number> theta;
+  int ranks;
+  std::size_t repetitions;
+  Statistics statistics;
+};
+
+void write_csv(std::ostream &os, const std::vector<Result> &results) {
+  os << "benchmark,distribution,number,theta,ranks,repetitions,min,median,"
+        "mean,stddev\n";
+  for (const auto &r : results) {
+    os << r.benchmark << ',' << r.distribution << ',' << r.number << ',';
+    if (r.theta)
+      os << *r.theta;
+    os << ',' << r.ranks << ',' << r.repetitions << ',' << r.statistics.min
+       << ',' << r.statistics.median << ',' << r.statistics.mean << ','
+       << r.statistics.stddev << '\n';
+  }
+}
+
+void write_json(std::ostream &os, const std::vector<Result> &results) {
+  os << "[\n";
+  for (std::size_t i = 0; i < results.size(); ++i) {
+    const auto &r = results[i];
+    os << "  {\"benchmark\": \"" << r.benchmark << "\", \"distribution\": \""
+       << r.distribution << "\", \"number\": " << r.number
+       << ", \"theta\": ";
+    if (r.theta)
+      os << *r.theta;
+    else
+      os << "null";
+    os << ", \"ranks\": " << r.ranks << ", \"repetitions\": " << r.repetitions
+       << ", \"min\": " << r.statistics.min
+       << ", \"median\": " << r.statistics.median
+       << ", \"mean\": " << r.statistics.mean
+       << ", \"stddev\": " << r.statistics.stddev << "}"
+       << (i + 1 == results.size() ? "\n" : ",\n");
+  }
+  os << "]\n";
+}
+
+struct Benchmark {
+  std::string name;
+  bool uses_theta;
+};
+
+// push:             serial insertion of all bodies into one tree
+// merge:            merge of two trees holding half of the bodies each
+// walk:             tree forces on the local bodies
+// packet:           tree forces on the local bodies in morton order, walked
+//                   by packets
+// direct:           direct sum forces on the local bodies
+// serialize-tree:   mpi serialization of the merged tree
+// serialize-bodies: mpi serialization of all bodies
+// build:            distributed tree build with the pairwise merge
+// step:             one step of the main loop with the tree method, root
+//                   space to all_gather
+const std::vector<Benchmark> BENCHMARKS = {
+    {"push", false},             {"merge", false},
+    {"walk", true},              {"packet", true},
+    {"direct", false},           {"serialize-tree", false},
+    {"serialize-bodies", false}, {"build", false},
+    {"step", true},
+};
+
+int main(int argc, char *argv[]) {
+  mpi::environment env(argc, argv, false);
+  mpi::communicator world;
+  mpi::timer timer;
+
+  logging::Configuration::instance().default_communicator = &world;
+  logging::Configuration::instance().timer = &timer;
+  // keep standard output for the results
+  logging::Configuration::instance().output = &std::cerr;
+
+  std::vector<std::size_t> numbers{1024, 8192};
+  std::vector<Number> thetas{0.5, 1};
+  std::vector<Distribution> distributions{
+      Distribution::Uniform, Distribution::Plummer, Distribution::Clustered};
+  std::vector<std::string> names;
+  for (const auto &benchmark : BENCHMARKS)
+    names.push_back(benchmark.name);
+  std::size_t repetitions = 5;
+  std::size_t warmup = 1;
+  std::uint64_t seed = 1;
+  std::string format = "csv";
+  std::string output;
+  bool show_help = false;
+
+  po::options_description description("options");
+  if (world.rank() == ROOT) {
+    description.add_options()("help,h", "print help message");
+    description.add_options()(
+        "number,n", po::value<std::vector<std::size_t>>()->multitoken(),
+        "numbers of bodies (default: 1024 8192)");
+    description.add_options()(
+        "theta,p", po::value<std::vector<Number>>()->multitoken(),
+        "Barnes-Hut approximation parameters (default: 0.5 1)");
+    description.add_options()(
+        "distribution,d", po::value<std::vector<Distribution>>()->multitoken(),
+        "uniform, plummer or clustered (default: all)");
+    description.add_options()(
+        "benchmark,b", po::value<std::vector<std::string>>()->multitoken(),
+        "push, merge, walk, packet, direct, serialize-tree, serialize-bodies, "
+        "build or step (default: all)");
+    description.add_options()(
+        "repetitions,r", po::value<std::size_t>()->default_value(repetitions),
+        "measured repetitions of every case");
+    description.add_options()("warmup",
+                              po::value<std::size_t>()->default_value(warmup),
+                              "unmeasured repetitions before measuring");
+    description.add_options()("seed",
+                              po::value<std::uint64_t>()->default_value(seed),
+                              "seed of the generated bodies");
+    description.add_options()("format,f",
+                              po::value<std::string>()->default_value(format),
+                              "csv or json");
+    description.add_options()("output,o", po::value<std::string>(),
+                              "output file (default: standard output)");
+
+    po::variables_map vm;
+    po::store(po::parse_command_line(argc, argv, description), vm);
+    po::notify(vm);
+
+    show_help = vm.count("help") != 0;
+    if (vm.count("number"))
+      numbers = vm["number"].as<std::vector<std::size_t>>();
+    if (vm.count("theta"))
+      thetas = vm["theta"].as<std::vector<Number>>();
+    if (vm.count("distribution"))
+      distributions = vm["distribution"].as<std::vector<Distribution>>();
+    if (vm.count("benchmark"))
+      names = vm["benchmark"].as<std::vector<std::string>>();
+    repetitions = vm["repetitions"].as<std::size_t>();
+    warmup = vm["warmup"].as<std::size_t>();
+    seed = vm["seed"].as<std::uint64_t>();
+    format = vm["format"].as<std::string>();
+    if (vm.count("output"))
+      output = vm["output"].as<std::string>();
+
+    for (const auto &name : names) {
+      if (std::none_of(BENCHMARKS.begin(), BENCHMARKS.end(),
+                       [&name](const auto &b) { return b.name == name; })) {
+        logging::logger(logging::Level::Error)
+            << "unknown benchmark " << name << std::endl;
+        world.abort(MPI_ERR_ARG);
+      }
+    }
+    for (auto number : numbers) {
+      if (number % world.size() != 0) {
+        logging::logger(logging::Level::Error)
+            << "number of bodies(" << number
+            << ") must be divisible by number of processes(" << world.size()
+            << ")" << std::endl;
+        world.abort(MPI_ERR_ARG);
+      }
+    }
+    if (format != "csv" && format != "json") {
+      logging::logger(logging::Level::Error)
+          << "unknown format " << format << std::endl;
+      world.abort(MPI_ERR_ARG);
+    }
+    if (repetitions == 0) {
+      logging::logger(logging::Level::Error)
+          << "at least one repetition is needed" << std::endl;
+      world.abort(MPI_ERR_ARG);
+    }
+  }
+  mpi::broadcast(world, show_help, ROOT);
+  if (show_help) {
+    if (world.rank() == ROOT) {
+      std::cout << description << std::endl;
+    }
+    return EXIT_SUCCESS;
+  }
+  mpi::broadcast(world, numbers, ROOT);
+  mpi::broadcast(world, thetas, ROOT);
+  mpi::broadcast(world, distributions, ROOT);
+  mpi::broadcast(world, names, ROOT);
+  mpi::broadcast(world, repetitions, ROOT);
+  mpi::broadcast(world, warmup, ROOT);
+  mpi::broadcast(world, seed, ROOT);
+
+  config::Configuration<Number> config;
+  config.time = static_cast<Number>(0.001);
+  config.G = 1;
+  config.theta = 1;
+  config.soften_length = static_cast<Number>(0.001);
+  config.quantize_precision = 0;
+
+  std::vector<Result> results;
+  for (auto distribution : distributions) {
+    for (auto number : numbers) {
+      auto bodies =
+          make_bodies<Number, DIMENSION>(world, distribution, number, seed);
+      auto root_space = space::root_space(world, bodies);
+      communication::Division division(world, number);
+
+      // inputs of the benchmarks which do not build their own tree
+      data::tree::BodyTree<Number, DIMENSION> first_half, second_half;
+      for (std::size_t i = 0; i < number; ++i) {
+        (i < number / 2 ? first_half : second_half)
+            .push(bodies, root_space, i);
+      }
+      auto tree = data::tree::merge_tree(first_half, second_half, bodies);
+
+      for (const auto &name : names) {
+        const auto &benchmark =
+            *std::find_if(BENCHMARKS.begin(), BENCHMARKS.end(),
+                          [&name](const auto &b) { return b.name == name; });
+        std::vector<boost::optional<Number>> cases;
+        if (benchmark.uses_theta) {
+          cases.assign(thetas.begin(), thetas.end());
+        } else {
+          cases.emplace_back();
+        }
+
+        for (const auto &theta : cases) {
+          config.theta = theta ? *theta : 1;
+          std::function<void()> run;
+          walk::WalkTree<Number, DIMENSION> walk_tree;
+          data::Bodies<Number, DIMENSION> local;
+          if (name == "push") {
+            run = [&]() {
+              data::tree::BodyTree<Number, DIMENSION> t;
+              for (std::size_t i = 0; i < number; ++i)
+                t.push(bodies, root_space, i);
+            };
+          } else if (name == "merge") {
+            run = [&]() {
+              data::tree::merge_tree(first_half, second_half, bodies);
+            };
+          } else if (name == "walk") {
+            // the layout is computed once per tree, outside of the timing
+            walk_tree = walk::WalkTree<Number, DIMENSION>::from_flat(
+                tree.flatten(), config);
+            run = [&]() {
+              data::Vector<Number, DIMENSION> sum{};
+              for (auto i = division.begin; i < division.end; ++i) {
+                sum += physical::gravity_per_unit_mass_tree_to_position(
+                    config, walk_tree, bodies[i].position);
+              }
+              // keep the result alive
+              volatile Number sink = sum[0];
+              (void)sink;
+            };
+          } else if (name == "packet") {
+            walk_tree = walk::WalkTree<Number, DIMENSION>::from_flat(
+                tree.flatten(), config);
+            // packets pay off for bodies close in space, as after
+            // --reorder-interval
+            local.assign(bodies.begin() + division.begin,
+                         bodies.begin() + division.end);
+            std::vector<std::uint64_t> ids(local.size());
+            morton::reorder(root_space, local.data(), ids.data(),
+                            local.size());
+            run = [&]() {
+              Vector<Number, DIMENSION> positions[walk::PACKET_SIZE];
+              Vector<Number, DIMENSION> accelerations[walk::PACKET_SIZE];
+              data::Vector<Number, DIMENSION> sum{};
+              for (std::size_t i = 0; i < local.size();) {
+                std::size_t count = 0;
+                for (; i < local.size() && count < walk::PACKET_SIZE;
+                     ++i, ++count) {
+                  positions[count] = local[i].position;
+                }
+                physical::gravity_per_unit_mass_tree_to_packet(
+                    config, walk_tree, positions, count, accelerations);
+                for (std::size_t l = 0; l < count; ++l)
+                  sum += accelerations[l];
+              }
+              // keep the result alive
+              volatile Number sink = sum[0];
+              (void)sink;
+            };
+          } else if (name == "direct") {
+            run = [&]() {
+              data::Bodies<Number, DIMENSION> local(
+                  bodies.begin() + division.begin,
+                  bodies.begin() + division.end);
+              physical::step(config, local.begin(), local.end(), bodies);
+            };
+          } else if (name == "serialize-tree") {
+            run = [&]() {
+              mpi::packed_oarchive ar(world);
+              ar << tree;
+            };
+          } else if (name == "serialize-bodies") {
+            run = [&]() {
+              mpi::packed_oarchive ar(world);
+              ar << bodies;
+            };
+          } else if (name == "build") {
+            run = [&]() { data::tree::build_tree(world, root_space, bodies); };
+          } else if (name == "step") {
+            run = [&]() {
+              auto moved = bodies;
+              auto space = space::root_space(world, moved);
+              auto t = data::tree::build_tree(world, space, moved);
+              physical::step(config, world, moved,
+                             walk::WalkTree<Number, DIMENSION>::from_flat(
+                                 t.flatten(), config));
+            };
+          }
+
+          auto samples = measure(world, warmup, repetitions, run);
+          results.push_back(Result{
+              name,
+              distribution,
+              number,
+              theta,
+              world.size(),
+              repetitions,
+              statistics_of(samples),
+          });
+          if (world.rank() == ROOT) {
+            logging::logger(logging::Level::Info)
+                << name << " " << distribution << " n=" << number
+                << " median " << std::scientific
+                << results.back().statistics.median << "s" << std::endl;
+          }
+        }
+      }
+    }
+  }
+
+  if (world.rank() == ROOT) {
+    std::ofstream file;
+    if (!output.empty())
+      file.open(output);
+    std::ostream &os = output.empty() ? std::cout : file;
+    if (format == "json")
+      write_json(os, results);
+    else
+      write_csv(os, results);
+  }
+  return EXIT_SUCCESS;
+}
+
+} // namespace n_body::bench
+
+int main(int argc, char *argv[]) { return n_body::bench::main(argc, argv); }
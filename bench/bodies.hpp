@@ -0,0 +1,98 @@
+#ifndef N_BODY_BENCH_BODIES_HPP
+#define N_BODY_BENCH_BODIES_HPP
+
+#include "../src/data.hpp"
+#include "../src/model.hpp"
+#include "../src/random.hpp"
+#include "../src/random_body.hpp"
+#include <boost/mpi.hpp>
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <random>
+#include <string>
+
+// generated bodies shared by the benchmark tools
+
+namespace n_body::bench {
+
+enum class Distribution {
+  Uniform = 0,
+  Plummer = 1,
+  Clustered = 2,
+};
+
+inline std::ostream &operator<<(std::ostream &os, Distribution distribution) {
+  switch (distribution) {
+  case Distribution::Uniform:
+    return os << "uniform";
+  case Distribution::Plummer:
+    return os << "plummer";
+  case Distribution::Clustered:
+    return os << "clustered";
+  default:
+    return os << "ukn";
+  }
+}
+
+inline std::istream &operator>>(std::istream &is, Distribution &distribution) {
+  std::string label;
+  is >> label;
+  if (label == "uniform")
+    distribution = Distribution::Uniform;
+  else if (label == "plummer")
+    distribution = Distribution::Plummer;
+  else if (label == "clustered")
+    distribution = Distribution::Clustered;
+  else
+    is.setstate(std::ios::failbit);
+  return is;
+}
+
+// number of plummer spheres of the clustered distribution
+constexpr std::size_t CLUSTERS = 8;
+
+// all ranks generate the same bodies, inside a region of size about 1
+template <typename T, std::size_t Dimension>
+data::Bodies<T, Dimension> make_bodies(const boost::mpi::communicator &comm,
+                                       Distribution distribution,
+                                       std::size_t number,
+                                       std::uint64_t seed) {
+  data::Bodies<T, Dimension> bodies;
+  switch (distribution) {
+  case Distribution::Uniform:
+    random::body::uniform_bodies(comm, seed, number, T(-1), T(1), T(0.5),
+                                 T(1), bodies);
+    break;
+  case Distribution::Plummer:
+  case Distribution::Clustered: {
+    model::Parameters<T> parameters{};
+    parameters.number = number;
+    bool clustered = distribution == Distribution::Clustered;
+    if (clustered)
+      parameters.scale = static_cast<T>(0.05);
+    random::CounterEngine engine(random::Key{seed, 0}, 0);
+    random::CounterEngine center_engine(random::Key{seed, 1}, 0);
+    bodies.reserve(number);
+    for (std::size_t i = 0; i < number; ++i) {
+      engine.seek(i);
+      auto body = model::sample<T, Dimension>(model::Kind::Plummer,
+                                              parameters, i, engine);
+      if (clustered) {
+        center_engine.seek(i % CLUSTERS);
+        for (std::size_t d = 0; d < Dimension; ++d) {
+          body.position[d] +=
+              std::uniform_real_distribution<T>(-1, 1)(center_engine);
+        }
+      }
+      bodies.push_back(body);
+    }
+    break;
+  }
+  }
+  return bodies;
+}
+
+} // namespace n_body::bench
+
+#endif
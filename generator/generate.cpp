@@ -0,0 +1,193 @@
+#include "../src/binary.hpp"
+#include "../src/communication.hpp"
+#include "../src/config.hpp"
+#include "../src/data.hpp"
+#include "../src/logging.hpp"
+#include "../src/model.hpp"
+#include "../src/random.hpp"
+#include <boost/mpi.hpp>
+#include <boost/program_options.hpp>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <filesystem>
+#include <iostream>
+#include <string>
+
+// parameters are parsed in double and converted to the output precision
+using Number = double;
+constexpr int ROOT = 0;
+
+namespace mpi = boost::mpi;
+namespace po = boost::program_options;
+namespace logging = n_body::logging;
+namespace model = n_body::model;
+
+// sample this rank's share and write it into the bodies file
+template <typename T, std::size_t Dimension>
+void generate(const mpi::communicator &world, model::Kind kind,
+              const model::Parameters<Number> &options,
+              const std::string &output, std::uint64_t seed) {
+  model::Parameters<T> parameters{
+      options.number,
+      static_cast<T>(options.mass),
+      static_cast<T>(options.scale),
+      static_cast<T>(options.density),
+      static_cast<T>(options.concentration),
+      static_cast<T>(options.scale_height),
+      static_cast<T>(options.separation),
+      static_cast<T>(options.relative_speed),
+  };
+
+  n_body::communication::Division division(world, parameters.number);
+  // body i always draws from index i of the stream, so the output does not
+  // depend on the number of ranks
+  n_body::random::CounterEngine engine(n_body::random::Key{seed, 0}, 0);
+  n_body::data::Bodies<T, Dimension> local_bodies;
+  local_bodies.reserve(division.count);
+  for (auto i = division.begin; i < division.end; ++i) {
+    engine.seek(i);
+    local_bodies.push_back(
+        model::sample<T, Dimension>(kind, parameters, i, engine));
+  }
+
+  n_body::binary::write_bodies_file(world, ROOT, std::filesystem::path(output),
+                                    local_bodies, division.begin,
+                                    parameters.number);
+}
+
+// generate initial conditions in parallel
+// every rank samples its own share of bodies and writes it directly into a
+// binary bodies file
+int main(int argc, char **argv) {
+  mpi::environment env(argc, argv, false);
+  mpi::communicator world;
+  mpi::timer timer;
+
+  logging::Configuration::instance().default_communicator = &world;
+  logging::Configuration::instance().timer = &timer;
+
+  model::Kind kind = model::Kind::Plummer;
+  model::Parameters<Number> parameters{};
+  std::string output;
+  std::uint64_t seed = 0;
+  unsigned dimension = 3;
+  auto precision = n_body::config::Precision::Double;
+  bool show_help = false;
+
+  po::options_description description("options");
+  if (world.rank() == ROOT) {
+    description.add_options()("help,h", "print help message");
+    description.add_options()(
+        "model,m", po::value<model::Kind>()->default_value(kind),
+        "cube, lattice, plummer, hernquist, nfw, disk or collision");
+    description.add_options()("number,n", po::value<std::size_t>(),
+                              "number of bodies");
+    description.add_options()("output,o", po::value<std::string>(),
+                              "output binary bodies file");
+    description.add_options()("seed", po::value<std::uint64_t>(),
+                              "random seed (random if not specified)");
+    description.add_options()("dimension",
+                              po::value<unsigned>()->default_value(dimension),
+                              "dimension of space, 2 or 3");
+    description.add_options()(
+        "precision",
+        po::value<n_body::config::Precision>()->default_value(precision),
+        "floating point type, float or double");
+    description.add_options()(
+        "mass", po::value<Number>()->default_value(parameters.mass),
+        "total mass");
+    description.add_options()(
+        "scale", po::value<Number>()->default_value(parameters.scale),
+        "scale radius of spheres or scale length of disks");
+    description.add_options()(
+        "density,d", po::value<Number>()->default_value(parameters.density),
+        "number of bodies per unit volume of cubes and lattices");
+    description.add_options()(
+        "concentration",
+        po::value<Number>()->default_value(parameters.concentration),
+        "concentration of nfw halos");
+    description.add_options()(
+        "scale-height",
+        po::value<Number>()->default_value(parameters.scale_height),
+        "scale height of disks");
+    description.add_options()(
+        "separation",
+        po::value<Number>()->default_value(parameters.separation),
+        "initial distance of colliding clusters");
+    description.add_options()(
+        "relative-speed",
+        po::value<Number>()->default_value(parameters.relative_speed),
+        "relative speed of colliding clusters");
+
+    po::variables_map vm;
+    po::store(po::parse_command_line(argc, argv, description), vm);
+    po::notify(vm);
+
+    show_help = vm.count("help") || !vm.count("number") || !vm.count("output");
+    if (!show_help) {
+      kind = vm["model"].as<model::Kind>();
+      parameters.number = vm["number"].as<std::size_t>();
+      parameters.mass = vm["mass"].as<Number>();
+      parameters.scale = vm["scale"].as<Number>();
+      parameters.density = vm["density"].as<Number>();
+      parameters.concentration = vm["concentration"].as<Number>();
+      parameters.scale_height = vm["scale-height"].as<Number>();
+      parameters.separation = vm["separation"].as<Number>();
+      parameters.relative_speed = vm["relative-speed"].as<Number>();
+      output = vm["output"].as<std::string>();
+      dimension = vm["dimension"].as<unsigned>();
+      precision = vm["precision"].as<n_body::config::Precision>();
+      if (dimension != 2 && dimension != 3) {
+        logging::logger(logging::Level::Error)
+            << "dimension " << dimension << " is not supported, use 2 or 3"
+            << std::endl;
+        world.abort(MPI_ERR_ARG);
+      }
+      if (vm.count("seed")) {
+        seed = vm["seed"].as<std::uint64_t>();
+      } else {
+        seed = n_body::random::new_seed();
+      }
+    }
+  }
+  mpi::broadcast(world, show_help, ROOT);
+  if (show_help) {
+    if (world.rank() == ROOT) {
+      std::cout << description << std::endl;
+    }
+    return EXIT_SUCCESS;
+  }
+  mpi::broadcast(world, kind, ROOT);
+  mpi::broadcast(world, parameters.number, ROOT);
+  mpi::broadcast(world, parameters.mass, ROOT);
+  mpi::broadcast(world, parameters.scale, ROOT);
+  mpi::broadcast(world, parameters.density, ROOT);
+  mpi::broadcast(world, parameters.concentration, ROOT);
+  mpi::broadcast(world, parameters.scale_height, ROOT);
+  mpi::broadcast(world, parameters.separation, ROOT);
+  mpi::broadcast(world, parameters.relative_speed, ROOT);
+  mpi::broadcast(world, output, ROOT);
+  mpi::broadcast(world, seed, ROOT);
+
+  mpi::broadcast(world, dimension, ROOT);
+  mpi::broadcast(world, precision, ROOT);
+
+  if (precision == n_body::config::Precision::Float) {
+    if (dimension == 2)
+      generate<float, 2>(world, kind, parameters, output, seed);
+    else
+      generate<float, 3>(world, kind, parameters, output, seed);
+  } else {
+    if (dimension == 2)
+      generate<double, 2>(world, kind, parameters, output, seed);
+    else
+      generate<double, 3>(world, kind, parameters, output, seed);
+  }
+  if (world.rank() == ROOT) {
+    logging::logger(logging::Level::Info)
+        << "generated " << parameters.number << " bodies of model " << kind
+        << " with seed " << seed << std::endl;
+  }
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,81 @@
+#include "../src/binary.hpp"
+#include "../src/compression.hpp"
+#include "../src/config.hpp"
+#include "../src/data.hpp"
+#include <boost/archive/xml_iarchive.hpp>
+#include <boost/program_options.hpp>
+#include <cstddef>
+#include <cstdlib>
+#include <filesystem>
+#include <iostream>
+#include <string>
+
+namespace po = boost::program_options;
+
+// xml archives do not record their layout, so it is given on the command
+// line like for the generator
+template <typename T, std::size_t Dimension>
+std::size_t convert(const std::string &input, const std::string &output) {
+  n_body::data::Bodies<T, Dimension> bodies;
+  {
+    auto is = n_body::compression::open_input(input);
+    boost::archive::xml_iarchive ar(*is);
+    ar >> BOOST_SERIALIZATION_NVP(bodies);
+  }
+  n_body::binary::write_bodies_file(std::filesystem::path(output), bodies);
+  return bodies.size();
+}
+
+// convert a (possibly compressed) xml bodies archive to the binary bodies
+// format which n-body reads in parallel
+int main(int argc, char **argv) {
+  unsigned dimension = 3;
+  auto precision = n_body::config::Precision::Double;
+
+  po::options_description description("options");
+  description.add_options()("help,h", "print help message");
+  description.add_options()("input,i", po::value<std::string>(),
+                            "input xml bodies file");
+  description.add_options()("output,o", po::value<std::string>(),
+                            "output binary bodies file");
+  description.add_options()("dimension",
+                            po::value<unsigned>()->default_value(dimension),
+                            "dimension of space, 2 or 3");
+  description.add_options()(
+      "precision",
+      po::value<n_body::config::Precision>()->default_value(precision),
+      "floating point type, float or double");
+
+  po::variables_map vm;
+  po::store(po::parse_command_line(argc, argv, description), vm);
+  po::notify(vm);
+
+  if (vm.count("help") || !vm.count("input") || !vm.count("output")) {
+    std::cout << description << std::endl;
+    return vm.count("help") ? EXIT_SUCCESS : EXIT_FAILURE;
+  }
+  auto input = vm["input"].as<std::string>();
+  auto output = vm["output"].as<std::string>();
+  dimension = vm["dimension"].as<unsigned>();
+  precision = vm["precision"].as<n_body::config::Precision>();
+  if (dimension != 2 && dimension != 3) {
+    std::cerr << "dimension " << dimension << " is not supported, use 2 or 3"
+              << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  std::size_t number = 0;
+  if (precision == n_body::config::Precision::Float) {
+    if (dimension == 2)
+      number = convert<float, 2>(input, output);
+    else
+      number = convert<float, 3>(input, output);
+  } else {
+    if (dimension == 2)
+      number = convert<double, 2>(input, output);
+    else
+      number = convert<double, 3>(input, output);
+  }
+  std::cout << "converted " << number << " bodies" << std::endl;
+  return EXIT_SUCCESS;
+}
@@ -1,13 +1,25 @@
+#include "src/async_output.hpp"
+#include "src/binary.hpp"
+#include "src/checkpoint.hpp"
+#include "src/compression.hpp"
 #include "src/config.hpp"
 #include "src/data.hpp"
+#include "src/diagnostics.hpp"
+#include "src/distributed.hpp"
 #include "src/input.hpp"
 #include "src/logging.hpp"
+#include "src/morton.hpp"
 #include "src/output.hpp"
 #include "src/physical.hpp"
+#include "src/profiling.hpp"
 #include "src/random.hpp"
 #include "src/random_body.hpp"
+#include "src/shared.hpp"
 #include "src/space.hpp"
+#include "src/timing.hpp"
+#include "src/trace.hpp"
 #include "src/tree.hpp"
+#include "src/walk.hpp"
 #include <algorithm>
 #include <array>
 #include <boost/archive/xml_oarchive.hpp>
@@ -17,18 +29,21 @@
 #include <boost/serialization/nvp.hpp>
 #include <cfenv>
 #include <cmath>
+#include <cstdint>
 #include <fenv.h>
 #include <filesystem>
 #include <fstream>
 #include <iostream>
 #include <limits>
-#include <random>
+#include <numeric>
 
 namespace mpi = boost::mpi;
 namespace po = boost::program_options;
 namespace logging = n_body::logging;
+namespace compression = n_body::compression;
 namespace fs = std::filesystem;
 
+// scalars are parsed in double and converted to the selected precision
 using Number = double;
 
 using boost::archive::xml_oarchive;
@@ -40,17 +55,21 @@ using std::endl;
 using std::size_t;
 using std::string;
 
-constexpr size_t DIMENSION = 3;
 constexpr int ROOT = 0;
 
 namespace n_body {
 
+template <typename T, size_t Dimension>
+int run(const mpi::communicator &world,
+        const config::Configuration<Number> &options);
+
 int main(int argc, char *argv[]) {
   // enable overflow check
   std::feclearexcept(FE_ALL_EXCEPT);
   feenableexcept(FE_DIVBYZERO | FE_UNDERFLOW | FE_OVERFLOW | FE_INVALID);
 
-  mpi::environment env(argc, argv, false);
+  // only the main thread calls mpi, the sample writer thread does not
+  mpi::environment env(argc, argv, mpi::threading::funneled, false);
   mpi::communicator world;
   mpi::timer timer;
 
@@ -66,26 +85,140 @@ int main(int argc, char *argv[]) {
     description.add_options()("sample-interval",
                               po::value<unsigned>()->default_value(10),
                               "Sample interval");
+    description.add_options()(
+        "output-queue-depth", po::value<unsigned>()->default_value(2),
+        "number of samples buffered for background writing (0 to write "
+        "synchronously)");
+    description.add_options()(
+        "dimension", po::value<unsigned>(),
+        "dimension of space, 2 or 3 (default: from a binary input file, "
+        "otherwise 3)");
+    description.add_options()(
+        "precision", po::value<config::Precision>(),
+        "floating point type, float or double (default: from a binary input "
+        "file, otherwise double)");
     description.add_options()("time,t", po::value<Number>()->default_value(1),
                               "time of every single step(s)");
     description.add_options()("gravitational-constant,G",
                               po::value<Number>()->default_value(1),
                               "the gravitational constant(m^3kg^-1s^-2)");
+    description.add_options()(
+        "method",
+        po::value<config::ForceMethod>()->default_value(
+            config::ForceMethod::Direct),
+        "how forces are computed, direct, tree, packet (the tree walked by "
+        "groups of bodies) or list (interaction lists of groups of bodies "
+        "reused over steps)");
     description.add_options()("theta,p",
                               po::value<Number>()->default_value(1),
                               "Barnes-Hut approximation parameter");
+    description.add_options()(
+        "opening",
+        po::value<config::OpeningCriterion>()->default_value(
+            config::OpeningCriterion::Geometric),
+        "when a node is accepted instead of opened: geometric (size / "
+        "distance below theta), salmon-warren (error bound of the node "
+        "below the tolerance) or relative (gadget style error below the "
+        "tolerance times the acceleration of the previous step, theta still "
+        "bounds the distance)");
+    description.add_options()(
+        "opening-tolerance", po::value<Number>()->default_value(0.0025),
+        "tolerance of the salmon-warren criterion relative to G M / r^2 "
+        "with r the half mass radius, or of the relative criterion");
+    description.add_options()(
+        "list-margin", po::value<Number>()->default_value(0.05),
+        "safety margin of the interaction lists relative to the size of "
+        "the root space, lists are rebuilt once a body moved half of it");
     description.add_options()(
         "output,o", po::value<string>()->default_value("n-body-output"),
         "output directory");
     description.add_options()("input,i", po::value<string>(),
                               "input bodies file");
+    description.add_options()(
+        "seed", po::value<std::uint64_t>(),
+        "seed of generated bodies (random if not specified)");
     description.add_options()(
         "min-log-level,m",
         po::value<logging::Level>()->default_value(logging::Level::Info),
         "Minimal log level");
+    description.add_options()(
+        "log-per-rank",
+        "write the trace, debug and info messages of every process to "
+        "_log.<rank>.txt in the output directory, in blocks, instead of "
+        "standard output");
     description.add_options()("soften-length",
                               po::value<Number>()->default_value(0),
                               "Soften length parameter");
+    description.add_options()(
+        "mixed-precision",
+        "compute interactions in float and accumulate them in full "
+        "precision");
+    description.add_options()(
+        "precision-report", po::value<unsigned>()->default_value(0),
+        "on every sample, compare the float interactions against full "
+        "precision on this many bodies per process (0 to disable)");
+    description.add_options()(
+        "compression",
+        po::value<compression::Method>()->default_value(
+            compression::Method::None),
+        "compression of samples and body dumps (none, gzip, bzip2 or zstd)");
+    description.add_options()(
+        "quantize", po::value<Number>()->default_value(0),
+        "write samples quantized to this precision and delta encoded against "
+        "the previous sample (0 to disable)");
+    description.add_options()(
+        "checkpoint-interval", po::value<unsigned>()->default_value(0),
+        "write a checkpoint every this many steps (0 to disable), a "
+        "checkpoint is also written on SIGUSR1");
+    description.add_options()(
+        "timing-interval", po::value<unsigned>()->default_value(0),
+        "reduce the time of every phase over processes every this many "
+        "steps and append it to _timings.csv (0 to disable)");
+    description.add_options()(
+        "communication-interval", po::value<unsigned>()->default_value(0),
+        "record calls, bytes, serialization, wait and mpi time of the "
+        "collectives, append them to _communication.csv every this many "
+        "steps and log the totals at exit (0 to disable), the wait is "
+        "measured by a barrier before every collective");
+    description.add_options()(
+        "diagnostics",
+        "on every sample, append the kinetic and potential energy, linear "
+        "and angular momentum and virial ratio to _diagnostics.csv, the "
+        "potential is computed by the force method along with the forces");
+    description.add_options()(
+        "tree-interval", po::value<unsigned>()->default_value(0),
+        "append the shape and memory of the tree and the spread of the "
+        "interactions per body to _tree.csv every this many steps (0 to "
+        "disable)");
+    description.add_options()(
+        "balance-interval", po::value<unsigned>()->default_value(0),
+        "every this many steps, divide the bodies between processes so that "
+        "every process gets the same number of interactions in the last "
+        "step instead of the same number of bodies (0 to disable)");
+    description.add_options()(
+        "trace",
+        "record a timeline of the phases of every process and write it to "
+        "_trace.<rank>.json in chrome trace format");
+    description.add_options()(
+        "trace-capacity", po::value<unsigned>()->default_value(1u << 16u),
+        "events kept per thread when tracing, older events are dropped");
+    description.add_options()(
+        "shared-memory",
+        "keep one copy of the bodies and the tree per node in mpi shared "
+        "memory instead of one per process");
+    description.add_options()(
+        "distributed",
+        "every process keeps only the bodies it owns, bodies are gathered "
+        "to root for output only, with --method direct the others pass by "
+        "in a ring, with --method tree and the geometric criterion bodies "
+        "migrate between slabs of space and every process receives the "
+        "nodes of the other trees its slab needs");
+    description.add_options()(
+        "reorder-interval", po::value<unsigned>()->default_value(0),
+        "sort bodies along the morton curve every this many steps (0 to "
+        "disable), output keeps the original order");
+    description.add_options()("restart,r", po::value<string>(),
+                              "continue from a checkpoint file");
 
     po::variables_map vm;
     po::store(po::parse_command_line(argc, argv, description), vm);
@@ -100,10 +233,41 @@ int main(int argc, char *argv[]) {
     }
     config.steps = vm["steps"].as<unsigned>();
     config.sample_interval = vm["sample-interval"].as<unsigned>();
+    config.output_queue_depth = vm["output-queue-depth"].as<unsigned>();
     config.time = vm["time"].as<Number>();
     config.G = vm["gravitational-constant"].as<Number>();
+    config.method = vm["method"].as<config::ForceMethod>();
     config.theta = vm["theta"].as<Number>();
+    config.opening = vm["opening"].as<config::OpeningCriterion>();
+    config.opening_tolerance = vm["opening-tolerance"].as<Number>();
+    config.list_margin = vm["list-margin"].as<Number>();
     config.soften_length = vm["soften-length"].as<Number>();
+    config.mixed_precision = vm.count("mixed-precision") != 0;
+    config.precision_report = vm["precision-report"].as<unsigned>();
+    config.compression = vm["compression"].as<compression::Method>();
+    config.quantize_precision = vm["quantize"].as<Number>();
+    config.checkpoint_interval = vm["checkpoint-interval"].as<unsigned>();
+    config.timing_interval = vm["timing-interval"].as<unsigned>();
+    config.communication_interval =
+        vm["communication-interval"].as<unsigned>();
+    config.diagnostics = vm.count("diagnostics") != 0;
+    config.tree_interval = vm["tree-interval"].as<unsigned>();
+    config.balance_interval = vm["balance-interval"].as<unsigned>();
+    config.trace = vm.count("trace") != 0;
+    config.trace_capacity = vm["trace-capacity"].as<unsigned>();
+    config.shared_memory = vm.count("shared-memory") != 0;
+    config.distributed = vm.count("distributed") != 0;
+    config.reorder_interval = vm["reorder-interval"].as<unsigned>();
+    if (vm.count("restart")) {
+      config.restart_file = vm["restart"].as<string>();
+    } else {
+      config.restart_file = boost::none;
+    }
+    if (vm.count("seed")) {
+      config.seed = vm["seed"].as<std::uint64_t>();
+    } else {
+      config.seed = random::new_seed();
+    }
     if (vm.count("input")) {
       config.input_file = vm["input"].as<string>();
     } else {
@@ -111,6 +275,30 @@ int main(int argc, char *argv[]) {
     }
     config.output_path = vm["output"].as<string>();
     config.min_log_level = vm["min-log-level"].as<logging::Level>();
+    config.log_per_rank = vm.count("log-per-rank") != 0;
+
+    // binary files record the layout they were written with
+    binary::Header header{};
+    bool has_header = false;
+    if (config.restart_file) {
+      has_header = binary::read_header(*config.restart_file, header) &&
+                   header.magic == checkpoint::MAGIC;
+    } else if (config.input_file) {
+      has_header = binary::read_header(*config.input_file, header) &&
+                   header.magic == binary::BODIES_MAGIC;
+    }
+    if (vm.count("dimension")) {
+      config.dimension = vm["dimension"].as<unsigned>();
+    } else if (has_header) {
+      config.dimension = header.dimension;
+    }
+    if (vm.count("precision")) {
+      config.precision = vm["precision"].as<config::Precision>();
+    } else if (has_header) {
+      config.precision = header.scalar_size == sizeof(float)
+                             ? config::Precision::Float
+                             : config::Precision::Double;
+    }
   }
   mpi::broadcast(world, config, ROOT);
 
@@ -132,6 +320,14 @@ int main(int argc, char *argv[]) {
                                  boost::archive::no_header)
         << boost::serialization::make_nvp("configuration", config);
 
+    if (!logging::compiled(config.min_log_level)) {
+      logger(Level::Warn) << config.min_log_level
+                          << " messages are not compiled in, build with "
+                             "N_BODY_LOG_MIN_LEVEL="
+                          << config.min_log_level << " to get them"
+                          << std::endl;
+    }
+
     if (config.input_file && config.number) {
       logger(Level::Error) << "input file and number options should not be "
                               "specified simultaneously"
@@ -139,11 +335,90 @@ int main(int argc, char *argv[]) {
       world.abort(MPI_ERR_ARG);
     }
 
-    if (!config.input_file && !config.number) {
+    if (config.restart_file && (config.input_file || config.number)) {
+      logger(Level::Error) << "restart file should not be specified with "
+                              "input file or number options"
+                           << std::endl;
+      world.abort(MPI_ERR_ARG);
+    }
+
+    if (!config.input_file && !config.number && !config.restart_file) {
       logger(Level::Error) << "please spcify either body number or input file" << std::endl;
       world.abort(MPI_ERR_ARG);
     }
+
+    if (config.dimension != 2 && config.dimension != 3) {
+      logger(Level::Error) << "dimension " << config.dimension
+                           << " is not supported, use 2 or 3" << std::endl;
+      world.abort(MPI_ERR_ARG);
+    }
+
+    if (config.opening == config::OpeningCriterion::Relative &&
+        config.method == config::ForceMethod::List) {
+      logger(Level::Error) << "the relative opening criterion depends on "
+                              "every body, it can not be used for "
+                              "interaction lists"
+                           << std::endl;
+      world.abort(MPI_ERR_ARG);
+    }
+
+    if (config.distributed &&
+        (config.shared_memory || config.precision_report != 0 ||
+         config.tree_interval != 0 || config.balance_interval != 0)) {
+      logger(Level::Error) << "distributed mode can not be combined with "
+                              "shared memory, precision reports, tree "
+                              "statistics or balancing"
+                           << std::endl;
+      world.abort(MPI_ERR_ARG);
+    }
+
+    // the essential trees are cut by the geometric radii of the senders
+    if (config.distributed &&
+        ((config.method != config::ForceMethod::Direct &&
+          config.method != config::ForceMethod::Tree) ||
+         config.opening != config::OpeningCriterion::Geometric)) {
+      logger(Level::Error) << "distributed mode computes forces by direct "
+                              "sum or by the tree with the geometric "
+                              "opening criterion only"
+                           << std::endl;
+      world.abort(MPI_ERR_ARG);
+    }
+
+    if (config.trace && config.trace_capacity == 0) {
+      logger(Level::Error) << "trace capacity must be at least 1 event"
+                           << std::endl;
+      world.abort(MPI_ERR_ARG);
+    }
+
+    if (config.tree_interval != 0 &&
+        config.method == config::ForceMethod::Direct) {
+      logger(Level::Error) << "tree statistics need one of the tree methods"
+                           << std::endl;
+      world.abort(MPI_ERR_ARG);
+    }
+
+    if (config.balance_interval != 0 &&
+        config.method == config::ForceMethod::Direct) {
+      logger(Level::Error) << "every body costs the same in a direct sum, "
+                              "balancing needs one of the tree methods"
+                           << std::endl;
+      world.abort(MPI_ERR_ARG);
+    }
+  }
+
+  // every combination is compiled, pick one at run time
+  if (config.precision == config::Precision::Float) {
+    return config.dimension == 2 ? run<float, 2>(world, config)
+                                 : run<float, 3>(world, config);
   }
+  return config.dimension == 2 ? run<double, 2>(world, config)
+                               : run<double, 3>(world, config);
+}
+
+template <typename T, size_t Dimension>
+int run(const mpi::communicator &world,
+        const config::Configuration<Number> &options) {
+  config::Configuration<T> config(options);
 
   boost::optional<fs::path> output_path;
   if (world.rank() == ROOT) {
@@ -163,15 +438,55 @@ int main(int argc, char *argv[]) {
     output::output_sample_number(*output_path, config);
   }
 
-  boost::optional<std::ifstream> infile = boost::none;
-  if (world.rank() == ROOT && config.input_file) {
-    infile = std::ifstream(*config.input_file);
+  // the other processes wait for root to create the output directory
+  boost::optional<logging::RankLog> rank_log;
+  if (config.log_per_rank) {
+    world.barrier();
+    rank_log.emplace(fs::path(config.output_path) /
+                     ("_log." + std::to_string(world.rank()) + ".txt"));
   }
 
-  data::Bodies<Number, DIMENSION> bodies;
-  if (infile) {
-    input::input_bodies(world, ROOT, *infile, bodies);
-    config.number = bodies.size();
+  checkpoint::install_request_handler();
+  profiling::Recorder::instance().enabled = config.communication_interval != 0;
+
+  data::Bodies<T, Dimension> bodies;
+  boost::optional<checkpoint::State<T, Dimension>> restart_state;
+  // ids of the bodies of the checkpoint, in the order of the bodies, and
+  // the accelerations of the division of this process
+  std::vector<std::uint64_t> restart_ids;
+  std::vector<T> restart_magnitudes;
+  if (config.restart_file) {
+    restart_state.emplace();
+    if (config.distributed) {
+      config.number = checkpoint::read_checkpoint_division(
+          world, ROOT, fs::path(*config.restart_file), *restart_state,
+          bodies, restart_ids, restart_magnitudes);
+    } else {
+      checkpoint::read_checkpoint(world, ROOT, fs::path(*config.restart_file),
+                                  *restart_state, bodies, restart_ids,
+                                  restart_magnitudes);
+      config.number = bodies.size();
+      // without reordering the bodies are kept in the order of their ids,
+      // the accelerations of the divisions belong to the old order
+      if (config.reorder_interval == 0 &&
+          !std::is_sorted(restart_ids.begin(), restart_ids.end())) {
+        bodies = morton::in_id_order(data::BodiesView<T, Dimension>(bodies),
+                                     restart_ids.data());
+        restart_magnitudes.clear();
+      }
+    }
+    if (world.rank() == ROOT) {
+      logger(Level::Info) << "restart from step " << restart_state->step
+                          << " with " << *config.number << " bodies" << endl;
+    }
+  } else if (config.input_file) {
+    if (config.distributed) {
+      config.number = input::input_bodies_division(
+          world, ROOT, fs::path(*config.input_file), bodies);
+    } else {
+      input::input_bodies(world, ROOT, fs::path(*config.input_file), bodies);
+      config.number = bodies.size();
+    }
   }
 
   if (*config.number % world.size() != 0) {
@@ -181,80 +496,529 @@ int main(int argc, char *argv[]) {
     world.abort(MPI_ERR_ARG);
   }
 
-  if (!infile) {
-    random::MinimunStandardEngine random_engine(world, ROOT);
-    random::body::BodyGenerator<Number, DIMENSION> body_generator =
-        [&](std::size_t i) {
-          auto min = static_cast<Number>(-10) * *config.number;
-          auto max = static_cast<Number>(10) * *config.number;
-          data::Body<Number, DIMENSION> body{};
-          for (std::size_t d = 0; d < DIMENSION; ++d) {
-            body.position[d] =
-                std::uniform_real_distribution<Number>(min, max)(random_engine);
-            body.velocity[d] = 0;
-          }
-          body.mass =
-              std::uniform_real_distribution<Number>(0.5, 1)(random_engine);
-          return body;
-        };
-    random::body::random_bodies(world, body_generator, bodies, *config.number);
+  if (!config.input_file && !config.restart_file) {
+    auto min = static_cast<T>(-10) * *config.number;
+    auto max = static_cast<T>(10) * *config.number;
+    if (config.distributed) {
+      communication::Division division(world, *config.number);
+      random::body::uniform_bodies(config.seed, division.begin,
+                                   division.count, min, max,
+                                   static_cast<T>(0.5), static_cast<T>(1),
+                                   bodies);
+    } else {
+      random::body::uniform_bodies(world, config.seed, *config.number, min,
+                                   max, static_cast<T>(0.5),
+                                   static_cast<T>(1), bodies);
+    }
   }
 
-  if (world.rank() == ROOT) {
-    output::dump_bodies(*output_path, bodies);
+  // in distributed mode every process starts with its division, root
+  // gathers the bodies whenever it needs all of them
+  boost::optional<distributed::Owned<T, Dimension>> owned;
+  boost::optional<distributed::Domains<T>> domains;
+  if (config.distributed) {
+    communication::Division division(world, *config.number);
+    owned.emplace(distributed::own(std::move(bodies), division.begin));
+    bodies.clear();
+    if (restart_state) {
+      owned->ids = std::move(restart_ids);
+    } else {
+      distributed::gather(world, ROOT, *owned, *config.number, bodies);
+    }
+  }
+
+  if (world.rank() == ROOT && !restart_state) {
+    output::dump_bodies(*output_path, bodies, config.compression);
   }
 
-  constexpr Number INF = std::numeric_limits<Number>::infinity();
-  data::Space<Number, DIMENSION> bounds{
-      .min =
-          {
-              INF,
-              INF,
-              INF,
-          },
-      .max =
-          {
-              -INF,
-              -INF,
-              -INF,
-          },
-      .center =
-          {
-              0,
-              0,
-              0,
-          },
+  // in shared memory mode the processes of a node share one copy, the
+  // copies of the processes are released
+  boost::optional<shared::Topology> topology;
+  boost::optional<shared::SharedArray<data::Body<T, Dimension>>>
+      shared_bodies;
+  boost::optional<shared::SharedArray<data::tree::FlatNode<T, Dimension>>>
+      shared_tree;
+  boost::optional<walk::SharedWalkTree<T, Dimension>> shared_walk_tree;
+  if (config.shared_memory) {
+    topology.emplace(world);
+    shared_bodies.emplace(*topology, bodies.size());
+    if (topology->is_leader()) {
+      std::copy(bodies.begin(), bodies.end(), shared_bodies->begin());
+    }
+    shared_bodies->fence();
+    shared_tree.emplace(*topology);
+    shared_walk_tree.emplace(*topology);
+    data::Bodies<T, Dimension>().swap(bodies);
+  }
+  auto bodies_view = [&]() {
+    return shared_bodies ? data::BodiesView<T, Dimension>(
+                               shared_bodies->data(), shared_bodies->size())
+                         : data::BodiesView<T, Dimension>(bodies);
+  };
+
+  // ids of the replicated bodies, distributed bodies carry their own
+  // a restart continues in the order of the checkpoint
+  std::vector<std::uint64_t> ids;
+  boost::optional<shared::SharedArray<std::uint64_t>> shared_ids;
+  if (config.reorder_interval != 0 && !owned) {
+    if (restart_state) {
+      ids = std::move(restart_ids);
+    } else {
+      ids.resize(*config.number);
+      std::iota(ids.begin(), ids.end(), 0);
+    }
+    if (shared_bodies) {
+      shared_ids.emplace(*topology, *config.number);
+      if (topology->is_leader()) {
+        std::copy(ids.begin(), ids.end(), shared_ids->begin());
+      }
+      shared_ids->fence();
+      std::vector<std::uint64_t>().swap(ids);
+    }
+  }
+  auto ids_data = [&]() {
+    return shared_ids ? shared_ids->data() : ids.data();
   };
+  // bodies in the order of their ids, for output
+  data::Bodies<T, Dimension> ordered;
+  auto output_view = [&]() {
+    if (owned || config.reorder_interval == 0)
+      return bodies_view();
+    ordered = morton::in_id_order(bodies_view(), ids_data());
+    return data::BodiesView<T, Dimension>(ordered);
+  };
+
+  constexpr T INF = std::numeric_limits<T>::infinity();
+  data::Space<T, Dimension> bounds{};
+  bounds.min.fill(INF);
+  bounds.max.fill(-INF);
   std::size_t output_index = 0;
+  decltype(config.steps) first_step = 0;
+  if (restart_state) {
+    bounds = restart_state->bounds;
+    output_index = restart_state->output_index;
+    first_step = restart_state->step;
+  }
+  timing::Recorder::instance().enabled = config.timing_interval != 0;
+  if (config.trace) {
+    trace::enable(world, config.trace_capacity);
+  }
+  boost::optional<output::AsyncPositionsWriter<T, Dimension>>
+      positions_writer;
   if (world.rank() == ROOT) {
-    output::output_positions(*output_path, output_index, bodies);
-    logger(Level::Info) << "output initial step with index " << output_index
-                        << " finished" << endl;
-    ++output_index;
+    positions_writer.emplace(*output_path, config.output_queue_depth,
+                             config.compression, config.quantize_precision);
+    if (!restart_state) {
+      positions_writer->push(output_index, bodies_view());
+      logger(Level::Info) << "output initial step with index " << output_index
+                          << " queued" << endl;
+      ++output_index;
+    }
+  }
+  if (owned) {
+    data::Bodies<T, Dimension>().swap(bodies);
   }
-  for (decltype(config.steps) s = 0; s < config.steps;) {
-    auto root_space = space::root_space(world, bodies);
-    space::extend_to_contain(bounds, root_space);
-    auto body_tree = data::tree::build_tree(world, root_space, bodies);
-    physical::step(config, world, bodies, body_tree);
+  // interaction lists of the local bodies, kept over steps
+  boost::optional<walk::InteractionLists<T, Dimension>> lists;
+  // accelerations of the local bodies in the previous step, for the
+  // relative opening criterion
+  std::vector<T> magnitudes = std::move(restart_magnitudes);
+  auto keep_magnitudes =
+      !owned && config.opening == config::OpeningCriterion::Relative;
+  // statistics of the last tree built and the size of what the walk used,
+  // kept while the interaction lists are reused
+  data::tree::TreeStatistics tree_statistics;
+  std::size_t walk_bytes = 0;
+  auto *statistics_pointer =
+      config.tree_interval != 0 ? &tree_statistics : nullptr;
+  // divisions of the replicated bodies for the forces, weighted by the
+  // interactions of every body when balancing, equal ones while empty
+  communication::Partition partition;
+  // the local bodies changed since the last step
+  bool repartitioned = false;
+  // one step of the replicated bodies with the force method of the
+  // configuration, `potential` and `interactions` are passed on to
+  // physical::step
+  auto replicated_step = [&](const config::Configuration<T> &step_config,
+                             const data::Space<T, Dimension> &root_space,
+                             bool reorder, T *potential,
+                             std::vector<std::uint64_t> *interactions) {
+    // in shared memory mode the walk tree is laid out once per node
+    auto build_shared_walk_tree = [&]() {
+      data::tree::build_shared_tree(*topology, root_space, bodies_view(),
+                                    *shared_tree, statistics_pointer);
+      timing::Scope scope(timing::Phase::TreeBuild);
+      shared_walk_tree->build(*shared_tree, step_config);
+    };
+    auto build_walk_tree = [&]() {
+      auto body_tree = data::tree::build_tree(world, root_space, bodies,
+                                              statistics_pointer);
+      timing::Scope scope(timing::Phase::TreeBuild);
+      return walk::WalkTree<T, Dimension>::from_flat(body_tree.flatten(),
+                                                     step_config);
+    };
+    auto advance = [&](const auto &source, auto &...state) {
+      if (shared_bodies) {
+        physical::step(step_config, *topology, partition, *shared_bodies,
+                       source, state...);
+      } else {
+        physical::step(step_config, world, partition, bodies, source,
+                       state...);
+      }
+    };
+
+    // the accelerations and lists belong to the local bodies before
+    // reordering or balancing
+    reorder = reorder || repartitioned;
+    repartitioned = false;
+    if (step_config.method == config::ForceMethod::Direct) {
+      advance(bodies_view(), potential);
+    } else if (step_config.method != config::ForceMethod::List) {
+      if (reorder)
+        magnitudes.clear();
+      if (shared_bodies) {
+        build_shared_walk_tree();
+        walk_bytes = shared_walk_tree->bytes();
+        advance(shared_walk_tree->view(), magnitudes, potential,
+                interactions);
+      } else {
+        auto walk_tree = build_walk_tree();
+        walk_bytes = walk_tree.bytes();
+        advance(walk_tree, magnitudes, potential, interactions);
+      }
+    } else {
+      // every process checks its own bodies, all of them agree on
+      // rebuilding
+      bool expired = lists && lists->expired(bodies_view());
+      mpi::all_reduce(world, mpi::inplace(expired), std::logical_or<bool>());
+      if (!lists || reorder || expired) {
+        communication::Division division(world, bodies_view().size(),
+                                         partition);
+        auto margin =
+            step_config.list_margin * space::size_of_space(root_space);
+        if (shared_bodies) {
+          build_shared_walk_tree();
+          timing::Scope scope(timing::Phase::TreeBuild);
+          lists = walk::InteractionLists<T, Dimension>::build(
+              *shared_walk_tree, root_space, bodies_view(), division.begin,
+              division.count, margin);
+        } else {
+          auto walk_tree = build_walk_tree();
+          timing::Scope scope(timing::Phase::TreeBuild);
+          lists = walk::InteractionLists<T, Dimension>::build(
+              std::move(walk_tree), root_space, bodies_view(),
+              division.begin, division.count, margin);
+        }
+        N_BODY_LOG(Debug) << "interaction lists rebuilt" << endl;
+      } else {
+        timing::Scope scope(timing::Phase::TreeBuild);
+        lists->refresh(bodies_view());
+      }
+      walk_bytes = lists->bytes();
+      advance(*lists, potential, interactions);
+    }
+  };
+  // kinetic energy and momenta of the local bodies
+  auto local_diagnostics = [&]() {
+    if (owned) {
+      return diagnostics::of_bodies<T, Dimension>(owned->bodies.begin(),
+                                                  owned->bodies.end());
+    }
+    auto view = bodies_view();
+    communication::Division division(world, view.size());
+    return diagnostics::of_bodies<T, Dimension>(view.begin() + division.begin,
+                                                view.begin() + division.end);
+  };
+  auto output_diagnostics = [&](std::size_t step,
+                                diagnostics::Diagnostics<T, Dimension> local,
+                                T potential) {
+    local.potential = potential;
+    auto total = diagnostics::reduce(world, ROOT, local);
+    if (world.rank() == ROOT) {
+      output::output_diagnostics(*output_path, step, total);
+    }
+  };
+  // `interactions` of the local bodies in the step leaving `step`
+  auto output_tree = [&](std::size_t step,
+                         const std::vector<std::uint64_t> &interactions) {
+    auto summary = walk::summarize(world, ROOT, interactions);
+    if (world.rank() == ROOT) {
+      output::output_tree(*output_path, step, tree_statistics, walk_bytes,
+                          summary);
+      N_BODY_LOG(Debug) << "tree of step " << step << ": "
+                        << tree_statistics.nodes << " nodes, depth "
+                        << tree_statistics.max_depth << ", "
+                        << tree_statistics.bytes << " bytes, "
+                        << summary.mean() << " interactions per body"
+                        << endl;
+    }
+  };
+  // divide the bodies again so that every process gets the same number of
+  // `interactions` as in the step leaving `step`, every process computes
+  // the same partition
+  auto balance = [&](std::size_t step,
+                     const std::vector<std::uint64_t> &interactions) {
+    // a body costs at least its own update
+    std::vector<std::uint64_t> costs(interactions.size());
+    std::transform(interactions.begin(), interactions.end(), costs.begin(),
+                   [](std::uint64_t count) { return count + 1; });
+    std::vector<std::uint64_t> all_costs;
+    std::vector<int> counts;
+    profiling::all_gatherv(world, profiling::Collective::CostGather, costs,
+                           all_costs, counts);
+    auto before = communication::imbalance(
+        all_costs, partition.empty()
+                       ? communication::equal(all_costs.size(), world.size())
+                       : partition);
+    partition = communication::balance(all_costs, world.size());
+    repartitioned = true;
+    if (world.rank() == ROOT) {
+      logger(Level::Info) << "load imbalance of step " << step << ": "
+                          << before << ", "
+                          << communication::imbalance(all_costs, partition)
+                          << " after balancing" << endl;
+    }
+  };
+  // one step of the owned bodies, the tree method first moves them to the
+  // owners of their slabs
+  auto distributed_step = [&](const config::Configuration<T> &step_config,
+                              const data::Space<T, Dimension> &root_space,
+                              T *potential) {
+    if (step_config.method == config::ForceMethod::Direct) {
+      distributed::step(step_config, world, *owned, potential);
+      return;
+    }
+    {
+      timing::Scope scope(timing::Phase::Migrate);
+      if (!domains || distributed::imbalance(world, *owned, *config.number) >
+                          distributed::REBALANCE_IMBALANCE) {
+        domains = distributed::decompose(world, root_space, *owned);
+        N_BODY_LOG(Debug) << "domains rebalanced" << endl;
+      }
+      distributed::migrate(world, *domains, *owned);
+    }
+    distributed::tree_step(step_config, world, root_space, *owned, potential);
+  };
+  auto timing_first_step = first_step;
+  auto communication_first_step = first_step;
+  for (decltype(config.steps) s = first_step; s < config.steps;) {
+    trace::set_step(s);
+    data::Space<T, Dimension> root_space;
+    {
+      timing::Scope scope(timing::Phase::RootSpace);
+      root_space = owned ? distributed::root_space(world, *owned)
+                         : space::root_space(world, bodies_view());
+      space::extend_to_contain(bounds, root_space);
+    }
+    auto reorder =
+        config.reorder_interval != 0 && s % config.reorder_interval == 0;
+    if (reorder) {
+      // every process computes the same order of the replicated bodies
+      timing::Scope scope(timing::Phase::Reorder);
+      if (owned) {
+        morton::reorder(root_space, owned->bodies.data(), owned->ids.data(),
+                        owned->bodies.size());
+      } else if (shared_bodies) {
+        if (topology->is_leader()) {
+          morton::reorder(root_space, shared_bodies->data(), ids_data(),
+                          shared_bodies->size());
+        }
+        shared_bodies->fence();
+      } else {
+        morton::reorder(root_space, bodies.data(), ids.data(), bodies.size());
+      }
+    }
+    // diagnostics of a sample are taken from the state before the step
+    // leaving it, the potential comes with the forces of that step
+    bool diagnose = config.diagnostics && s % config.sample_interval == 0;
+    diagnostics::Diagnostics<T, Dimension> diagnosed;
+    T potential = 0;
+    T *potential_pointer = diagnose ? &potential : nullptr;
+    if (diagnose)
+      diagnosed = local_diagnostics();
+    bool describe_tree =
+        config.tree_interval != 0 && s % config.tree_interval == 0;
+    // a new order makes the weights of the divisions meaningless, the
+    // bodies are divided equally for the step and balanced after it
+    bool balance_step = config.balance_interval != 0 &&
+                        (s % config.balance_interval == 0 ||
+                         (reorder && !partition.empty()));
+    if (reorder && !owned)
+      partition.clear();
+    std::vector<std::uint64_t> interactions;
+    if (owned) {
+      distributed_step(config, root_space, potential_pointer);
+    } else {
+      replicated_step(config, root_space, reorder, potential_pointer,
+                      describe_tree || balance_step ? &interactions
+                                                    : nullptr);
+      if (balance_step)
+        balance(s, interactions);
+    }
+    if (diagnose)
+      output_diagnostics(s, diagnosed, potential);
+    if (describe_tree)
+      output_tree(s, interactions);
 
     ++s;
 
-    if (world.rank() == ROOT && s % config.sample_interval == 0) {
-      // do sample
-      output::output_positions(*output_path, output_index, bodies);
-      logger(Level::Info) << "output step " << s << " with index "
-                          << output_index << " finished" << endl;
-      ++output_index;
+    if (config.precision_report != 0 && s % config.sample_interval == 0) {
+      auto report = physical::precision_report(config, world, bodies_view(),
+                                               config.precision_report);
+      if (world.rank() == ROOT) {
+        logger(Level::Info) << "mixed precision error of step " << s
+                            << " over " << report.samples
+                            << " bodies: max " << std::scientific
+                            << report.max_relative_error << ", rms "
+                            << report.rms_relative_error << endl;
+      }
+    }
+
+    {
+      timing::Scope scope(timing::Phase::Output);
+      bool take_sample = s % config.sample_interval == 0;
+      bool take_checkpoint =
+          world.rank() == ROOT && ((config.checkpoint_interval != 0 &&
+                                    s % config.checkpoint_interval == 0) ||
+                                   checkpoint::take_request());
+      if (owned || keep_magnitudes) {
+        mpi::broadcast(world, take_checkpoint, ROOT);
+      }
+      // root only holds all bodies while writing them
+      if (owned && (take_checkpoint || take_sample)) {
+        distributed::gather(world, ROOT, *owned, *config.number, bodies);
+      }
+      // the accelerations the next step would go on with, none after
+      // balancing, which drops them
+      std::vector<T> all_magnitudes;
+      if (keep_magnitudes && take_checkpoint) {
+        communication::Division division(world, bodies_view().size(),
+                                         partition);
+        std::vector<T> known;
+        if (!repartitioned && magnitudes.size() == division.count)
+          known = magnitudes;
+        std::vector<int> counts;
+        profiling::all_gatherv(world, profiling::Collective::BodiesGather,
+                               known, all_magnitudes, counts);
+        if (all_magnitudes.size() != bodies_view().size())
+          all_magnitudes.clear();
+      }
+
+      if (world.rank() == ROOT && (take_sample || take_checkpoint)) {
+        auto output_bodies = output_view();
+        if (take_sample) {
+          positions_writer->push(output_index, output_bodies);
+          logger(Level::Info) << "output step " << s << " with index "
+                              << output_index << " queued" << endl;
+          ++output_index;
+        }
+
+        if (take_checkpoint) {
+          // samples before the checkpoint must be complete
+          positions_writer->flush();
+          // the replicated bodies are written in the order of the run
+          checkpoint::State<T, Dimension> state{s, output_index, bounds};
+          const T *accelerations =
+              all_magnitudes.empty() ? nullptr : all_magnitudes.data();
+          if (owned || config.reorder_interval == 0) {
+            checkpoint::write_checkpoint(*output_path / "_checkpoint.bin",
+                                         state, output_bodies, nullptr,
+                                         accelerations);
+          } else {
+            checkpoint::write_checkpoint(*output_path / "_checkpoint.bin",
+                                         state, bodies_view(), ids_data(),
+                                         accelerations);
+          }
+          logger(Level::Info)
+              << "checkpoint of step " << s << " written" << endl;
+        }
+      }
+      if (owned) {
+        data::Bodies<T, Dimension>().swap(bodies);
+      }
+    }
+
+    if (config.timing_interval != 0 &&
+        (s % config.timing_interval == 0 || s == config.steps)) {
+      auto summary = timing::reduce(world, ROOT);
+      if (world.rank() == ROOT) {
+        output::output_timings(*output_path, timing_first_step, s, summary);
+      }
+      timing_first_step = s;
+    }
+
+    if (config.communication_interval != 0 &&
+        (s % config.communication_interval == 0 || s == config.steps)) {
+      auto summary = profiling::reduce_interval(world, ROOT);
+      if (world.rank() == ROOT) {
+        output::output_communication(*output_path, communication_first_step,
+                                     s, summary);
+      }
+      communication_first_step = s;
+    }
+  }
+  // no step leaves the last sample, its potential is computed by a step of
+  // zero time, which leaves the bodies where they are
+  if (config.diagnostics && config.steps % config.sample_interval == 0 &&
+      first_step < config.steps) {
+    auto still_config = config;
+    still_config.time = 0;
+    auto diagnosed = local_diagnostics();
+    T potential = 0;
+    if (owned) {
+      distributed_step(still_config, distributed::root_space(world, *owned),
+                       &potential);
+    } else {
+      replicated_step(still_config, space::root_space(world, bodies_view()),
+                      false, &potential, nullptr);
     }
+    output_diagnostics(config.steps, diagnosed, potential);
+  }
+  if (owned) {
+    space::extend_to_contain(bounds, distributed::root_space(world, *owned));
+    distributed::gather(world, ROOT, *owned, *config.number, bodies);
+  } else {
+    space::extend_to_contain(bounds,
+                             space::root_space(world, bodies_view()));
   }
-  space::extend_to_contain(bounds, space::root_space(world, bodies));
 
   if (world.rank() == ROOT) {
+    // wait for pending samples
+    positions_writer->flush();
+    logger(Level::Info) << "all samples written" << endl;
+
     // save last bodies
-    output::dump_bodies_finished(*output_path, bodies);
+    if (!owned && config.reorder_interval != 0) {
+      bodies = morton::in_id_order(bodies_view(), ids_data());
+    } else if (shared_bodies) {
+      bodies.assign(shared_bodies->begin(), shared_bodies->end());
+    }
+    output::dump_bodies_finished(*output_path, bodies, config.compression);
     output::output_bounds(*output_path, bounds);
   }
+
+  if (config.communication_interval != 0) {
+    auto summary = profiling::reduce_run(world, ROOT);
+    if (world.rank() == ROOT) {
+      for (std::size_t i = 0; i < profiling::COLLECTIVES; ++i) {
+        const auto &c = summary[i];
+        logger(Level::Info)
+            << static_cast<profiling::Collective>(i) << ": " << c.calls
+            << " calls, " << c.messages << " messages, " << c.raw_bytes
+            << " raw bytes, " << c.serialized_bytes << " serialized bytes, "
+            << std::scientific << c.serialization_time
+            << "s serialization, " << c.wait_time << "s waiting, "
+            << c.mpi_time << "s in mpi" << endl;
+      }
+    }
+  }
+
+  if (config.trace) {
+    // every process writes its own timeline
+    trace::write(fs::path(config.output_path) /
+                     ("_trace." + std::to_string(world.rank()) + ".json"),
+                 world.rank());
+  }
   return 0;
 }
 
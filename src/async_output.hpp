@@ -0,0 +1,166 @@
+#ifndef N_BODY_ASYNC_OUTPUT_HPP
+#define N_BODY_ASYNC_OUTPUT_HPP
+
+#include "compression.hpp"
+#include "data.hpp"
+#include "output.hpp"
+#include "trace.hpp"
+#include <boost/optional.hpp>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <filesystem>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace n_body::output {
+
+// write samples in a background thread
+// positions are copied into a staging buffer, so the caller can continue
+// updating bodies as soon as push() returns
+// at most `depth` samples are waiting, push() blocks when the queue is full
+// a depth of 0 makes every push() write synchronously
+template <typename T, std::size_t Dimension> class AsyncPositionsWriter {
+public:
+  using positions_type = std::vector<data::Vector<T, Dimension>>;
+
+  // a positive `precision` enables the lossy quantized output
+  AsyncPositionsWriter(std::filesystem::path directory_path, std::size_t depth,
+                       compression::Method compression, T precision)
+      : directory_path(std::move(directory_path)), depth(depth),
+        compression(compression) {
+    if (precision > 0) {
+      this->quantizer.emplace(precision);
+    }
+    if (this->depth != 0) {
+      this->worker = std::thread([this]() { this->run(); });
+    }
+  }
+
+  AsyncPositionsWriter(const AsyncPositionsWriter &) = delete;
+  AsyncPositionsWriter &operator=(const AsyncPositionsWriter &) = delete;
+
+  ~AsyncPositionsWriter() {
+    if (this->worker.joinable()) {
+      {
+        std::lock_guard<std::mutex> lock(this->mutex);
+        this->stopping = true;
+      }
+      this->not_empty.notify_one();
+      this->worker.join();
+    }
+  }
+
+  void push(std::size_t number,
+            const data::BodiesView<T, Dimension> &bodies) {
+    if (this->depth == 0) {
+      // reuse a single staging buffer
+      if (this->recycled.empty())
+        this->recycled.emplace_back();
+      stage(this->recycled.back(), bodies);
+      this->write(number, this->recycled.back());
+      return;
+    }
+
+    positions_type staging;
+    {
+      std::unique_lock<std::mutex> lock(this->mutex);
+      this->not_full.wait(
+          lock, [this]() { return this->pending.size() < this->depth; });
+      if (!this->recycled.empty()) {
+        staging = std::move(this->recycled.back());
+        this->recycled.pop_back();
+      }
+    }
+
+    // copy outside the lock, the worker may be writing meanwhile
+    stage(staging, bodies);
+
+    {
+      std::lock_guard<std::mutex> lock(this->mutex);
+      this->pending.emplace_back(number, std::move(staging));
+    }
+    this->not_empty.notify_one();
+  }
+
+  // block until all pushed samples are written
+  void flush() {
+    if (this->depth == 0)
+      return;
+    std::unique_lock<std::mutex> lock(this->mutex);
+    this->drained.wait(lock, [this]() {
+      return this->pending.empty() && !this->writing;
+    });
+  }
+
+private:
+  static void stage(positions_type &staging,
+                    const data::BodiesView<T, Dimension> &bodies) {
+    staging.resize(bodies.size());
+    for (std::size_t i = 0; i < bodies.size(); ++i) {
+      staging[i] = bodies[i].position;
+    }
+  }
+
+  void write(std::size_t number, const positions_type &positions) {
+    trace::Span span("write_sample",
+                     positions.size() * sizeof(data::Vector<T, Dimension>));
+    if (this->quantizer) {
+      output_quantized_positions(this->directory_path, number, positions,
+                                 *this->quantizer, this->compression);
+    } else {
+      output_positions(this->directory_path, number, positions,
+                       this->compression);
+    }
+  }
+
+  void run() {
+    std::unique_lock<std::mutex> lock(this->mutex);
+    while (true) {
+      this->not_empty.wait(lock, [this]() {
+        return this->stopping || !this->pending.empty();
+      });
+      if (this->pending.empty()) {
+        // stopping and nothing left
+        return;
+      }
+      auto sample = std::move(this->pending.front());
+      this->pending.pop_front();
+      this->writing = true;
+      lock.unlock();
+      this->not_full.notify_one();
+
+      this->write(sample.first, sample.second);
+
+      lock.lock();
+      this->writing = false;
+      this->recycled.push_back(std::move(sample.second));
+      if (this->pending.empty()) {
+        this->drained.notify_all();
+      }
+    }
+  }
+
+  std::filesystem::path directory_path;
+  std::size_t depth;
+  compression::Method compression;
+  // only touched by the thread writing samples
+  boost::optional<PositionsQuantizer<T, Dimension>> quantizer;
+
+  std::deque<std::pair<std::size_t, positions_type>> pending;
+  std::vector<positions_type> recycled;
+  bool writing = false;
+  bool stopping = false;
+
+  std::mutex mutex;
+  std::condition_variable not_full;
+  std::condition_variable not_empty;
+  std::condition_variable drained;
+  std::thread worker;
+};
+
+} // namespace n_body::output
+
+#endif
@@ -0,0 +1,278 @@
+#ifndef N_BODY_BINARY_HPP
+#define N_BODY_BINARY_HPP
+
+#include "communication.hpp"
+#include "data.hpp"
+#include "logging.hpp"
+#include "profiling.hpp"
+#include <array>
+#include <boost/mpi.hpp>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <string>
+
+namespace n_body::binary {
+
+using Magic = std::array<char, 8>;
+
+// raised whenever the layout of a file behind the header changes, version
+// 2 added the ids and accelerations of checkpoints and writes their state
+// field by field
+constexpr std::uint32_t VERSION = 2;
+
+constexpr std::array<char, 8> BODIES_MAGIC = {'N', 'B', 'O', 'D',
+                                              'Y', 'B', 'I', 'N'};
+
+
+// fixed layout header in front of raw body records
+// files are written in native byte order and are only meant to be read on
+// machines with the same layout
+struct Header {
+  Magic magic;
+  std::uint32_t version;
+  std::uint32_t dimension;
+  std::uint32_t scalar_size;
+  std::uint32_t body_size;
+  std::uint64_t number;
+};
+
+static_assert(sizeof(Header) == 32, "binary header must not be padded");
+
+template <typename T, std::size_t Dimension>
+Header make_header(const Magic &magic, std::uint64_t number) {
+  return Header{
+      magic,
+      VERSION,
+      static_cast<std::uint32_t>(Dimension),
+      static_cast<std::uint32_t>(sizeof(T)),
+      static_cast<std::uint32_t>(sizeof(data::Body<T, Dimension>)),
+      number,
+  };
+}
+
+// return an error message if the header does not match, empty otherwise
+template <typename T, std::size_t Dimension>
+std::string check_header(const Header &header, const Magic &magic) {
+  if (header.magic != magic)
+    return "bad magic number";
+  if (header.version != VERSION)
+    return "unsupported version " + std::to_string(header.version);
+  if (header.dimension != Dimension)
+    return "dimension " + std::to_string(header.dimension) +
+           " does not match " + std::to_string(Dimension);
+  if (header.scalar_size != sizeof(T))
+    return "scalar size " + std::to_string(header.scalar_size) +
+           " does not match " + std::to_string(sizeof(T));
+  if (header.body_size != sizeof(data::Body<T, Dimension>))
+    return "body record size " + std::to_string(header.body_size) +
+           " does not match " +
+           std::to_string(sizeof(data::Body<T, Dimension>));
+  return "";
+}
+
+// scalars and fixed size arrays of them are written in native layout one
+// after another, without the padding of the structs holding them
+template <typename V> void write_value(std::ostream &os, const V &value) {
+  os.write(reinterpret_cast<const char *>(&value), sizeof(value));
+}
+
+template <typename V, std::size_t N>
+void write_value(std::ostream &os, const std::array<V, N> &values) {
+  for (const auto &value : values)
+    write_value(os, value);
+}
+
+template <typename V> void read_value(std::istream &is, V &value) {
+  is.read(reinterpret_cast<char *>(&value), sizeof(value));
+}
+
+template <typename V, std::size_t N>
+void read_value(std::istream &is, std::array<V, N> &values) {
+  for (auto &value : values)
+    read_value(is, value);
+}
+
+template <typename T, std::size_t Dimension>
+void write_bodies(std::ostream &os,
+                  const data::BodiesView<T, Dimension> &bodies) {
+  os.write(reinterpret_cast<const char *>(bodies.data()),
+           static_cast<std::streamsize>(bodies.size() *
+                                        sizeof(data::Body<T, Dimension>)));
+}
+
+template <typename T, std::size_t Dimension>
+void read_bodies(std::istream &is, data::Bodies<T, Dimension> &bodies,
+                 std::size_t number) {
+  bodies.resize(number);
+  is.read(reinterpret_cast<char *>(bodies.data()),
+          static_cast<std::streamsize>(number *
+                                       sizeof(data::Body<T, Dimension>)));
+}
+
+// bodies file layout: Header with BODIES_MAGIC, then raw body records
+// the body array starts at a fixed offset, so the file can be memory mapped
+// or read in slices
+template <typename T, std::size_t Dimension>
+void write_bodies_file(const std::filesystem::path &path,
+                       const data::Bodies<T, Dimension> &bodies) {
+  std::ofstream os(path, std::ios::out | std::ios::binary);
+  auto header = make_header<T, Dimension>(BODIES_MAGIC, bodies.size());
+  os.write(reinterpret_cast<const char *>(&header), sizeof(header));
+  write_bodies(os, data::BodiesView<T, Dimension>(bodies));
+}
+
+// whether the file starts with the magic number
+inline bool has_magic(const std::filesystem::path &path, const Magic &magic) {
+  std::ifstream is(path, std::ios::in | std::ios::binary);
+  Magic file_magic{};
+  is.read(file_magic.data(), file_magic.size());
+  return is && file_magic == magic;
+}
+
+// read the header of a bodies file or checkpoint without checking it
+// return false if the file is shorter than a header
+inline bool read_header(const std::filesystem::path &path, Header &header) {
+  std::ifstream is(path, std::ios::in | std::ios::binary);
+  is.read(reinterpret_cast<char *>(&header), sizeof(header));
+  return static_cast<bool>(is);
+}
+
+namespace detail {
+
+inline void check_mpi_io(const boost::mpi::communicator &comm, int error,
+                         const std::filesystem::path &path,
+                         const char *operation) {
+  if (error != MPI_SUCCESS) {
+    char message[MPI_MAX_ERROR_STRING];
+    int length = 0;
+    MPI_Error_string(error, message, &length);
+    logging::logger(logging::Level::Error)
+        << operation << " " << path << " failed: "
+        << std::string(message, length) << std::endl;
+    comm.abort(error);
+  }
+}
+
+} // namespace detail
+
+// collectively read body records [first, first + count) of the body array
+// starting at `offset` bytes into the file
+template <typename T, std::size_t Dimension>
+void read_bodies_at(const boost::mpi::communicator &comm,
+                    const std::filesystem::path &path, std::uint64_t offset,
+                    std::size_t first, std::size_t count,
+                    data::Bodies<T, Dimension> &bodies) {
+  constexpr auto BODY_SIZE = sizeof(data::Body<T, Dimension>);
+  bodies.resize(count);
+
+  MPI_File file;
+  detail::check_mpi_io(comm,
+                       MPI_File_open(comm, path.c_str(), MPI_MODE_RDONLY,
+                                     MPI_INFO_NULL, &file),
+                       path, "open");
+  // count bodies instead of bytes to stay below the int limit
+  MPI_Datatype body_type;
+  MPI_Type_contiguous(static_cast<int>(BODY_SIZE), MPI_BYTE, &body_type);
+  MPI_Type_commit(&body_type);
+  detail::check_mpi_io(
+      comm,
+      MPI_File_read_at_all(file,
+                           static_cast<MPI_Offset>(offset + first * BODY_SIZE),
+                           bodies.data(), static_cast<int>(count), body_type,
+                           MPI_STATUS_IGNORE),
+      path, "read");
+  MPI_Type_free(&body_type);
+  MPI_File_close(&file);
+}
+
+// collectively write a bodies file, every rank writes its own slice of
+// `number` bodies starting at body `first`, root also writes the header
+template <typename T, std::size_t Dimension>
+void write_bodies_file(const boost::mpi::communicator &comm, int root,
+                       const std::filesystem::path &path,
+                       const data::Bodies<T, Dimension> &local_bodies,
+                       std::size_t first, std::size_t number) {
+  constexpr auto BODY_SIZE = sizeof(data::Body<T, Dimension>);
+
+  MPI_File file;
+  detail::check_mpi_io(comm,
+                       MPI_File_open(comm, path.c_str(),
+                                     MPI_MODE_WRONLY | MPI_MODE_CREATE,
+                                     MPI_INFO_NULL, &file),
+                       path, "open");
+  detail::check_mpi_io(
+      comm,
+      MPI_File_set_size(file,
+                        static_cast<MPI_Offset>(sizeof(Header) +
+                                                number * BODY_SIZE)),
+      path, "resize");
+  if (comm.rank() == root) {
+    auto header = make_header<T, Dimension>(BODIES_MAGIC, number);
+    detail::check_mpi_io(comm,
+                         MPI_File_write_at(file, 0, &header, sizeof(header),
+                                           MPI_BYTE, MPI_STATUS_IGNORE),
+                         path, "write");
+  }
+  MPI_Datatype body_type;
+  MPI_Type_contiguous(static_cast<int>(BODY_SIZE), MPI_BYTE, &body_type);
+  MPI_Type_commit(&body_type);
+  detail::check_mpi_io(
+      comm,
+      MPI_File_write_at_all(
+          file, static_cast<MPI_Offset>(sizeof(Header) + first * BODY_SIZE),
+          local_bodies.data(), static_cast<int>(local_bodies.size()),
+          body_type, MPI_STATUS_IGNORE),
+      path, "write");
+  MPI_Type_free(&body_type);
+  MPI_File_close(&file);
+}
+
+// read the header in root, then let every rank read its own division of the
+// bodies in parallel
+// return the number of bodies in the file
+template <typename T, std::size_t Dimension>
+std::uint64_t read_bodies_file_division(const boost::mpi::communicator &comm,
+                                        int root,
+                                        const std::filesystem::path &path,
+                                        data::Bodies<T, Dimension> &bodies) {
+  std::uint64_t number = 0;
+  if (comm.rank() == root) {
+    std::ifstream is(path, std::ios::in | std::ios::binary);
+    Header header{};
+    is.read(reinterpret_cast<char *>(&header), sizeof(header));
+    auto error = check_header<T, Dimension>(header, BODIES_MAGIC);
+    if (!is || !error.empty()) {
+      logging::logger(logging::Level::Error)
+          << "invalid bodies file " << path << ": "
+          << (error.empty() ? "truncated file" : error) << std::endl;
+      comm.abort(MPI_ERR_FILE);
+    }
+    number = header.number;
+  }
+  boost::mpi::broadcast(comm, number, root);
+
+  communication::Division division(comm, number);
+  read_bodies_at(comm, path, sizeof(Header), division.begin, division.count,
+                 bodies);
+  return number;
+}
+
+// read the divisions in parallel and gather them, all ranks end up with all
+// bodies
+template <typename T, std::size_t Dimension>
+void read_bodies_file(const boost::mpi::communicator &comm, int root,
+                      const std::filesystem::path &path,
+                      data::Bodies<T, Dimension> &bodies) {
+  data::Bodies<T, Dimension> local_bodies;
+  auto number = read_bodies_file_division(comm, root, path, local_bodies);
+  communication::Division division(comm, number);
+  profiling::all_gather(comm, profiling::Collective::BodiesGather,
+                        local_bodies.data(), division.count, bodies);
+}
+
+} // namespace n_body::binary
+
+#endif
@@ -0,0 +1,24 @@
+#include "checkpoint.hpp"
+#include <csignal>
+
+namespace n_body::checkpoint {
+
+namespace {
+
+volatile std::sig_atomic_t requested = 0;
+
+void request_handler(int /* signal */) { requested = 1; }
+
+} // namespace
+
+void install_request_handler() { std::signal(SIGUSR1, request_handler); }
+
+bool take_request() {
+  if (requested) {
+    requested = 0;
+    return true;
+  }
+  return false;
+}
+
+} // namespace n_body::checkpoint
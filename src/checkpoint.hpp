@@ -0,0 +1,238 @@
+#ifndef N_BODY_CHECKPOINT_HPP
+#define N_BODY_CHECKPOINT_HPP
+
+#include "binary.hpp"
+#include "communication.hpp"
+#include "data.hpp"
+#include "logging.hpp"
+#include "profiling.hpp"
+#include <boost/mpi.hpp>
+#include <boost/serialization/access.hpp>
+#include <boost/serialization/nvp.hpp>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <numeric>
+#include <vector>
+
+namespace n_body::checkpoint {
+
+constexpr binary::Magic MAGIC = {'N', 'B', 'O', 'D', 'Y', 'C', 'K', 'P'};
+
+// everything besides the bodies needed to continue a run
+template <typename T, std::size_t Dimension> struct State {
+  std::uint64_t step;
+  std::uint64_t output_index;
+  data::Space<T, Dimension> bounds;
+  // number of accelerations behind the ids, 0 if unknown, else the number
+  // of bodies
+  std::uint64_t accelerations = 0;
+
+private:
+  /* serialization */
+  friend class boost::serialization::access;
+  template <typename Archive>
+  void serialize(Archive &ar, const unsigned int /* version */) {
+    ar &BOOST_SERIALIZATION_NVP(step);
+    ar &BOOST_SERIALIZATION_NVP(output_index);
+    ar &BOOST_SERIALIZATION_NVP(bounds);
+    ar &BOOST_SERIALIZATION_NVP(accelerations);
+  }
+};
+
+// bytes of the state in the file, its fields are written one after another
+template <typename T, std::size_t Dimension>
+constexpr std::uint64_t state_size() {
+  return 3 * sizeof(std::uint64_t) + 3 * Dimension * sizeof(T);
+}
+
+template <typename T, std::size_t Dimension>
+void write_state(std::ostream &os, const State<T, Dimension> &state) {
+  binary::write_value(os, state.step);
+  binary::write_value(os, state.output_index);
+  binary::write_value(os, state.bounds.min);
+  binary::write_value(os, state.bounds.max);
+  binary::write_value(os, state.bounds.center);
+  binary::write_value(os, state.accelerations);
+}
+
+template <typename T, std::size_t Dimension>
+void read_state(std::istream &is, State<T, Dimension> &state) {
+  binary::read_value(is, state.step);
+  binary::read_value(is, state.output_index);
+  binary::read_value(is, state.bounds.min);
+  binary::read_value(is, state.bounds.max);
+  binary::read_value(is, state.bounds.center);
+  binary::read_value(is, state.accelerations);
+}
+
+// install a SIGUSR1 handler which requests a checkpoint
+extern void install_request_handler();
+// return whether a checkpoint has been requested since the last call
+extern bool take_request();
+
+// offset of the ids behind the bodies
+template <typename T, std::size_t Dimension>
+std::uint64_t ids_offset(std::uint64_t number) {
+  return sizeof(binary::Header) + state_size<T, Dimension>() +
+         number * sizeof(data::Body<T, Dimension>);
+}
+
+// offset of the accelerations behind the ids
+template <typename T, std::size_t Dimension>
+std::uint64_t accelerations_offset(std::uint64_t number) {
+  return ids_offset<T, Dimension>(number) + number * sizeof(std::uint64_t);
+}
+
+// layout: binary::Header, State field by field, raw bodies, the id of every
+// body, the acceleration of every body in the previous step if known
+// the bodies are kept in the order of the run, so a restart continues with
+// the same order, `ids` is null if they are in the order of their ids
+// `accelerations` are the magnitudes the relative opening criterion goes
+// on with, null if unknown
+// the file is written next to `path` and renamed, so an interrupted write
+// never destroys the previous checkpoint
+template <typename T, std::size_t Dimension>
+void write_checkpoint(const std::filesystem::path &path,
+                      State<T, Dimension> state,
+                      const data::BodiesView<T, Dimension> &bodies,
+                      const std::uint64_t *ids = nullptr,
+                      const T *accelerations = nullptr) {
+  state.accelerations = accelerations ? bodies.size() : 0;
+  std::vector<std::uint64_t> identity;
+  if (!ids) {
+    identity.resize(bodies.size());
+    std::iota(identity.begin(), identity.end(), 0);
+    ids = identity.data();
+  }
+  auto temporary = path;
+  temporary += ".tmp";
+  {
+    std::ofstream os(temporary, std::ios::out | std::ios::binary);
+    auto header = binary::make_header<T, Dimension>(MAGIC, bodies.size());
+    os.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    write_state(os, state);
+    binary::write_bodies(os, bodies);
+    os.write(reinterpret_cast<const char *>(ids),
+             static_cast<std::streamsize>(bodies.size() *
+                                          sizeof(std::uint64_t)));
+    if (accelerations) {
+      os.write(reinterpret_cast<const char *>(accelerations),
+               static_cast<std::streamsize>(bodies.size() * sizeof(T)));
+    }
+  }
+  std::filesystem::rename(temporary, path);
+}
+
+template <typename T, std::size_t Dimension>
+void write_checkpoint(const std::filesystem::path &path,
+                      const State<T, Dimension> &state,
+                      const data::Bodies<T, Dimension> &bodies,
+                      const std::uint64_t *ids = nullptr,
+                      const T *accelerations = nullptr) {
+  write_checkpoint(path, state, data::BodiesView<T, Dimension>(bodies), ids,
+                   accelerations);
+}
+
+// collectively read values [first, first + count) of the array starting at
+// `offset` bytes into the file
+template <typename V>
+void read_values_at(const boost::mpi::communicator &comm,
+                    const std::filesystem::path &path, std::uint64_t offset,
+                    std::size_t first, std::size_t count,
+                    std::vector<V> &values) {
+  values.resize(count);
+  MPI_File file;
+  binary::detail::check_mpi_io(comm,
+                               MPI_File_open(comm, path.c_str(),
+                                             MPI_MODE_RDONLY, MPI_INFO_NULL,
+                                             &file),
+                               path, "open");
+  binary::detail::check_mpi_io(
+      comm,
+      MPI_File_read_at_all(
+          file, static_cast<MPI_Offset>(offset + first * sizeof(V)),
+          values.data(), static_cast<int>(count),
+          boost::mpi::get_mpi_datatype<V>(V{}), MPI_STATUS_IGNORE),
+      path, "read");
+  MPI_File_close(&file);
+}
+
+// read the header and the state in root and broadcast them, every rank
+// reads its own division of the bodies, of their ids and of their
+// accelerations, which are left empty if unknown
+// the rank count may differ from the run which wrote the checkpoint
+// return the number of bodies in the checkpoint
+template <typename T, std::size_t Dimension>
+std::uint64_t read_checkpoint_division(const boost::mpi::communicator &comm,
+                                       int root,
+                                       const std::filesystem::path &path,
+                                       State<T, Dimension> &state,
+                                       data::Bodies<T, Dimension> &bodies,
+                                       std::vector<std::uint64_t> &ids,
+                                       std::vector<T> &accelerations) {
+  std::uint64_t number = 0;
+  if (comm.rank() == root) {
+    std::ifstream is(path, std::ios::in | std::ios::binary);
+    binary::Header header{};
+    is.read(reinterpret_cast<char *>(&header), sizeof(header));
+    auto error = binary::check_header<T, Dimension>(header, MAGIC);
+    if (!is || !error.empty()) {
+      logging::logger(logging::Level::Error)
+          << "invalid checkpoint " << path << ": "
+          << (error.empty() ? "truncated file" : error) << std::endl;
+      comm.abort(MPI_ERR_FILE);
+    }
+    read_state(is, state);
+    if (!is || std::filesystem::file_size(path) <
+                   accelerations_offset<T, Dimension>(header.number) +
+                       state.accelerations * sizeof(T)) {
+      logging::logger(logging::Level::Error)
+          << "invalid checkpoint " << path << ": truncated file"
+          << std::endl;
+      comm.abort(MPI_ERR_FILE);
+    }
+    number = header.number;
+  }
+  boost::mpi::broadcast(comm, state, root);
+  boost::mpi::broadcast(comm, number, root);
+
+  communication::Division division(comm, number);
+  binary::read_bodies_at(comm, path,
+                         sizeof(binary::Header) + state_size<T, Dimension>(),
+                         division.begin, division.count, bodies);
+  read_values_at(comm, path, ids_offset<T, Dimension>(number),
+                 division.begin, division.count, ids);
+  if (state.accelerations != 0) {
+    read_values_at(comm, path, accelerations_offset<T, Dimension>(number),
+                   division.begin, division.count, accelerations);
+  } else {
+    accelerations.clear();
+  }
+  return number;
+}
+
+// read the divisions in parallel and gather them, all ranks end up with all
+// bodies and their ids, the accelerations stay those of the division
+template <typename T, std::size_t Dimension>
+void read_checkpoint(const boost::mpi::communicator &comm, int root,
+                     const std::filesystem::path &path,
+                     State<T, Dimension> &state,
+                     data::Bodies<T, Dimension> &bodies,
+                     std::vector<std::uint64_t> &ids,
+                     std::vector<T> &accelerations) {
+  data::Bodies<T, Dimension> local_bodies;
+  std::vector<std::uint64_t> local_ids;
+  auto number = read_checkpoint_division(comm, root, path, state, local_bodies,
+                                         local_ids, accelerations);
+  communication::Division division(comm, number);
+  profiling::all_gather(comm, profiling::Collective::BodiesGather,
+                        local_bodies.data(), division.count, bodies);
+  profiling::all_gather(comm, profiling::Collective::BodiesGather,
+                        local_ids.data(), division.count, ids);
+}
+
+} // namespace n_body::checkpoint
+
+#endif
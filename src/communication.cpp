@@ -1,8 +1,10 @@
 #include "communication.hpp"
 #include "logging.hpp"
+#include <algorithm>
 #include <boost/mpi.hpp>
 #include <cstddef>
 #include <iostream>
+#include <numeric>
 
 namespace n_body::communication {
 
@@ -22,11 +24,74 @@ Division::Division(const boost::mpi::communicator &comm, std::size_t total) {
   this->end = basic_local_count * (rank + 1);
   this->count = this->end - this->begin;
 
-  auto &lg = logging::logger(logging::Level::Debug);
-  lg << "division = ";
-  lg << ".count { " << this->count << ", }, "
-     << ".begin { " << this->begin << ", }, "
-     << ".end { " << this->end << ", }, " << std::endl;
+  N_BODY_LOG(Debug) << "division = "
+                    << ".count { " << this->count << ", }, "
+                    << ".begin { " << this->begin << ", }, "
+                    << ".end { " << this->end << ", }, " << std::endl;
+}
+
+Division::Division(const boost::mpi::communicator &comm, std::size_t total,
+                   const Partition &partition) {
+  if (partition.empty()) {
+    *this = Division(comm, total);
+    return;
+  }
+  const auto rank = static_cast<std::size_t>(comm.rank());
+  if (partition.size() != static_cast<std::size_t>(comm.size()) + 1 ||
+      partition.back() != total) {
+    logging::logger(logging::Level::Error)
+        << "partition of " << partition.back() << " bodies into "
+        << partition.size() - 1 << " divisions does not fit total(" << total
+        << ")" << std::endl;
+    comm.abort(MPI_ERR_ARG);
+  }
+  this->begin = partition[rank];
+  this->end = partition[rank + 1];
+  this->count = this->end - this->begin;
+}
+
+Partition equal(std::size_t total, std::size_t parts) {
+  Partition partition(parts + 1);
+  for (std::size_t r = 0; r <= parts; ++r) {
+    partition[r] = total / parts * r;
+  }
+  partition[parts] = total;
+  return partition;
+}
+
+Partition balance(const std::vector<std::uint64_t> &costs, std::size_t parts) {
+  std::vector<std::uint64_t> prefix(costs.size() + 1, 0);
+  std::partial_sum(costs.begin(), costs.end(), prefix.begin() + 1);
+  const auto total = prefix.back();
+
+  // division r ends at the first index whose prefix reaches r + 1 parts of
+  // the total, so no division overshoots by more than one body
+  Partition partition(parts + 1, 0);
+  for (std::size_t r = 1; r < parts; ++r) {
+    auto target = (total * r + parts - 1) / parts;
+    partition[r] = static_cast<std::size_t>(
+        std::lower_bound(prefix.begin() + partition[r - 1], prefix.end(),
+                         target) -
+        prefix.begin());
+  }
+  partition[parts] = costs.size();
+  return partition;
+}
+
+double imbalance(const std::vector<std::uint64_t> &costs,
+                 const Partition &partition) {
+  std::uint64_t total = 0;
+  std::uint64_t most = 0;
+  for (std::size_t r = 0; r + 1 < partition.size(); ++r) {
+    auto cost = std::accumulate(costs.begin() + partition[r],
+                                costs.begin() + partition[r + 1],
+                                std::uint64_t{0});
+    total += cost;
+    most = std::max(most, cost);
+  }
+  return total == 0 ? 1
+                    : static_cast<double>(most) * (partition.size() - 1) /
+                          static_cast<double>(total);
 }
 
 } // namespace n_body::communication
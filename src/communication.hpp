@@ -3,17 +3,36 @@
 
 #include <boost/mpi.hpp>
 #include <cstddef>
+#include <cstdint>
+#include <vector>
 
 namespace n_body::communication {
 
+// first index of the division of every process followed by the total, the
+// division of process r is [partition[r], partition[r + 1]), empty for
+// equal divisions
+using Partition = std::vector<std::size_t>;
+
 struct Division {
   std::size_t count;
   std::size_t begin;
   std::size_t end;
 
   explicit Division(const boost::mpi::communicator &comm, std::size_t total);
+  Division(const boost::mpi::communicator &comm, std::size_t total,
+           const Partition &partition);
 };
 
+// the partition of the equal divisions
+Partition equal(std::size_t total, std::size_t parts);
+
+// cut consecutive `costs` into `parts` divisions of about equal total cost
+Partition balance(const std::vector<std::uint64_t> &costs, std::size_t parts);
+
+// ratio of the largest total cost of a division to the average
+double imbalance(const std::vector<std::uint64_t> &costs,
+                 const Partition &partition);
+
 } // namespace n_body::communication
 
 #endif
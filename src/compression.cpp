@@ -0,0 +1,109 @@
+#include "compression.hpp"
+#include <boost/iostreams/device/file.hpp>
+#include <boost/iostreams/filter/bzip2.hpp>
+#include <boost/iostreams/filter/gzip.hpp>
+#include <boost/iostreams/filter/zstd.hpp>
+#include <boost/iostreams/filtering_stream.hpp>
+
+namespace n_body::compression {
+
+std::ostream &operator<<(std::ostream &os, Method method) {
+  switch (method) {
+  case Method::None:
+    return os << "none";
+  case Method::Gzip:
+    return os << "gzip";
+  case Method::Bzip2:
+    return os << "bzip2";
+  case Method::Zstd:
+    return os << "zstd";
+  default:
+    return os << "ukn";
+  }
+}
+
+std::istream &operator>>(std::istream &is, Method &method) {
+  std::string label;
+  is >> label;
+  if (label == "none")
+    method = Method::None;
+  else if (label == "gzip")
+    method = Method::Gzip;
+  else if (label == "bzip2")
+    method = Method::Bzip2;
+  else if (label == "zstd")
+    method = Method::Zstd;
+  else
+    is.setstate(std::ios::failbit);
+  return is;
+}
+
+std::string extension_of(Method method) {
+  switch (method) {
+  case Method::Gzip:
+    return ".gz";
+  case Method::Bzip2:
+    return ".bz2";
+  case Method::Zstd:
+    return ".zst";
+  case Method::None:
+  default:
+    return "";
+  }
+}
+
+Method method_of_path(const std::filesystem::path &path) {
+  auto extension = path.extension().string();
+  if (extension == ".gz")
+    return Method::Gzip;
+  else if (extension == ".bz2")
+    return Method::Bzip2;
+  else if (extension == ".zst")
+    return Method::Zstd;
+  else
+    return Method::None;
+}
+
+std::unique_ptr<std::ostream> open_output(const std::filesystem::path &path,
+                                          Method method) {
+  namespace io = boost::iostreams;
+  auto os = std::make_unique<io::filtering_ostream>();
+  switch (method) {
+  case Method::Gzip:
+    os->push(io::gzip_compressor());
+    break;
+  case Method::Bzip2:
+    os->push(io::bzip2_compressor());
+    break;
+  case Method::Zstd:
+    os->push(io::zstd_compressor());
+    break;
+  case Method::None:
+    break;
+  }
+  os->push(io::file_sink(path.string() + extension_of(method),
+                         std::ios::out | std::ios::binary));
+  return os;
+}
+
+std::unique_ptr<std::istream> open_input(const std::filesystem::path &path) {
+  namespace io = boost::iostreams;
+  auto is = std::make_unique<io::filtering_istream>();
+  switch (method_of_path(path)) {
+  case Method::Gzip:
+    is->push(io::gzip_decompressor());
+    break;
+  case Method::Bzip2:
+    is->push(io::bzip2_decompressor());
+    break;
+  case Method::Zstd:
+    is->push(io::zstd_decompressor());
+    break;
+  case Method::None:
+    break;
+  }
+  is->push(io::file_source(path.string(), std::ios::in | std::ios::binary));
+  return is;
+}
+
+} // namespace n_body::compression
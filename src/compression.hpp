@@ -0,0 +1,36 @@
+#ifndef N_BODY_COMPRESSION_HPP
+#define N_BODY_COMPRESSION_HPP
+
+#include <filesystem>
+#include <iostream>
+#include <memory>
+#include <string>
+
+namespace n_body::compression {
+
+enum class Method {
+  None = 0,
+  Gzip = 1,
+  Bzip2 = 2,
+  Zstd = 3,
+};
+
+extern std::ostream &operator<<(std::ostream &os, Method method);
+extern std::istream &operator>>(std::istream &is, Method &method);
+
+// file name extension appended by the method, empty for Method::None
+extern std::string extension_of(Method method);
+// infer the method from the extension of a file name
+extern Method method_of_path(const std::filesystem::path &path);
+
+// open `path` with the extension of the method appended
+// the compressor chain is flushed and closed when the stream is destroyed
+extern std::unique_ptr<std::ostream>
+open_output(const std::filesystem::path &path, Method method);
+// open `path` and decompress it according to its extension
+extern std::unique_ptr<std::istream>
+open_input(const std::filesystem::path &path);
+
+} // namespace n_body::compression
+
+#endif
@@ -1,25 +1,196 @@
 #ifndef N_BODY_CONFIG_HPP
 #define N_BODY_CONFIG_HPP
 
+#include "compression.hpp"
 #include "logging.hpp"
 #include <boost/serialization/access.hpp>
 #include <boost/serialization/nvp.hpp>
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
 #include <string>
 
 namespace n_body::config {
 
+// floating point type of the simulation, selected at run time
+enum class Precision {
+  Float = 0,
+  Double = 1,
+};
+
+inline std::ostream &operator<<(std::ostream &os, Precision precision) {
+  switch (precision) {
+  case Precision::Float:
+    return os << "float";
+  case Precision::Double:
+    return os << "double";
+  default:
+    return os << "ukn";
+  }
+}
+
+inline std::istream &operator>>(std::istream &is, Precision &precision) {
+  std::string label;
+  is >> label;
+  if (label == "float")
+    precision = Precision::Float;
+  else if (label == "double")
+    precision = Precision::Double;
+  else
+    is.setstate(std::ios::failbit);
+  return is;
+}
+
+// how the forces on the bodies are computed
+enum class ForceMethod {
+  // every pair of bodies interacts
+  Direct = 0,
+  // barnes-hut walk of the tree
+  Tree = 1,
+  // barnes-hut walk of the tree by packets of nearby bodies
+  Packet = 2,
+  // interaction lists of groups of bodies, reused over steps
+  List = 3,
+};
+
+inline std::ostream &operator<<(std::ostream &os, ForceMethod method) {
+  switch (method) {
+  case ForceMethod::Direct:
+    return os << "direct";
+  case ForceMethod::Tree:
+    return os << "tree";
+  case ForceMethod::Packet:
+    return os << "packet";
+  case ForceMethod::List:
+    return os << "list";
+  default:
+    return os << "ukn";
+  }
+}
+
+inline std::istream &operator>>(std::istream &is, ForceMethod &method) {
+  std::string label;
+  is >> label;
+  if (label == "direct")
+    method = ForceMethod::Direct;
+  else if (label == "tree")
+    method = ForceMethod::Tree;
+  else if (label == "packet")
+    method = ForceMethod::Packet;
+  else if (label == "list")
+    method = ForceMethod::List;
+  else
+    is.setstate(std::ios::failbit);
+  return is;
+}
+
+// when a node of the tree is accepted as a whole instead of being opened
+enum class OpeningCriterion {
+  // size / distance below theta
+  Geometric = 0,
+  // salmon-warren bound on the error of the monopole below the tolerance
+  SalmonWarren = 1,
+  // gadget style, the monopole term times (size / distance)^2 below the
+  // tolerance times the acceleration of the body in the previous step
+  Relative = 2,
+};
+
+inline std::ostream &operator<<(std::ostream &os, OpeningCriterion criterion) {
+  switch (criterion) {
+  case OpeningCriterion::Geometric:
+    return os << "geometric";
+  case OpeningCriterion::SalmonWarren:
+    return os << "salmon-warren";
+  case OpeningCriterion::Relative:
+    return os << "relative";
+  default:
+    return os << "ukn";
+  }
+}
+
+inline std::istream &operator>>(std::istream &is,
+                                OpeningCriterion &criterion) {
+  std::string label;
+  is >> label;
+  if (label == "geometric")
+    criterion = OpeningCriterion::Geometric;
+  else if (label == "salmon-warren")
+    criterion = OpeningCriterion::SalmonWarren;
+  else if (label == "relative")
+    criterion = OpeningCriterion::Relative;
+  else
+    is.setstate(std::ios::failbit);
+  return is;
+}
+
 template <typename T> struct Configuration {
+  Configuration() = default;
+
+  // the same configuration with scalars converted to T
+  template <typename U>
+  explicit Configuration(const Configuration<U> &other)
+      : show_help(other.show_help), number(other.number), steps(other.steps),
+        sample_interval(other.sample_interval),
+        output_queue_depth(other.output_queue_depth),
+        dimension(other.dimension), precision(other.precision),
+        time(static_cast<T>(other.time)), G(static_cast<T>(other.G)),
+        method(other.method), theta(static_cast<T>(other.theta)),
+        opening(other.opening),
+        opening_tolerance(static_cast<T>(other.opening_tolerance)),
+        list_margin(static_cast<T>(other.list_margin)),
+        soften_length(static_cast<T>(other.soften_length)),
+        mixed_precision(other.mixed_precision),
+        precision_report(other.precision_report),
+        compression(other.compression),
+        quantize_precision(static_cast<T>(other.quantize_precision)),
+        checkpoint_interval(other.checkpoint_interval),
+        timing_interval(other.timing_interval),
+        communication_interval(other.communication_interval),
+        diagnostics(other.diagnostics), tree_interval(other.tree_interval),
+        balance_interval(other.balance_interval), trace(other.trace),
+        trace_capacity(other.trace_capacity),
+        shared_memory(other.shared_memory), distributed(other.distributed),
+        reorder_interval(other.reorder_interval), seed(other.seed),
+        input_file(other.input_file), restart_file(other.restart_file),
+        output_path(other.output_path), min_log_level(other.min_log_level),
+        log_per_rank(other.log_per_rank) {}
+
   bool show_help = false;
   boost::optional<unsigned> number = 0;
   unsigned steps = 0;
   unsigned sample_interval = 0;
+  unsigned output_queue_depth = 0;
+  unsigned dimension = 3;
+  Precision precision = Precision::Double;
   T time;
   T G;
+  ForceMethod method = ForceMethod::Direct;
   T theta;
+  OpeningCriterion opening = OpeningCriterion::Geometric;
+  T opening_tolerance;
+  T list_margin;
   T soften_length;
+  bool mixed_precision = false;
+  unsigned precision_report = 0;
+  compression::Method compression = compression::Method::None;
+  T quantize_precision;
+  unsigned checkpoint_interval = 0;
+  unsigned timing_interval = 0;
+  unsigned communication_interval = 0;
+  bool diagnostics = false;
+  unsigned tree_interval = 0;
+  unsigned balance_interval = 0;
+  bool trace = false;
+  unsigned trace_capacity = 0;
+  bool shared_memory = false;
+  bool distributed = false;
+  unsigned reorder_interval = 0;
+  std::uint64_t seed = 0;
   boost::optional<std::string> input_file;
+  boost::optional<std::string> restart_file;
   std::string output_path;
   logging::Level min_log_level = logging::Level::Info;
+  bool log_per_rank = false;
 
 private:
   /* serialization */
@@ -30,14 +201,39 @@ private:
     ar &BOOST_SERIALIZATION_NVP(number);
     ar &BOOST_SERIALIZATION_NVP(steps);
     ar &BOOST_SERIALIZATION_NVP(sample_interval);
+    ar &BOOST_SERIALIZATION_NVP(output_queue_depth);
+    ar &BOOST_SERIALIZATION_NVP(dimension);
+    ar &BOOST_SERIALIZATION_NVP(precision);
     ar &BOOST_SERIALIZATION_NVP(time);
     ar &BOOST_SERIALIZATION_NVP(G);
+    ar &BOOST_SERIALIZATION_NVP(method);
     ar &BOOST_SERIALIZATION_NVP(theta);
+    ar &BOOST_SERIALIZATION_NVP(opening);
+    ar &BOOST_SERIALIZATION_NVP(opening_tolerance);
+    ar &BOOST_SERIALIZATION_NVP(list_margin);
     ar &BOOST_SERIALIZATION_NVP(soften_length);
+    ar &BOOST_SERIALIZATION_NVP(mixed_precision);
+    ar &BOOST_SERIALIZATION_NVP(precision_report);
+    ar &BOOST_SERIALIZATION_NVP(compression);
+    ar &BOOST_SERIALIZATION_NVP(quantize_precision);
+    ar &BOOST_SERIALIZATION_NVP(checkpoint_interval);
+    ar &BOOST_SERIALIZATION_NVP(timing_interval);
+    ar &BOOST_SERIALIZATION_NVP(communication_interval);
+    ar &BOOST_SERIALIZATION_NVP(diagnostics);
+    ar &BOOST_SERIALIZATION_NVP(tree_interval);
+    ar &BOOST_SERIALIZATION_NVP(balance_interval);
+    ar &BOOST_SERIALIZATION_NVP(trace);
+    ar &BOOST_SERIALIZATION_NVP(trace_capacity);
+    ar &BOOST_SERIALIZATION_NVP(shared_memory);
+    ar &BOOST_SERIALIZATION_NVP(distributed);
+    ar &BOOST_SERIALIZATION_NVP(reorder_interval);
+    ar &BOOST_SERIALIZATION_NVP(seed);
     ar &BOOST_SERIALIZATION_NVP(input_file);
+    ar &BOOST_SERIALIZATION_NVP(restart_file);
     ar &BOOST_SERIALIZATION_NVP(output_path);
     logging::level_serializer level_serializer(min_log_level);
     ar &boost::serialization::make_nvp("min_log_level", level_serializer);
+    ar &BOOST_SERIALIZATION_NVP(log_per_rank);
   }
 };
 
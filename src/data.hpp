@@ -2,6 +2,7 @@
 #define N_BODY_DATA_HPP
 
 #include <array>
+#include <boost/mpi/datatype.hpp>
 #include <boost/serialization/access.hpp>
 #include <boost/serialization/array.hpp>
 #include <boost/serialization/nvp.hpp>
@@ -41,6 +42,31 @@ private:
 template <typename T, std::size_t Dimension>
 using Bodies = std::vector<Body<T, Dimension>>;
 
+// read only view of contiguous bodies, which may be owned by a vector or live
+// in memory shared between processes
+template <typename T, std::size_t Dimension> class BodiesView {
+public:
+  using value_type = Body<T, Dimension>;
+  using const_iterator = const value_type *;
+
+  BodiesView() = default;
+  BodiesView(const value_type *first, std::size_t count)
+      : first(first), count(count) {}
+  BodiesView(const Bodies<T, Dimension> &bodies)
+      : first(bodies.data()), count(bodies.size()) {}
+
+  const value_type *data() const { return this->first; }
+  std::size_t size() const { return this->count; }
+  bool empty() const { return this->count == 0; }
+  const_iterator begin() const { return this->first; }
+  const_iterator end() const { return this->first + this->count; }
+  const value_type &operator[](std::size_t i) const { return this->first[i]; }
+
+private:
+  const value_type *first = nullptr;
+  std::size_t count = 0;
+};
+
 template <typename T, std::size_t Dimension> struct Space {
   using vector_type = Vector<T, Dimension>;
 
@@ -182,4 +208,18 @@ void average_position_by_mass_in_place(Vector<T, Dimension> &position1,
 
 } // namespace n_body::data
 
+namespace boost::mpi {
+
+// bodies and spaces have a fixed layout, mpi sends them as derived datatypes
+// instead of packing them into archives
+template <typename T, std::size_t Dimension>
+struct is_mpi_datatype<n_body::data::Body<T, Dimension>>
+    : public is_mpi_datatype<T> {};
+
+template <typename T, std::size_t Dimension>
+struct is_mpi_datatype<n_body::data::Space<T, Dimension>>
+    : public is_mpi_datatype<T> {};
+
+} // namespace boost::mpi
+
 #endif
@@ -0,0 +1,84 @@
+#ifndef N_BODY_DIAGNOSTICS_HPP
+#define N_BODY_DIAGNOSTICS_HPP
+
+#include "data.hpp"
+#include <algorithm>
+#include <array>
+#include <boost/mpi.hpp>
+#include <cstddef>
+#include <functional>
+
+// conserved quantities of the system, every process sums its own bodies and
+// root reduces the sums
+// the potential energy is not summed here, it is a by-product of the force
+// computation, see physical::step
+namespace n_body::diagnostics {
+
+template <typename T, std::size_t Dimension> struct Diagnostics {
+  T kinetic = 0;
+  T potential = 0;
+  data::Vector<T, Dimension> momentum{};
+  // about the origin, in 2 dimensions only z is not 0
+  data::Vector<T, 3> angular_momentum{};
+
+  T total() const { return kinetic + potential; }
+
+  // 2 K / |W|, 1 for a system in virial equilibrium
+  T virial_ratio() const {
+    return potential == 0 ? 0 : -2 * kinetic / potential;
+  }
+};
+
+// kinetic energy, momentum and angular momentum of the bodies
+template <typename T, std::size_t Dimension, typename Iter>
+Diagnostics<T, Dimension> of_bodies(Iter first, Iter last) {
+  Diagnostics<T, Dimension> result;
+  for (; first != last; ++first) {
+    const auto &body = *first;
+    T speed2 = 0;
+    for (std::size_t d = 0; d < Dimension; ++d) {
+      speed2 += body.velocity[d] * body.velocity[d];
+      result.momentum[d] += body.mass * body.velocity[d];
+    }
+    result.kinetic += body.mass * speed2 / 2;
+    const auto &r = body.position;
+    const auto &v = body.velocity;
+    if constexpr (Dimension == 3) {
+      result.angular_momentum[0] += body.mass * (r[1] * v[2] - r[2] * v[1]);
+      result.angular_momentum[1] += body.mass * (r[2] * v[0] - r[0] * v[2]);
+    }
+    result.angular_momentum[2] += body.mass * (r[0] * v[1] - r[1] * v[0]);
+  }
+  return result;
+}
+
+// sum of the diagnostics of all processes, meaningful in root only
+template <typename T, std::size_t Dimension>
+Diagnostics<T, Dimension> reduce(const boost::mpi::communicator &comm,
+                                 int root,
+                                 const Diagnostics<T, Dimension> &local) {
+  constexpr std::size_t SIZE = 2 + Dimension + 3;
+  std::array<T, SIZE> values{local.kinetic, local.potential};
+  std::copy(local.momentum.begin(), local.momentum.end(), values.begin() + 2);
+  std::copy(local.angular_momentum.begin(), local.angular_momentum.end(),
+            values.begin() + 2 + Dimension);
+  if (comm.rank() != root) {
+    boost::mpi::reduce(comm, values.data(), SIZE, std::plus<T>(), root);
+    return local;
+  }
+  std::array<T, SIZE> sums;
+  boost::mpi::reduce(comm, values.data(), SIZE, sums.data(), std::plus<T>(),
+                     root);
+  Diagnostics<T, Dimension> result;
+  result.kinetic = sums[0];
+  result.potential = sums[1];
+  std::copy(sums.begin() + 2, sums.begin() + 2 + Dimension,
+            result.momentum.begin());
+  std::copy(sums.begin() + 2 + Dimension, sums.end(),
+            result.angular_momentum.begin());
+  return result;
+}
+
+} // namespace n_body::diagnostics
+
+#endif
@@ -0,0 +1,555 @@
+#ifndef N_BODY_DISTRIBUTED_HPP
+#define N_BODY_DISTRIBUTED_HPP
+
+#include "config.hpp"
+#include "data.hpp"
+#include "logging.hpp"
+#include "physical.hpp"
+#include "profiling.hpp"
+#include "space.hpp"
+#include "timing.hpp"
+#include "tree.hpp"
+#include "walk.hpp"
+#include <algorithm>
+#include <boost/mpi.hpp>
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <limits>
+#include <numeric>
+#include <utility>
+#include <vector>
+
+// every process owns the bodies it holds only, so the memory of a process
+// does not grow with the number of processes times the bodies
+// the direct sum passes the owned bodies around a ring, so they keep the
+// equal divisions they start with
+// the tree method cuts space into slabs along one axis, bodies migrate to
+// the owner of the slab they move into, and every process receives the
+// locally essential tree of its domain from the others: the nodes of their
+// trees which are accepted as a whole for every position of the domain
+namespace n_body::distributed {
+
+using namespace n_body::data;
+
+// domains are cut again when the most loaded process owns this many times
+// the average number of bodies
+constexpr double REBALANCE_IMBALANCE = 1.2;
+
+// bodies of this process and their indices in the whole system
+template <typename T, std::size_t Dimension> struct Owned {
+  data::Bodies<T, Dimension> bodies;
+  std::vector<std::uint64_t> ids;
+};
+
+// process r owns the positions with splitters[r - 1] <= x[axis] <
+// splitters[r], the first and last slab are unbounded
+template <typename T> struct Domains {
+  std::size_t axis = 0;
+  std::vector<T> splitters;
+
+  template <std::size_t Dimension>
+  int owner(const data::Vector<T, Dimension> &position) const {
+    return static_cast<int>(std::upper_bound(this->splitters.begin(),
+                                             this->splitters.end(),
+                                             position[this->axis]) -
+                            this->splitters.begin());
+  }
+};
+
+// own consecutive bodies, the first one has id `first`
+template <typename T, std::size_t Dimension>
+Owned<T, Dimension> own(data::Bodies<T, Dimension> bodies, std::uint64_t first) {
+  Owned<T, Dimension> owned;
+  owned.ids.resize(bodies.size());
+  std::iota(owned.ids.begin(), owned.ids.end(), first);
+  owned.bodies = std::move(bodies);
+  return owned;
+}
+
+template <typename T, std::size_t Dimension>
+data::Space<T, Dimension> root_space(const boost::mpi::communicator &comm,
+                                     const Owned<T, Dimension> &owned) {
+  T min = std::numeric_limits<T>::max();
+  T max = std::numeric_limits<T>::lowest();
+  for (const auto &body : owned.bodies) {
+    for (std::size_t d = 0; d < Dimension; ++d) {
+      min = std::min(min, body.position[d]);
+      max = std::max(max, body.position[d]);
+    }
+  }
+  profiling::all_reduce(comm, profiling::Collective::RootSpace, min,
+                        boost::mpi::minimum<T>());
+  profiling::all_reduce(comm, profiling::Collective::RootSpace, max,
+                        boost::mpi::maximum<T>());
+  data::Space<T, Dimension> space{};
+  for (std::size_t d = 0; d < Dimension; ++d) {
+    space.min[d] = min;
+    space.max[d] = max;
+    space.center[d] = (max + min) / 2;
+  }
+  return space;
+}
+
+// cut the longest axis of the bounds into slabs holding equal numbers of
+// bodies
+// every process contributes regular samples of its sorted coordinates, each
+// weighted by the bodies it stands for, so processes holding more bodies
+// count more
+template <typename T, std::size_t Dimension>
+Domains<T> decompose(const boost::mpi::communicator &comm,
+                     const data::Space<T, Dimension> &bounds,
+                     const Owned<T, Dimension> &owned) {
+  constexpr std::size_t SAMPLES = 64;
+
+  Domains<T> domains;
+  for (std::size_t d = 1; d < Dimension; ++d) {
+    if (bounds.max[d] - bounds.min[d] >
+        bounds.max[domains.axis] - bounds.min[domains.axis])
+      domains.axis = d;
+  }
+
+  std::vector<T> coordinates(owned.bodies.size());
+  for (std::size_t i = 0; i < owned.bodies.size(); ++i) {
+    coordinates[i] = owned.bodies[i].position[domains.axis];
+  }
+  std::sort(coordinates.begin(), coordinates.end());
+  auto samples = std::min(SAMPLES, coordinates.size());
+  std::vector<T> local_values(samples);
+  std::vector<double> local_weights(samples);
+  for (std::size_t k = 0; k < samples; ++k) {
+    auto first = k * coordinates.size() / samples;
+    auto last = (k + 1) * coordinates.size() / samples;
+    local_values[k] = coordinates[first];
+    local_weights[k] = static_cast<double>(last - first);
+  }
+
+  std::vector<T> values;
+  std::vector<double> weights;
+  std::vector<int> counts;
+  profiling::all_gatherv(comm, profiling::Collective::Migration, local_values,
+                         values, counts);
+  profiling::all_gatherv(comm, profiling::Collective::Migration,
+                         local_weights, weights, counts);
+
+  std::vector<std::size_t> order(values.size());
+  std::iota(order.begin(), order.end(), 0);
+  std::sort(order.begin(), order.end(), [&](std::size_t a, std::size_t b) {
+    return values[a] < values[b];
+  });
+  auto total = std::accumulate(weights.begin(), weights.end(), 0.0);
+  double cumulated = 0;
+  std::size_t k = 0;
+  for (int r = 1; r < comm.size(); ++r) {
+    auto target = total * r / comm.size();
+    while (k < order.size() && cumulated + weights[order[k]] <= target) {
+      cumulated += weights[order[k]];
+      ++k;
+    }
+    domains.splitters.push_back(k < order.size()
+                                    ? values[order[k]]
+                                    : std::numeric_limits<T>::max());
+  }
+  return domains;
+}
+
+// send every body to the owner of its position
+template <typename T, std::size_t Dimension>
+void migrate(const boost::mpi::communicator &comm, const Domains<T> &domains,
+             Owned<T, Dimension> &owned) {
+  auto &recorder = profiling::Recorder::instance();
+  profiling::Statistics statistics;
+  statistics.calls = 1;
+
+  const auto size = static_cast<std::size_t>(comm.size());
+  std::vector<int> owners(owned.bodies.size());
+  std::vector<int> send_counts(size, 0);
+  for (std::size_t i = 0; i < owned.bodies.size(); ++i) {
+    owners[i] = domains.owner(owned.bodies[i].position);
+    ++send_counts[owners[i]];
+  }
+  std::vector<int> send_displacements(size, 0);
+  for (std::size_t r = 1; r < size; ++r) {
+    send_displacements[r] = send_displacements[r - 1] + send_counts[r - 1];
+  }
+
+  // bodies keep their order within every destination
+  Owned<T, Dimension> outgoing;
+  outgoing.bodies.resize(owned.bodies.size());
+  outgoing.ids.resize(owned.ids.size());
+  auto next = send_displacements;
+  for (std::size_t i = 0; i < owned.bodies.size(); ++i) {
+    auto place = next[owners[i]]++;
+    outgoing.bodies[place] = owned.bodies[i];
+    outgoing.ids[place] = owned.ids[i];
+  }
+  profiling::detail::wait_for_all(comm, statistics);
+
+  auto start = MPI_Wtime();
+  std::vector<int> receive_counts(size);
+  MPI_Alltoall(send_counts.data(), 1, MPI_INT, receive_counts.data(), 1,
+               MPI_INT, comm);
+  std::vector<int> receive_displacements(size, 0);
+  for (std::size_t r = 1; r < size; ++r) {
+    receive_displacements[r] =
+        receive_displacements[r - 1] + receive_counts[r - 1];
+  }
+  auto total = receive_displacements[size - 1] + receive_counts[size - 1];
+  owned.bodies.resize(total);
+  owned.ids.resize(total);
+  auto body_type =
+      boost::mpi::get_mpi_datatype<data::Body<T, Dimension>>(
+          data::Body<T, Dimension>{});
+  MPI_Alltoallv(outgoing.bodies.data(), send_counts.data(),
+                send_displacements.data(), body_type, owned.bodies.data(),
+                receive_counts.data(), receive_displacements.data(),
+                body_type, comm);
+  MPI_Alltoallv(outgoing.ids.data(), send_counts.data(),
+                send_displacements.data(), MPI_UINT64_T, owned.ids.data(),
+                receive_counts.data(), receive_displacements.data(),
+                MPI_UINT64_T, comm);
+  statistics.mpi_time = MPI_Wtime() - start;
+
+  for (std::size_t r = 0; r < size; ++r) {
+    if (static_cast<int>(r) == comm.rank() || send_counts[r] == 0)
+      continue;
+    statistics.messages += 1;
+    statistics.raw_bytes +=
+        send_counts[r] * (sizeof(data::Body<T, Dimension>) +
+                          sizeof(std::uint64_t));
+  }
+  statistics.serialized_bytes = statistics.raw_bytes;
+  if (recorder.enabled)
+    recorder.add(profiling::Collective::Migration, statistics);
+}
+
+// ratio of the largest number of owned bodies to the average
+template <typename T, std::size_t Dimension>
+double imbalance(const boost::mpi::communicator &comm,
+                 const Owned<T, Dimension> &owned, std::size_t number) {
+  std::size_t most = 0;
+  boost::mpi::all_reduce(comm, owned.bodies.size(), most,
+                         boost::mpi::maximum<std::size_t>());
+  return number == 0 ? 1
+                     : static_cast<double>(most) * comm.size() /
+                           static_cast<double>(number);
+}
+
+// smallest box holding the owned bodies, min is above max without bodies
+template <typename T, std::size_t Dimension>
+data::Space<T, Dimension> bounds_of(const Owned<T, Dimension> &owned) {
+  data::Space<T, Dimension> box{};
+  for (std::size_t d = 0; d < Dimension; ++d) {
+    box.min[d] = std::numeric_limits<T>::max();
+    box.max[d] = std::numeric_limits<T>::lowest();
+  }
+  for (const auto &body : owned.bodies) {
+    for (std::size_t d = 0; d < Dimension; ++d) {
+      box.min[d] = std::min(box.min[d], body.position[d]);
+      box.max[d] = std::max(box.max[d], body.position[d]);
+    }
+  }
+  for (std::size_t d = 0; d < Dimension; ++d) {
+    box.center[d] = (box.max[d] + box.min[d]) / 2;
+  }
+  return box;
+}
+
+// squared distance from `position` to the nearest point of `box`
+template <typename T, std::size_t Dimension>
+T distance2_to(const data::Space<T, Dimension> &box,
+               const data::Vector<T, Dimension> &position) {
+  T distance2 = 0;
+  for (std::size_t d = 0; d < Dimension; ++d) {
+    auto offset = std::max({box.min[d] - position[d],
+                            position[d] - box.max[d], T{0}});
+    distance2 += offset * offset;
+  }
+  return distance2;
+}
+
+// append the locally essential tree of `box` to `essential`: every node of
+// `tree` accepted for the nearest position of the box is accepted for all
+// of them, so it is sent as one body at its center of mass, the walk goes
+// on below the others down to the leaves
+// only the geometric radii are used, the scales of the relative criterion
+// of the positions in the box are not known here
+template <typename T, std::size_t Dimension>
+void append_essential(const walk::WalkTree<T, Dimension> &tree,
+                      const data::Space<T, Dimension> &box,
+                      data::Bodies<T, Dimension> &essential) {
+  if (tree.nodes.empty())
+    return;
+  std::vector<std::uint32_t> stack{0};
+  while (!stack.empty()) {
+    const auto &node = tree.nodes[stack.back()];
+    stack.pop_back();
+    if (node.children != 0 &&
+        distance2_to(box, node.center_of_mass) <= node.opening_radius2) {
+      for (std::uint32_t c = 0; c < node.children; ++c) {
+        stack.push_back(node.first_child + c);
+      }
+      continue;
+    }
+    data::Body<T, Dimension> body{};
+    body.position = node.center_of_mass;
+    body.mass = node.mass;
+    essential.push_back(body);
+  }
+}
+
+// send every process the locally essential tree of its domain, the bodies
+// received from all processes are returned
+// domains are the boxes of the owned bodies, which the slabs keep apart
+template <typename T, std::size_t Dimension>
+data::Bodies<T, Dimension>
+exchange_essential(const boost::mpi::communicator &comm,
+                   const walk::WalkTree<T, Dimension> &tree,
+                   const Owned<T, Dimension> &owned) {
+  auto &recorder = profiling::Recorder::instance();
+  profiling::Statistics statistics;
+  statistics.calls = 1;
+
+  const auto size = static_cast<std::size_t>(comm.size());
+  std::vector<data::Space<T, Dimension>> boxes;
+  boost::mpi::all_gather(comm, bounds_of(owned), boxes);
+
+  data::Bodies<T, Dimension> outgoing;
+  std::vector<int> send_counts(size, 0);
+  std::vector<int> send_displacements(size, 0);
+  for (std::size_t r = 0; r < size; ++r) {
+    send_displacements[r] = static_cast<int>(outgoing.size());
+    // a process without bodies needs nothing
+    bool empty = boxes[r].min[0] > boxes[r].max[0];
+    if (static_cast<int>(r) == comm.rank() || empty)
+      continue;
+    append_essential(tree, boxes[r], outgoing);
+    send_counts[r] =
+        static_cast<int>(outgoing.size()) - send_displacements[r];
+    statistics.messages += 1;
+    statistics.raw_bytes +=
+        send_counts[r] * sizeof(data::Body<T, Dimension>);
+  }
+  statistics.serialized_bytes = statistics.raw_bytes;
+  profiling::detail::wait_for_all(comm, statistics);
+
+  auto start = MPI_Wtime();
+  std::vector<int> receive_counts(size);
+  MPI_Alltoall(send_counts.data(), 1, MPI_INT, receive_counts.data(), 1,
+               MPI_INT, comm);
+  std::vector<int> receive_displacements(size, 0);
+  for (std::size_t r = 1; r < size; ++r) {
+    receive_displacements[r] =
+        receive_displacements[r - 1] + receive_counts[r - 1];
+  }
+  data::Bodies<T, Dimension> incoming(receive_displacements[size - 1] +
+                                      receive_counts[size - 1]);
+  auto body_type =
+      boost::mpi::get_mpi_datatype<data::Body<T, Dimension>>(
+          data::Body<T, Dimension>{});
+  MPI_Alltoallv(outgoing.data(), send_counts.data(),
+                send_displacements.data(), body_type, incoming.data(),
+                receive_counts.data(), receive_displacements.data(),
+                body_type, comm);
+  statistics.mpi_time = MPI_Wtime() - start;
+
+  if (recorder.enabled)
+    recorder.add(profiling::Collective::EssentialTree, statistics);
+  return incoming;
+}
+
+// update the owned bodies one step with the tree method
+// the local tree is built in the cells of `root_space`, which holds all
+// bodies, the bodies received as locally essential trees are inserted
+// alongside the owned ones, and the owned bodies walk the combined tree
+// a node received as one body lies inside the cell it came from, so every
+// cell containing that cell holds the same mass and center of mass as in
+// the tree of all bodies
+// `potential` is added the potential energy of the owned bodies before they
+// move if not null, see physical::step
+template <typename T, std::size_t Dimension>
+void tree_step(const config::Configuration<T> &config,
+               const boost::mpi::communicator &comm,
+               const data::Space<T, Dimension> &root_space,
+               Owned<T, Dimension> &owned, T *potential = nullptr) {
+  using BodyTree = data::tree::BodyTree<T, Dimension>;
+  using WalkTree = walk::WalkTree<T, Dimension>;
+
+  WalkTree local;
+  {
+    timing::Scope scope(timing::Phase::TreeBuild);
+    BodyTree tree;
+    data::BodiesView<T, Dimension> bodies(owned.bodies);
+    for (std::size_t i = 0; i < bodies.size(); ++i) {
+      tree.push(bodies, root_space, i);
+    }
+    local = WalkTree::from_flat(tree.flatten(), config);
+  }
+
+  data::Bodies<T, Dimension> combined;
+  {
+    timing::Scope scope(timing::Phase::TreeMerge);
+    combined = exchange_essential(comm, local, owned);
+  }
+
+  WalkTree walk_tree;
+  {
+    timing::Scope scope(timing::Phase::TreeBuild);
+    combined.insert(combined.begin(), owned.bodies.begin(),
+                    owned.bodies.end());
+    BodyTree tree;
+    data::BodiesView<T, Dimension> bodies(combined);
+    for (std::size_t i = 0; i < bodies.size(); ++i) {
+      tree.push(bodies, root_space, i);
+    }
+    walk_tree = WalkTree::from_flat(tree.flatten(), config);
+  }
+
+  timing::Scope scope(timing::Phase::Force);
+  std::vector<T> magnitudes;
+  physical::step(config, owned.bodies.begin(), owned.bodies.end(), walk_tree,
+                 magnitudes, potential, nullptr);
+}
+
+template <typename K, typename T, std::size_t Dimension>
+void accumulate_block(const config::Configuration<T> &config,
+                      const data::Bodies<T, Dimension> &targets,
+                      const data::Bodies<T, Dimension> &sources,
+                      std::vector<data::Vector<T, Dimension>> &accelerations,
+                      std::vector<T> *potentials) {
+  for (std::size_t i = 0; i < targets.size(); ++i) {
+    for (const auto &source : sources) {
+      accelerations[i] += physical::gravity_per_unit_mass_position_to_position<
+          T, Dimension, K>(config, source.position, source.mass,
+                           targets[i].position,
+                           potentials ? &(*potentials)[i] : nullptr);
+    }
+  }
+}
+
+// update the owned bodies one step by direct summation
+// the bodies of the other processes pass around a ring one block at a time,
+// the next block is received while the current one is summed, so a process
+// holds at most two blocks besides its own bodies
+// `potential` is added the potential energy of the owned bodies before they
+// move if not null, see physical::step
+template <typename T, std::size_t Dimension>
+void step(const config::Configuration<T> &config,
+          const boost::mpi::communicator &comm, Owned<T, Dimension> &owned,
+          T *potential = nullptr) {
+  constexpr int TAG = 0;
+  auto &recorder = profiling::Recorder::instance();
+  profiling::Statistics statistics;
+  statistics.calls = 1;
+
+  timing::Scope scope(timing::Phase::Force);
+  std::vector<int> counts;
+  boost::mpi::all_gather(comm, static_cast<int>(owned.bodies.size()), counts);
+  const int size = comm.size();
+  const int rank = comm.rank();
+  const int left = (rank + size - 1) % size;
+  const int right = (rank + 1) % size;
+  auto body_type =
+      boost::mpi::get_mpi_datatype<data::Body<T, Dimension>>(
+          data::Body<T, Dimension>{});
+
+  std::vector<data::Vector<T, Dimension>> accelerations(owned.bodies.size());
+  std::vector<T> potentials(potential ? owned.bodies.size() : 0);
+  auto *potentials_pointer = potential ? &potentials : nullptr;
+  auto current = owned.bodies;
+  data::Bodies<T, Dimension> incoming;
+  for (int round = 0; round < size; ++round) {
+    MPI_Request requests[2];
+    int pending = 0;
+    if (round + 1 < size) {
+      // the block of round + 1 started at rank - round - 1
+      incoming.resize(counts[(rank + 2 * size - round - 1) % size]);
+      MPI_Irecv(incoming.data(), static_cast<int>(incoming.size()), body_type,
+                left, TAG, comm, &requests[pending++]);
+      MPI_Isend(current.data(), static_cast<int>(current.size()), body_type,
+                right, TAG, comm, &requests[pending++]);
+      statistics.messages += 1;
+      statistics.raw_bytes +=
+          current.size() * sizeof(data::Body<T, Dimension>);
+    }
+    if (config.mixed_precision) {
+      accumulate_block<float>(config, owned.bodies, current, accelerations,
+                              potentials_pointer);
+    } else {
+      accumulate_block<T>(config, owned.bodies, current, accelerations,
+                          potentials_pointer);
+    }
+    // the transfer overlaps the summation, what is left is waiting for the
+    // neighbours
+    auto start = MPI_Wtime();
+    MPI_Waitall(pending, requests, MPI_STATUSES_IGNORE);
+    statistics.wait_time += MPI_Wtime() - start;
+    std::swap(current, incoming);
+  }
+
+  for (std::size_t i = 0; i < owned.bodies.size(); ++i) {
+    auto &body = owned.bodies[i];
+    if (potential)
+      *potential += body.mass * potentials[i] / 2;
+    body.velocity += config.time * accelerations[i];
+    body.position += config.time * body.velocity;
+  }
+  statistics.serialized_bytes = statistics.raw_bytes;
+  if (recorder.enabled)
+    recorder.add(profiling::Collective::BodiesRing, statistics);
+}
+
+// gather all bodies to root in the order of their ids
+// only root receives bodies
+template <typename T, std::size_t Dimension>
+void gather(const boost::mpi::communicator &comm, int root,
+            const Owned<T, Dimension> &owned, std::size_t number,
+            data::Bodies<T, Dimension> &bodies) {
+  auto &recorder = profiling::Recorder::instance();
+  profiling::Statistics statistics;
+  statistics.calls = 1;
+  statistics.messages = comm.rank() == root ? 0 : 1;
+  statistics.raw_bytes = statistics.serialized_bytes =
+      comm.rank() == root
+          ? 0
+          : owned.bodies.size() *
+                (sizeof(data::Body<T, Dimension>) + sizeof(std::uint64_t));
+  profiling::detail::wait_for_all(comm, statistics);
+
+  auto start = MPI_Wtime();
+  auto count = static_cast<int>(owned.bodies.size());
+  auto body_type =
+      boost::mpi::get_mpi_datatype<data::Body<T, Dimension>>(
+          data::Body<T, Dimension>{});
+  if (comm.rank() == root) {
+    std::vector<int> counts(comm.size());
+    MPI_Gather(&count, 1, MPI_INT, counts.data(), 1, MPI_INT, root, comm);
+    std::vector<int> displacements(comm.size(), 0);
+    for (int r = 1; r < comm.size(); ++r) {
+      displacements[r] = displacements[r - 1] + counts[r - 1];
+    }
+    data::Bodies<T, Dimension> received(number);
+    std::vector<std::uint64_t> ids(number);
+    MPI_Gatherv(owned.bodies.data(), count, body_type, received.data(),
+                counts.data(), displacements.data(), body_type, root, comm);
+    MPI_Gatherv(owned.ids.data(), count, MPI_UINT64_T, ids.data(),
+                counts.data(), displacements.data(), MPI_UINT64_T, root, comm);
+    bodies.resize(number);
+    for (std::size_t i = 0; i < number; ++i) {
+      bodies[ids[i]] = received[i];
+    }
+  } else {
+    MPI_Gather(&count, 1, MPI_INT, nullptr, 0, MPI_INT, root, comm);
+    MPI_Gatherv(owned.bodies.data(), count, body_type, nullptr, nullptr,
+                nullptr, body_type, root, comm);
+    MPI_Gatherv(owned.ids.data(), count, MPI_UINT64_T, nullptr, nullptr,
+                nullptr, MPI_UINT64_T, root, comm);
+  }
+  statistics.mpi_time = MPI_Wtime() - start;
+  if (recorder.enabled)
+    recorder.add(profiling::Collective::BodiesGather, statistics);
+}
+
+} // namespace n_body::distributed
+
+#endif
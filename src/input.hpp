@@ -1,10 +1,19 @@
 #ifndef N_BODY_INPUT_HPP
 #define N_BODY_INPUT_HPP
 
+#include "binary.hpp"
+#include "communication.hpp"
+#include "compression.hpp"
 #include "data.hpp"
 #include <boost/archive/xml_iarchive.hpp>
+#include <array>
 #include <boost/mpi.hpp>
+#include <cstdint>
+#include <filesystem>
 #include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
 
 namespace n_body::input {
 
@@ -20,6 +29,119 @@ std::istream &input_bodies(const boost::mpi::communicator &comm, int root,
   return is;
 }
 
+// read bodies from a file
+// binary bodies files are detected by their magic number and read in
+// parallel, otherwise the file is parsed as a (possibly compressed) xml
+// archive in root
+template <typename T, std::size_t Dimension>
+void input_bodies(const boost::mpi::communicator &comm, int root,
+                  const std::filesystem::path &path,
+                  data::Bodies<T, Dimension> &bodies) {
+  bool is_binary = false;
+  if (comm.rank() == root) {
+    is_binary = binary::has_magic(path, binary::BODIES_MAGIC);
+  }
+  boost::mpi::broadcast(comm, is_binary, root);
+  if (is_binary) {
+    binary::read_bodies_file(comm, root, path, bodies);
+    return;
+  }
+
+  if (comm.rank() == root) {
+    auto is = compression::open_input(path);
+    input_bodies(comm, root, *is, bodies);
+  } else {
+    std::istringstream unused;
+    input_bodies(comm, root, unused, bodies);
+  }
+}
+
+// read the division of this rank from a bodies file
+// binary files are read in slices, xml archives are read as a whole in root
+// return the number of bodies in the file
+template <typename T, std::size_t Dimension>
+std::uint64_t input_bodies_division(const boost::mpi::communicator &comm,
+                                    int root,
+                                    const std::filesystem::path &path,
+                                    data::Bodies<T, Dimension> &bodies) {
+  bool is_binary = false;
+  if (comm.rank() == root) {
+    is_binary = binary::has_magic(path, binary::BODIES_MAGIC);
+  }
+  boost::mpi::broadcast(comm, is_binary, root);
+  if (is_binary) {
+    return binary::read_bodies_file_division(comm, root, path, bodies);
+  }
+
+  data::Bodies<T, Dimension> all_bodies;
+  input_bodies(comm, root, path, all_bodies);
+  communication::Division division(comm, all_bodies.size());
+  bodies.assign(all_bodies.begin() + division.begin,
+                all_bodies.begin() + division.end);
+  return all_bodies.size();
+}
+
+// decode samples written by output::PositionsQuantizer
+// frames must be read in order, starting from a key frame
+template <typename T, std::size_t Dimension> class PositionsDequantizer {
+public:
+  bool read(std::istream &is,
+            std::vector<data::Vector<T, Dimension>> &positions) {
+    std::string line;
+    bool key = false;
+    T precision = 0;
+    data::Vector<T, Dimension> origin{};
+    while (is.peek() == '#' && std::getline(is, line)) {
+      std::istringstream header(line.substr(1));
+      std::string field;
+      header >> field;
+      if (field == "precision") {
+        header >> precision;
+      } else if (field == "origin") {
+        for (std::size_t d = 0; d < Dimension; ++d) {
+          header >> origin[d];
+        }
+      } else if (field == "key") {
+        key = true;
+      }
+    }
+    if (!key && this->previous.empty()) {
+      // a delta frame without its key frame
+      is.setstate(std::ios::failbit);
+      return false;
+    }
+
+    std::size_t i = 0;
+    std::array<std::int64_t, Dimension> q;
+    positions.clear();
+    while (std::getline(is, line)) {
+      std::istringstream values(line);
+      for (std::size_t d = 0; d < Dimension; ++d) {
+        values >> q[d];
+      }
+      if (!values)
+        break;
+      if (key) {
+        this->previous.resize(i + 1);
+      } else if (i >= this->previous.size()) {
+        is.setstate(std::ios::failbit);
+        return false;
+      }
+      data::Vector<T, Dimension> position;
+      for (std::size_t d = 0; d < Dimension; ++d) {
+        this->previous[i][d] = key ? q[d] : this->previous[i][d] + q[d];
+        position[d] = origin[d] + precision * this->previous[i][d];
+      }
+      positions.push_back(position);
+      ++i;
+    }
+    return true;
+  }
+
+private:
+  std::vector<std::array<std::int64_t, Dimension>> previous;
+};
+
 } // namespace n_body::input
 
 #endif
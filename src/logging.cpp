@@ -5,11 +5,6 @@
 
 namespace n_body::logging {
 
-Configuration &Configuration::instance() {
-  static Configuration configuration;
-  return configuration;
-}
-
 std::ostream &operator<<(std::ostream &os, Level level) {
   switch (level) {
   case Level::Trace:
@@ -45,14 +40,6 @@ std::istream &operator>>(std::istream &is, Level &level) {
   return is;
 }
 
-bool should_output(Level level) {
-  auto &configuration = Configuration::instance();
-  const auto current = static_cast<std::underlying_type_t<Level>>(level);
-  const auto min =
-      static_cast<std::underlying_type_t<Level>>(configuration.min_level);
-  return current >= min;
-}
-
 std::ostream &level_to_stream(Level level) {
   auto &configuration = Configuration::instance();
   if (should_output(level)) {
@@ -63,7 +50,9 @@ std::ostream &level_to_stream(Level level) {
       case Level::Trace:
       case Level::Debug:
       case Level::Info:
-        return std::cout;
+        return configuration.rank_output != nullptr
+                   ? *configuration.rank_output
+                   : std::cout;
       case Level::Warn:
       case Level::Error:
         return std::cerr;
@@ -82,6 +71,9 @@ std::ostream &level_to_stream(Level level) {
 std::ostream &logger(const boost::mpi::communicator *comm, Level level) {
   auto &configuration = Configuration::instance();
   auto &stream = level_to_stream(level);
+  // nothing to format for the null stream
+  if (!should_output(level))
+    return stream;
   if (configuration.timer != nullptr) {
     stream << "[" << std::right << std::setfill('0')
            << std::setw(configuration.time_width) << std::fixed
@@ -101,4 +93,37 @@ std::ostream &logger(Level level) {
   return logger(configuration.default_communicator, level);
 }
 
+FileSink::FileSink(const std::filesystem::path &path)
+    : file(path, std::ios::out | std::ios::binary), buffer(CAPACITY) {
+  this->setp(this->buffer.data(), this->buffer.data() + this->buffer.size());
+}
+
+FileSink::~FileSink() { this->write_buffer(); }
+
+FileSink::int_type FileSink::overflow(int_type c) {
+  this->write_buffer();
+  if (!traits_type::eq_int_type(c, traits_type::eof())) {
+    *this->pptr() = traits_type::to_char_type(c);
+    this->pbump(1);
+  }
+  return traits_type::not_eof(c);
+}
+
+void FileSink::write_buffer() {
+  this->file.write(this->pbase(), this->pptr() - this->pbase());
+  this->file.flush();
+  this->setp(this->buffer.data(), this->buffer.data() + this->buffer.size());
+}
+
+RankLog::RankLog(const std::filesystem::path &path)
+    : sink(path), stream(&this->sink) {
+  Configuration::instance().rank_output = &this->stream;
+}
+
+RankLog::~RankLog() {
+  auto &configuration = Configuration::instance();
+  if (configuration.rank_output == &this->stream)
+    configuration.rank_output = nullptr;
+}
+
 } // namespace n_body::logging
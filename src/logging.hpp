@@ -2,10 +2,21 @@
 #define N_BODY_LOGGING_HPP
 
 #include "boost/mpi.hpp"
+#include <cstddef>
+#include <filesystem>
+#include <fstream>
 #include <iomanip>
 #include <iostream>
 #include <sstream>
+#include <streambuf>
 #include <type_traits>
+#include <vector>
+
+// least severe level compiled in, 10 (trace) to 50 (error), the messages of
+// less severe levels are removed by the compiler
+#ifndef N_BODY_LOG_MIN_LEVEL
+#define N_BODY_LOG_MIN_LEVEL 10
+#endif
 
 namespace n_body::logging {
 
@@ -19,13 +30,22 @@ enum class Level {
   Error = 50,
 };
 
+constexpr Level COMPILED_MIN_LEVEL = static_cast<Level>(N_BODY_LOG_MIN_LEVEL);
+
 struct Configuration {
-  static Configuration &instance();
+  // inline, so checking the level in N_BODY_LOG is not a call
+  static Configuration &instance() {
+    static Configuration configuration;
+    return configuration;
+  }
 
   const boost::mpi::timer *timer = nullptr;
   const boost::mpi::communicator *default_communicator = nullptr;
   Level min_level = Level::Info;
+  // all levels are written here if not null
   std::ostream *output = nullptr;
+  // otherwise trace, debug and info here if not null, standard output if null
+  std::ostream *rank_output = nullptr;
   int time_width = 20;
   int rank_width = 5;
   int size_width = 5;
@@ -33,14 +53,26 @@ struct Configuration {
 
 extern std::ostream &operator<<(std::ostream &os, Level level);
 extern std::istream &operator>>(std::istream &is, Level &level);
-extern bool should_output(Level level);
+constexpr bool compiled(Level level) {
+  return static_cast<std::underlying_type_t<Level>>(level) >=
+         static_cast<std::underlying_type_t<Level>>(COMPILED_MIN_LEVEL);
+}
+
+inline bool should_output(Level level) {
+  return compiled(level) &&
+         static_cast<std::underlying_type_t<Level>>(level) >=
+             static_cast<std::underlying_type_t<Level>>(
+                 Configuration::instance().min_level);
+}
+
 extern std::ostream &level_to_stream(Level level);
 extern std::ostream &logger(const boost::mpi::communicator &comm, Level level);
 extern std::ostream &logger(Level level);
 
+// a loaded level is written through to the serialized one
 struct level_serializer {
-  Level level;
-  explicit level_serializer(Level level) : level(level) {}
+  Level &level;
+  explicit level_serializer(Level &level) : level(level) {}
 
   template <class Archive>
   void save(Archive &ar, const unsigned int version) const {
@@ -61,6 +93,53 @@ struct level_serializer {
   BOOST_SERIALIZATION_SPLIT_MEMBER();
 };
 
+// log of one process kept in memory and written to its file in blocks of
+// CAPACITY bytes, a flushed line costs no system call and the processes do
+// not contend for a shared terminal
+// the rest is written on destruction, so lines after a crash may be lost
+class FileSink : public std::streambuf {
+public:
+  static constexpr std::size_t CAPACITY = std::size_t{1} << 16u;
+
+  explicit FileSink(const std::filesystem::path &path);
+  FileSink(const FileSink &) = delete;
+  FileSink &operator=(const FileSink &) = delete;
+  ~FileSink() override;
+
+protected:
+  int_type overflow(int_type c) override;
+  // std::endl ends here, the block is written once it is full
+  int sync() override { return 0; }
+
+private:
+  void write_buffer();
+
+  std::ofstream file;
+  std::vector<char> buffer;
+};
+
+// sends trace, debug and info of this process to a FileSink while it lives,
+// warn and error still go to standard error at once
+class RankLog {
+public:
+  explicit RankLog(const std::filesystem::path &path);
+  RankLog(const RankLog &) = delete;
+  RankLog &operator=(const RankLog &) = delete;
+  ~RankLog();
+
+private:
+  FileSink sink;
+  std::ostream stream;
+};
+
 } // namespace n_body::logging
 
+// stream a message only if `level` is compiled in and enabled, otherwise the
+// message is not even evaluated
+//   N_BODY_LOG(Debug) << "expensive " << describe(x) << std::endl;
+#define N_BODY_LOG(level)                                                      \
+  if (!::n_body::logging::should_output(::n_body::logging::Level::level)) {    \
+  } else                                                                       \
+    ::n_body::logging::logger(::n_body::logging::Level::level)
+
 #endif
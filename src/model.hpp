@@ -0,0 +1,298 @@
+#ifndef N_BODY_MODEL_HPP
+#define N_BODY_MODEL_HPP
+
+#include "data.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <functional>
+#include <iostream>
+#include <random>
+#include <string>
+
+// initial condition models
+// all models use G = 1, every body gets the same mass
+// `sample(i, engine)` returns body i of `number` bodies, so each rank can
+// generate its own share independently
+namespace n_body::model {
+
+using namespace n_body::data;
+
+enum class Kind {
+  Cube = 0,
+  Lattice = 1,
+  Plummer = 2,
+  Hernquist = 3,
+  Nfw = 4,
+  Disk = 5,
+  Collision = 6,
+};
+
+inline std::ostream &operator<<(std::ostream &os, Kind kind) {
+  switch (kind) {
+  case Kind::Cube:
+    return os << "cube";
+  case Kind::Lattice:
+    return os << "lattice";
+  case Kind::Plummer:
+    return os << "plummer";
+  case Kind::Hernquist:
+    return os << "hernquist";
+  case Kind::Nfw:
+    return os << "nfw";
+  case Kind::Disk:
+    return os << "disk";
+  case Kind::Collision:
+    return os << "collision";
+  default:
+    return os << "ukn";
+  }
+}
+
+inline std::istream &operator>>(std::istream &is, Kind &kind) {
+  std::string label;
+  is >> label;
+  if (label == "cube")
+    kind = Kind::Cube;
+  else if (label == "lattice")
+    kind = Kind::Lattice;
+  else if (label == "plummer")
+    kind = Kind::Plummer;
+  else if (label == "hernquist")
+    kind = Kind::Hernquist;
+  else if (label == "nfw")
+    kind = Kind::Nfw;
+  else if (label == "disk")
+    kind = Kind::Disk;
+  else if (label == "collision")
+    kind = Kind::Collision;
+  else
+    is.setstate(std::ios::failbit);
+  return is;
+}
+
+template <typename T> struct Parameters {
+  std::size_t number;
+  // total mass
+  T mass = 1;
+  // scale radius of spheres and scale length of disks
+  T scale = 1;
+  // number of bodies per unit volume for cube and lattice
+  T density = 1;
+  // nfw halos are truncated at concentration * scale
+  T concentration = 10;
+  // scale height of disks
+  T scale_height = static_cast<T>(0.1);
+  // distance and relative speed of the two clusters of a collision
+  T separation = 10;
+  T relative_speed = 1;
+};
+
+namespace detail {
+
+template <typename T> constexpr T PI = static_cast<T>(3.14159265358979323846);
+
+template <typename T, typename Engine> T uniform(Engine &engine) {
+  return std::uniform_real_distribution<T>(0, 1)(engine);
+}
+
+// uniform in (0, 1), safe for logarithms and divisions
+template <typename T, typename Engine> T open_uniform(Engine &engine) {
+  T u;
+  do {
+    u = uniform<T>(engine);
+  } while (u <= 0 || u >= 1);
+  return u;
+}
+
+template <typename T, std::size_t Dimension, typename Engine>
+data::Vector<T, Dimension> isotropic(Engine &engine, T length) {
+  data::Vector<T, Dimension> v;
+  T module;
+  do {
+    for (std::size_t d = 0; d < Dimension; ++d) {
+      v[d] = std::normal_distribution<T>(0, 1)(engine);
+    }
+    module = data::module_of(v);
+  } while (module == 0);
+  return v * (length / module);
+}
+
+// solve f(x) = target for increasing f on [low, high] by bisection
+template <typename T, typename F> T invert(F f, T target, T low, T high) {
+  for (int i = 0; i < 100; ++i) {
+    auto middle = (low + high) / 2;
+    if (f(middle) < target)
+      low = middle;
+    else
+      high = middle;
+  }
+  return (low + high) / 2;
+}
+
+template <typename T, std::size_t Dimension, typename Engine>
+data::Body<T, Dimension> plummer(const Parameters<T> &p, T mass,
+                                 Engine &engine) {
+  auto a = p.scale;
+  // invert the cumulative mass m(r) = r^3 / (r^2 + a^2)^(3/2)
+  // draws too close to 1 would place the body at infinity
+  T r;
+  do {
+    auto x = open_uniform<T>(engine);
+    r = a / std::sqrt(std::pow(x, static_cast<T>(-2) / 3) - 1);
+  } while (!std::isfinite(r));
+
+  // von neumann rejection on g(q) = q^2 (1 - q^2)^(7/2)
+  T q, y;
+  do {
+    q = uniform<T>(engine);
+    y = uniform<T>(engine) * static_cast<T>(0.1);
+  } while (y > q * q * std::pow(1 - q * q, static_cast<T>(3.5)));
+  auto escape = std::sqrt(2 * mass) *
+                std::pow(r * r + a * a, static_cast<T>(-0.25));
+
+  data::Body<T, Dimension> body{};
+  body.position = isotropic<T, Dimension>(engine, r);
+  body.velocity = isotropic<T, Dimension>(engine, q * escape);
+  return body;
+}
+
+template <typename T, std::size_t Dimension, typename Engine>
+data::Body<T, Dimension> hernquist(const Parameters<T> &p, Engine &engine) {
+  auto a = p.scale;
+  auto M = p.mass;
+  // invert the cumulative mass m(r) = r^2 / (r + a)^2
+  // r = a sqrt(x) / (1 - sqrt(x)), rewritten to stay finite for x near 1
+  auto x = open_uniform<T>(engine);
+  auto sx = std::sqrt(x);
+  auto r = a * sx * (1 + sx) / (1 - x);
+
+  // isotropic velocity dispersion (Hernquist 1990, eq. 10)
+  // the closed form cancels catastrophically far outside, use the
+  // asymptotic sigma^2 = M / (5 r) there
+  auto s = r / a;
+  auto sigma2 =
+      s > 100 ? M / (5 * r)
+              : M / (12 * a) *
+                    (12 * s * std::pow(1 + s, 3) * std::log((1 + s) / s) -
+                     s / (1 + s) * (25 + 52 * s + 42 * s * s + 12 * s * s * s));
+  auto sigma = std::sqrt(std::max<T>(sigma2, 0));
+  auto escape = std::sqrt(2 * M / (r + a));
+
+  data::Body<T, Dimension> body{};
+  body.position = isotropic<T, Dimension>(engine, r);
+  do {
+    for (std::size_t d = 0; d < Dimension; ++d) {
+      body.velocity[d] = std::normal_distribution<T>(0, sigma)(engine);
+    }
+  } while (data::module_of(body.velocity) >= escape);
+  return body;
+}
+
+template <typename T, std::size_t Dimension, typename Engine>
+data::Body<T, Dimension> nfw(const Parameters<T> &p, Engine &engine) {
+  auto a = p.scale;
+  auto c = p.concentration;
+  auto m = [](T x) { return std::log(1 + x) - x / (1 + x); };
+  auto x = invert<T>(m, open_uniform<T>(engine) * m(c), 0, c);
+  auto r = a * x;
+
+  // local approximation sigma^2 = v_circular^2 / 2
+  auto enclosed = p.mass * m(x) / m(c);
+  auto sigma = std::sqrt(enclosed / (2 * r));
+  auto escape = std::sqrt(2 * enclosed / r);
+
+  data::Body<T, Dimension> body{};
+  body.position = isotropic<T, Dimension>(engine, r);
+  do {
+    for (std::size_t d = 0; d < Dimension; ++d) {
+      body.velocity[d] = std::normal_distribution<T>(0, sigma)(engine);
+    }
+  } while (data::module_of(body.velocity) >= escape);
+  return body;
+}
+
+template <typename T, std::size_t Dimension, typename Engine>
+data::Body<T, Dimension> disk(const Parameters<T> &p, Engine &engine) {
+  static_assert(Dimension >= 2, "a disk needs at least two dimensions");
+  auto rd = p.scale;
+  // surface density exp(-R / rd), m(R) = 1 - (1 + R / rd) exp(-R / rd)
+  auto m = [](T x) { return 1 - (1 + x) * std::exp(-x); };
+  auto R = rd * invert<T>(m, open_uniform<T>(engine), 0, 50);
+  auto phi = 2 * PI<T> * uniform<T>(engine);
+
+  // circular orbit in the field of the enclosed mass
+  auto speed = std::sqrt(p.mass * m(R / rd) / R);
+
+  data::Body<T, Dimension> body{};
+  body.position[0] = R * std::cos(phi);
+  body.position[1] = R * std::sin(phi);
+  body.velocity[0] = -speed * std::sin(phi);
+  body.velocity[1] = speed * std::cos(phi);
+  if constexpr (Dimension >= 3) {
+    // sech^2 vertical profile
+    body.position[2] =
+        p.scale_height * std::atanh(2 * open_uniform<T>(engine) - 1);
+  }
+  return body;
+}
+
+} // namespace detail
+
+template <typename T, std::size_t Dimension, typename Engine>
+data::Body<T, Dimension> sample(Kind kind, const Parameters<T> &p,
+                                std::size_t i, Engine &engine) {
+  data::Body<T, Dimension> body{};
+  switch (kind) {
+  case Kind::Cube: {
+    auto side = std::pow(p.number / p.density, static_cast<T>(1) / Dimension);
+    for (std::size_t d = 0; d < Dimension; ++d) {
+      body.position[d] = (detail::uniform<T>(engine) - static_cast<T>(0.5)) *
+                         side;
+    }
+    break;
+  }
+  case Kind::Lattice: {
+    auto side = static_cast<std::size_t>(
+        std::ceil(std::pow(static_cast<T>(p.number),
+                           static_cast<T>(1) / Dimension) -
+                  static_cast<T>(1e-9)));
+    auto spacing = std::pow(1 / p.density, static_cast<T>(1) / Dimension);
+    auto rest = i;
+    for (std::size_t d = 0; d < Dimension; ++d) {
+      body.position[d] =
+          (static_cast<T>(rest % side) - static_cast<T>(side - 1) / 2) *
+          spacing;
+      rest /= side;
+    }
+    break;
+  }
+  case Kind::Plummer:
+    body = detail::plummer<T, Dimension>(p, p.mass, engine);
+    break;
+  case Kind::Hernquist:
+    body = detail::hernquist<T, Dimension>(p, engine);
+    break;
+  case Kind::Nfw:
+    body = detail::nfw<T, Dimension>(p, engine);
+    break;
+  case Kind::Disk:
+    body = detail::disk<T, Dimension>(p, engine);
+    break;
+  case Kind::Collision: {
+    // two plummer spheres of half the mass approaching along the first axis
+    bool first = i < p.number / 2;
+    body = detail::plummer<T, Dimension>(p, p.mass / 2, engine);
+    auto sign = first ? static_cast<T>(-1) : static_cast<T>(1);
+    body.position[0] += sign * p.separation / 2;
+    body.velocity[0] -= sign * p.relative_speed / 2;
+    break;
+  }
+  }
+  body.mass = p.mass / p.number;
+  return body;
+}
+
+} // namespace n_body::model
+
+#endif
@@ -0,0 +1,83 @@
+#ifndef N_BODY_MORTON_HPP
+#define N_BODY_MORTON_HPP
+
+#include "data.hpp"
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <utility>
+#include <vector>
+
+// ordering of bodies along the morton (z order) curve, bodies close in space
+// end up close in memory
+namespace n_body::morton {
+
+// bits of a key spent on every dimension
+template <std::size_t Dimension> constexpr std::size_t bits_per_dimension() {
+  return 64 / Dimension;
+}
+
+// interleave the bits of the cell coordinates of `position` in `space`,
+// positions outside the space are clamped to its boundary
+// bit d of every group of Dimension bits belongs to dimension d
+template <typename T, std::size_t Dimension>
+std::uint64_t key_of(const data::Space<T, Dimension> &space,
+                     const data::Vector<T, Dimension> &position) {
+  constexpr auto BITS = bits_per_dimension<Dimension>();
+  constexpr auto CELLS = static_cast<double>(std::uint64_t{1} << BITS);
+
+  std::array<std::uint64_t, Dimension> cells{};
+  for (std::size_t d = 0; d < Dimension; ++d) {
+    auto extent = static_cast<double>(space.max[d] - space.min[d]);
+    auto offset = static_cast<double>(position[d] - space.min[d]);
+    auto cell = extent > 0 ? offset / extent * CELLS : 0.0;
+    cells[d] = static_cast<std::uint64_t>(std::clamp(cell, 0.0, CELLS - 1));
+  }
+
+  std::uint64_t key = 0;
+  for (std::size_t bit = BITS; bit > 0; --bit) {
+    for (std::size_t d = Dimension; d > 0; --d) {
+      key = (key << 1u) | ((cells[d - 1] >> (bit - 1)) & 1u);
+    }
+  }
+  return key;
+}
+
+// sort bodies by key, the ids are carried along
+// bodies with equal keys keep their relative order
+template <typename T, std::size_t Dimension>
+void reorder(const data::Space<T, Dimension> &space,
+             data::Body<T, Dimension> *bodies, std::uint64_t *ids,
+             std::size_t count) {
+  std::vector<std::pair<std::uint64_t, std::size_t>> keys(count);
+  for (std::size_t i = 0; i < count; ++i) {
+    keys[i] = {key_of(space, bodies[i].position), i};
+  }
+  std::sort(keys.begin(), keys.end());
+
+  data::Bodies<T, Dimension> sorted_bodies(count);
+  std::vector<std::uint64_t> sorted_ids(count);
+  for (std::size_t i = 0; i < count; ++i) {
+    sorted_bodies[i] = bodies[keys[i].second];
+    sorted_ids[i] = ids[keys[i].second];
+  }
+  std::copy(sorted_bodies.begin(), sorted_bodies.end(), bodies);
+  std::copy(sorted_ids.begin(), sorted_ids.end(), ids);
+}
+
+// copy of the bodies in the order of their ids
+template <typename T, std::size_t Dimension>
+data::Bodies<T, Dimension> in_id_order(const data::BodiesView<T, Dimension> &bodies,
+                                       const std::uint64_t *ids) {
+  data::Bodies<T, Dimension> result(bodies.size());
+  for (std::size_t i = 0; i < bodies.size(); ++i) {
+    result[ids[i]] = bodies[i];
+  }
+  return result;
+}
+
+} // namespace n_body::morton
+
+#endif
@@ -1,34 +1,118 @@
 #ifndef N_BODY_OUTPUT_HPP
 #define N_BODY_OUTPUT_HPP
 
+#include "compression.hpp"
+#include "config.hpp"
 #include "data.hpp"
+#include "diagnostics.hpp"
+#include "profiling.hpp"
+#include "timing.hpp"
+#include "walk.hpp"
+#include <algorithm>
+#include <array>
 #include <boost/archive/xml_oarchive.hpp>
+#include <cmath>
 #include <cstddef>
+#include <cstdint>
 #include <filesystem>
 #include <fstream>
 #include <iostream>
+#include <limits>
 #include <sstream>
+#include <vector>
 
 namespace n_body::output {
 
 template <typename T, std::size_t Dimension>
 void output_positions(const std::filesystem::path &directory_path,
                       std::size_t number,
-                      const data::Bodies<T, Dimension> &bodies) {
+                      const std::vector<data::Vector<T, Dimension>> &positions,
+                      compression::Method compression = compression::Method::None) {
   std::ostringstream filename;
   filename << number;
   filename << ".dat";
-  auto path = directory_path / filename.str();
-  std::ofstream os(path);
-  for (const auto &body : bodies) {
+  auto os = compression::open_output(directory_path / filename.str(),
+                                     compression);
+  for (const auto &position : positions) {
     for (std::size_t d = 0; d < Dimension; ++d) {
       if (d != 0)
-        os << " ";
-      os << body.position[d];
+        *os << " ";
+      *os << position[d];
+    }
+    *os << '\n';
+  }
+  *os << std::flush;
+}
+
+// lossy encoding of positions
+// every coordinate is rounded to a multiple of `precision` relative to the
+// lower corner of the first frame's bounding box, then written as the
+// difference to the same coordinate in the previous frame
+// the first frame is a key frame and holds the absolute values
+// slowly moving bodies produce small integers, which compress well
+template <typename T, std::size_t Dimension> class PositionsQuantizer {
+public:
+  using quantized_type = std::array<std::int64_t, Dimension>;
+
+  explicit PositionsQuantizer(T precision) : precision(precision) {}
+
+  void write(std::ostream &os,
+             const std::vector<data::Vector<T, Dimension>> &positions) {
+    bool key = this->previous.size() != positions.size();
+    if (key) {
+      for (std::size_t d = 0; d < Dimension; ++d) {
+        this->origin[d] = std::numeric_limits<T>::max();
+      }
+      for (const auto &position : positions) {
+        for (std::size_t d = 0; d < Dimension; ++d) {
+          this->origin[d] = std::min(this->origin[d], position[d]);
+        }
+      }
+      this->previous.assign(positions.size(), quantized_type{});
+    }
+
+    // readers decode from the origin, which must not be rounded
+    os.precision(std::numeric_limits<T>::max_digits10);
+    os << "# quantized positions\n";
+    os << "# precision " << this->precision << '\n';
+    os << "# origin";
+    for (std::size_t d = 0; d < Dimension; ++d) {
+      os << " " << this->origin[d];
     }
     os << '\n';
+    os << (key ? "# key\n" : "# delta\n");
+    for (std::size_t i = 0; i < positions.size(); ++i) {
+      for (std::size_t d = 0; d < Dimension; ++d) {
+        auto q = static_cast<std::int64_t>(std::llround(
+            (positions[i][d] - this->origin[d]) / this->precision));
+        if (d != 0)
+          os << " ";
+        os << q - this->previous[i][d];
+        this->previous[i][d] = q;
+      }
+      os << '\n';
+    }
   }
-  os << std::flush;
+
+private:
+  T precision;
+  data::Vector<T, Dimension> origin{};
+  std::vector<quantized_type> previous;
+};
+
+template <typename T, std::size_t Dimension>
+void output_quantized_positions(
+    const std::filesystem::path &directory_path, std::size_t number,
+    const std::vector<data::Vector<T, Dimension>> &positions,
+    PositionsQuantizer<T, Dimension> &quantizer,
+    compression::Method compression = compression::Method::None) {
+  std::ostringstream filename;
+  filename << number;
+  filename << ".qdat";
+  auto os = compression::open_output(directory_path / filename.str(),
+                                     compression);
+  quantizer.write(*os, positions);
+  *os << std::flush;
 }
 
 template <typename T>
@@ -41,18 +125,27 @@ void dump_configuration(const std::filesystem::path &directory_path,
 
 template <typename T, std::size_t Dimension>
 void dump_bodies(const std::filesystem::path &directory_path,
-                 data::Bodies<T, Dimension> bodies) {
-  std::ofstream os(directory_path / "_bodies.xml");
-  boost::archive::xml_oarchive ar(os);
-  ar << BOOST_SERIALIZATION_NVP(bodies);
+                 const data::Bodies<T, Dimension> &bodies,
+                 compression::Method compression = compression::Method::None) {
+  auto os = compression::open_output(directory_path / "_bodies.xml",
+                                     compression);
+  {
+    boost::archive::xml_oarchive ar(*os);
+    ar << BOOST_SERIALIZATION_NVP(bodies);
+  } // the archive writes its trailer on destruction
 }
 
 template <typename T, std::size_t Dimension>
-void dump_bodies_finished(const std::filesystem::path &directory_path,
-                          data::Bodies<T, Dimension> bodies) {
-  std::ofstream os(directory_path / "_bodies_finished.xml");
-  boost::archive::xml_oarchive ar(os);
-  ar << BOOST_SERIALIZATION_NVP(bodies);
+void dump_bodies_finished(
+    const std::filesystem::path &directory_path,
+    const data::Bodies<T, Dimension> &bodies,
+    compression::Method compression = compression::Method::None) {
+  auto os = compression::open_output(directory_path / "_bodies_finished.xml",
+                                     compression);
+  {
+    boost::archive::xml_oarchive ar(*os);
+    ar << BOOST_SERIALIZATION_NVP(bodies);
+  } // the archive writes its trailer on destruction
 }
 
 template <typename T>
@@ -75,6 +168,99 @@ void output_sample_number(const std::filesystem::path &directory_path,
   os << std::flush;
 }
 
+// append the phase times of steps (first_step, last_step] as one row per
+// phase, the header is written when the file is created
+inline void output_timings(const std::filesystem::path &directory_path,
+                           std::size_t first_step, std::size_t last_step,
+                           const timing::Summary &summary) {
+  auto path = directory_path / "_timings.csv";
+  bool exists = std::filesystem::exists(path);
+  std::ofstream os(path, std::ios::out | std::ios::app);
+  if (!exists)
+    os << "first_step,last_step,phase,min,avg,max\n";
+  for (std::size_t i = 0; i < timing::PHASES; ++i) {
+    os << first_step << ',' << last_step << ','
+       << static_cast<timing::Phase>(i) << ',' << summary.min[i] << ','
+       << summary.avg[i] << ',' << summary.max[i] << '\n';
+  }
+  os << std::flush;
+}
+
+// append the diagnostics of the state after `step` as one row, the header is
+// written when the file is created
+// full precision, the drift of conserved quantities is in the last digits
+template <typename T, std::size_t Dimension>
+void output_diagnostics(const std::filesystem::path &directory_path,
+                        std::size_t step,
+                        const diagnostics::Diagnostics<T, Dimension> &d) {
+  constexpr char AXES[] = "xyz";
+  auto path = directory_path / "_diagnostics.csv";
+  bool exists = std::filesystem::exists(path);
+  std::ofstream os(path, std::ios::out | std::ios::app);
+  if (!exists) {
+    os << "step,kinetic,potential,total";
+    for (std::size_t i = 0; i < Dimension; ++i)
+      os << ",momentum_" << AXES[i];
+    for (std::size_t i = 0; i < 3; ++i)
+      os << ",angular_momentum_" << AXES[i];
+    os << ",virial_ratio\n";
+  }
+  os.precision(std::numeric_limits<T>::max_digits10);
+  os << step << ',' << d.kinetic << ',' << d.potential << ',' << d.total();
+  for (auto p : d.momentum)
+    os << ',' << p;
+  for (auto l : d.angular_momentum)
+    os << ',' << l;
+  os << ',' << d.virial_ratio() << '\n' << std::flush;
+}
+
+// append the statistics of the tree and the interactions of `step` as one
+// row, the header is written when the file is created
+// `walk_bytes` is the size of the walk tree, or of the interaction lists
+inline void output_tree(const std::filesystem::path &directory_path,
+                        std::size_t step,
+                        const data::tree::TreeStatistics &tree,
+                        std::size_t walk_bytes,
+                        const walk::InteractionSummary &interactions) {
+  auto path = directory_path / "_tree.csv";
+  bool exists = std::filesystem::exists(path);
+  std::ofstream os(path, std::ios::out | std::ios::app);
+  if (!exists)
+    os << "step,nodes,inner,leaves,max_depth,average_depth,bytes,walk_bytes,"
+          "local_nodes,max_local_nodes,merge_ratio,serialized_bytes,"
+          "interactions_min,interactions_mean,interactions_max\n";
+  os << step << ',' << tree.nodes << ',' << tree.inner << ',' << tree.leaves
+     << ',' << tree.max_depth << ',' << tree.average_depth << ','
+     << tree.bytes << ',' << walk_bytes << ',' << tree.local_nodes << ','
+     << tree.max_local_nodes << ',' << tree.merge_ratio() << ','
+     << tree.serialized_bytes << ',' << interactions.min << ','
+     << interactions.mean() << ',' << interactions.max << '\n'
+     << std::flush;
+}
+
+// append the communication statistics of steps (first_step, last_step] as
+// one row per collective, the header is written when the file is created
+inline void output_communication(const std::filesystem::path &directory_path,
+                                 std::size_t first_step, std::size_t last_step,
+                                 const profiling::Summary &summary) {
+  auto path = directory_path / "_communication.csv";
+  bool exists = std::filesystem::exists(path);
+  std::ofstream os(path, std::ios::out | std::ios::app);
+  if (!exists)
+    os << "first_step,last_step,collective,calls,messages,raw_bytes,"
+          "serialized_bytes,serialization_time_max,wait_time_max,"
+          "mpi_time_max\n";
+  for (std::size_t i = 0; i < profiling::COLLECTIVES; ++i) {
+    const auto &s = summary[i];
+    os << first_step << ',' << last_step << ','
+       << static_cast<profiling::Collective>(i) << ',' << s.calls << ','
+       << s.messages << ',' << s.raw_bytes << ',' << s.serialized_bytes
+       << ',' << s.serialization_time << ',' << s.wait_time << ','
+       << s.mpi_time << '\n';
+  }
+  os << std::flush;
+}
+
 template <typename T, std::size_t Dimension>
 void output_bounds(const std::filesystem::path &directory_path,
                    data::Space<T, Dimension> space) {
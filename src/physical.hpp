@@ -5,165 +5,718 @@
 #include "config.hpp"
 #include "data.hpp"
 #include "logging.hpp"
+#include "profiling.hpp"
+#include "shared.hpp"
 #include "space.hpp"
+#include "timing.hpp"
 #include "tree.hpp"
+#include "walk.hpp"
+#include <algorithm>
 #include <boost/archive/xml_oarchive.hpp>
 #include <boost/mpi.hpp>
 #include <cmath>
 #include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <iterator>
+#include <limits>
+#include <stdexcept>
+#include <vector>
 
 namespace n_body::physical {
 
 using namespace n_body::data;
 
-template <typename T, std::size_t Dimension>
-void step(const config::Configuration<T> &config,
-          const boost::mpi::communicator &comm, int root,
-          data::Bodies<T, Dimension> &bodies,
-          const data::tree::BodyTree<T, Dimension> &tree);
+template <typename T, std::size_t Dimension, typename Iter>
+void step(const config::Configuration<T> &config, Iter first, Iter last,
+          const walk::WalkTree<T, Dimension> &tree);
 
 template <typename T, std::size_t Dimension, typename Iter>
 void step(const config::Configuration<T> &config, Iter first, Iter last,
-          const data::tree::BodyTree<T, Dimension> &tree);
+          const walk::WalkView<T, Dimension> &tree,
+          std::vector<T> &magnitudes, T *potential = nullptr,
+          std::vector<std::uint64_t> *interactions = nullptr);
 
 template <typename T, std::size_t Dimension, typename Iter>
 void step(const config::Configuration<T> &config, Iter first, Iter last,
-          const data::Bodies<T, Dimension> &bodies);
+          const walk::WalkTree<T, Dimension> &tree,
+          std::vector<T> &magnitudes, T *potential = nullptr,
+          std::vector<std::uint64_t> *interactions = nullptr);
 
-template <typename T, std::size_t Dimension>
+template <typename T, std::size_t Dimension, typename Iter>
+void step(const config::Configuration<T> &config, Iter first, Iter last,
+          const walk::InteractionLists<T, Dimension> &lists,
+          T *potential = nullptr,
+          std::vector<std::uint64_t> *interactions = nullptr);
+
+template <typename T, std::size_t Dimension, typename Iter>
+void step(const config::Configuration<T> &config, Iter first, Iter last,
+          const data::BodiesView<T, Dimension> &bodies,
+          T *potential = nullptr);
+
+template <typename T, std::size_t Dimension, typename Iter>
+void step(const config::Configuration<T> &config, Iter first, Iter last,
+          const data::Bodies<T, Dimension> &bodies, T *potential = nullptr);
+
+// K is the type the interactions are computed in
+// positions and the returned accelerations stay in T
+template <typename K, typename T, std::size_t Dimension, typename Iter>
+void step_in(const config::Configuration<T> &config, Iter first, Iter last,
+             const walk::WalkView<T, Dimension> &tree,
+             std::vector<T> &magnitudes, T *potential,
+             std::vector<std::uint64_t> *interactions);
+
+template <typename K, typename T, std::size_t Dimension, typename Iter>
+void step_in(const config::Configuration<T> &config, Iter first, Iter last,
+             const walk::InteractionLists<T, Dimension> &lists,
+             T *potential, std::vector<std::uint64_t> *interactions);
+
+template <typename K, typename T, std::size_t Dimension, typename Iter>
+void step_in(const config::Configuration<T> &config, Iter first, Iter last,
+             const data::BodiesView<T, Dimension> &bodies, T *potential);
+
+// `scale` is the opening scale of the position, see walk::opening_scale
+// the number of accepted nodes is added to `interactions` and the potential
+// per unit mass at the position to `potential` if not null
+template <typename T, std::size_t Dimension, typename K = T>
 data::Vector<T, Dimension> gravity_per_unit_mass_tree_to_position(
     const config::Configuration<T> &config,
-    const data::tree::BodyTree<T, Dimension> &tree,
-    const data::Vector<T, Dimension> &position);
+    const walk::WalkView<T, Dimension> &tree,
+    const data::Vector<T, Dimension> &position,
+    T scale = std::numeric_limits<T>::infinity(),
+    std::uint64_t *interactions = nullptr, T *potential = nullptr);
 
-template <typename T, std::size_t Dimension>
-data::Vector<T, Dimension> gravity_per_unit_mass_subtree_to_position(
+template <typename T, std::size_t Dimension, typename K = T>
+data::Vector<T, Dimension> gravity_per_unit_mass_tree_to_position(
     const config::Configuration<T> &config,
-    const data::tree::BodyTree<T, Dimension> &tree, std::size_t root,
-    const data::Vector<T, Dimension> &position);
+    const walk::WalkTree<T, Dimension> &tree,
+    const data::Vector<T, Dimension> &position,
+    T scale = std::numeric_limits<T>::infinity(),
+    std::uint64_t *interactions = nullptr, T *potential = nullptr);
 
-template <typename T, std::size_t Dimension>
+// `scales` holds the opening scale of every position, null for infinite,
+// `potentials` receives the potential per unit mass and `interactions` the
+// number of accepted nodes of every position if not null
+template <typename T, std::size_t Dimension, typename K = T>
+void gravity_per_unit_mass_tree_to_packet(
+    const config::Configuration<T> &config,
+    const walk::WalkView<T, Dimension> &tree,
+    const data::Vector<T, Dimension> *positions, std::size_t count,
+    data::Vector<T, Dimension> *accelerations, const T *scales = nullptr,
+    T *potentials = nullptr, std::uint64_t *interactions = nullptr);
+
+template <typename T, std::size_t Dimension, typename K = T>
+void gravity_per_unit_mass_tree_to_packet(
+    const config::Configuration<T> &config,
+    const walk::WalkTree<T, Dimension> &tree,
+    const data::Vector<T, Dimension> *positions, std::size_t count,
+    data::Vector<T, Dimension> *accelerations, const T *scales = nullptr,
+    T *potentials = nullptr, std::uint64_t *interactions = nullptr);
+
+// the potential per unit mass at the position is added to `potential` if
+// not null
+template <typename T, std::size_t Dimension, typename K = T>
 data::Vector<T, Dimension> gravity_per_unit_mass_position_to_position(
     const config::Configuration<T> &config,
     const data::Vector<T, Dimension> &other_position,
-    data::Scalar<T> other_mass, const data::Vector<T, Dimension> &position);
+    data::Scalar<T> other_mass, const data::Vector<T, Dimension> &position,
+    T *potential = nullptr);
 
-// update bodies one step
-template <typename T, std::size_t Dimension>
+// update bodies one step, `source` is what the forces are computed from:
+// the bodies for a direct sum, a walk tree or interaction lists, `state` is
+// passed along with it
+// a `potential` passed in the state is added the potential energy of the
+// local bodies in the field of the source before they move, half of every
+// pair as it is counted from both sides, so the sum over processes is the
+// potential energy of the system
+// the local bodies are the division of the process in `partition`, equal
+// divisions if it is empty
+template <typename T, std::size_t Dimension, typename Source,
+          typename... State>
 void step(const config::Configuration<T> &config,
           const boost::mpi::communicator &comm,
-          data::Bodies<T, Dimension> &bodies,
-          const data::tree::BodyTree<T, Dimension> &tree) {
-  communication::Division division(comm, bodies.size());
-  data::Bodies<T, Dimension> local_bodies(&bodies[division.begin],
-                                          &bodies[division.end]);
-  // step(config, local_bodies.begin(), local_bodies.end(), tree);
-  step(config, local_bodies.begin(), local_bodies.end(), bodies);
-  boost::mpi::all_gather(comm, local_bodies.data(), division.count, bodies);
+          const communication::Partition &partition,
+          data::Bodies<T, Dimension> &bodies, const Source &source,
+          State &...state) {
+  communication::Division division(comm, bodies.size(), partition);
+  // a balanced division may be empty and end past the last body
+  data::Bodies<T, Dimension> local_bodies(bodies.data() + division.begin,
+                                          bodies.data() + division.end);
+  {
+    timing::Scope scope(timing::Phase::Force);
+    step(config, local_bodies.begin(), local_bodies.end(), source, state...);
+  }
+  timing::Scope scope(timing::Phase::Gather);
+  if (partition.empty()) {
+    profiling::all_gather(comm, profiling::Collective::BodiesGather,
+                          local_bodies.data(), division.count, bodies);
+  } else {
+    std::vector<int> counts;
+    profiling::all_gatherv(comm, profiling::Collective::BodiesGather,
+                           local_bodies, bodies, counts);
+  }
+}
+
+template <typename T, std::size_t Dimension, typename Source,
+          typename... State>
+void step(const config::Configuration<T> &config,
+          const boost::mpi::communicator &comm,
+          data::Bodies<T, Dimension> &bodies, const Source &source,
+          State &...state) {
+  step(config, comm, communication::Partition(), bodies, source, state...);
+}
+
+// update bodies one step, the bodies live in memory shared by the processes
+// of a node
+// every process updates its own division, then the divisions are written
+// back and exchanged between nodes
+template <typename T, std::size_t Dimension, typename Source,
+          typename... State>
+void step(const config::Configuration<T> &config,
+          const shared::Topology &topology,
+          const communication::Partition &partition,
+          shared::SharedArray<data::Body<T, Dimension>> &bodies,
+          const Source &source, State &...state) {
+  communication::Division division(topology.world, bodies.size(), partition);
+  data::Bodies<T, Dimension> local_bodies(bodies.begin() + division.begin,
+                                          bodies.begin() + division.end);
+  {
+    timing::Scope scope(timing::Phase::Force);
+    step(config, local_bodies.begin(), local_bodies.end(), source, state...);
+  }
+  timing::Scope scope(timing::Phase::Gather);
+  if (partition.empty()) {
+    bodies.all_gather(profiling::Collective::BodiesGather,
+                      local_bodies.data(), division.count);
+  } else {
+    bodies.all_gather(profiling::Collective::BodiesGather,
+                      local_bodies.data(), partition);
+  }
 }
 
 // update bodies one step by iterator
 template <typename T, std::size_t Dimension, typename Iter>
 void step(const config::Configuration<T> &config, Iter first, Iter last,
-          const data::Bodies<T, Dimension> &bodies) {
-  for (; first != last; ++first) {
-    data::Vector<T, Dimension> acceleration{
-        0,
-        0,
-        0,
-    };
-    for (const auto &body : bodies) {
-      acceleration += gravity_per_unit_mass_position_to_position(
-          config, body.position, body.mass, first->position);
-    }
-    first->velocity += config.time * acceleration;
-    first->position += config.time * first->velocity;
+          const data::BodiesView<T, Dimension> &bodies, T *potential) {
+  if (config.mixed_precision) {
+    step_in<float>(config, first, last, bodies, potential);
+  } else {
+    step_in<T>(config, first, last, bodies, potential);
   }
 }
 
+template <typename T, std::size_t Dimension, typename Iter>
+void step(const config::Configuration<T> &config, Iter first, Iter last,
+          const data::Bodies<T, Dimension> &bodies, T *potential) {
+  step(config, first, last, data::BodiesView<T, Dimension>(bodies),
+       potential);
+}
+
 // update bodies one step by iterator
 template <typename T, std::size_t Dimension, typename Iter>
 void step(const config::Configuration<T> &config, Iter first, Iter last,
-          const data::tree::BodyTree<T, Dimension> &tree) {
+          const walk::WalkTree<T, Dimension> &tree) {
+  std::vector<T> magnitudes;
+  step(config, first, last, tree, magnitudes);
+}
+
+// `magnitudes` holds the acceleration of every body in the previous step for
+// the relative criterion, it is replaced by the accelerations of this step
+// the walk falls back to the geometric radii while they are unknown
+// `interactions` receives the number of nodes every body interacted with if
+// not null
+template <typename T, std::size_t Dimension, typename Iter>
+void step(const config::Configuration<T> &config, Iter first, Iter last,
+          const walk::WalkView<T, Dimension> &tree,
+          std::vector<T> &magnitudes, T *potential,
+          std::vector<std::uint64_t> *interactions) {
+  if (config.mixed_precision) {
+    step_in<float>(config, first, last, tree, magnitudes, potential,
+                   interactions);
+  } else {
+    step_in<T>(config, first, last, tree, magnitudes, potential,
+               interactions);
+  }
+}
+
+template <typename T, std::size_t Dimension, typename Iter>
+void step(const config::Configuration<T> &config, Iter first, Iter last,
+          const walk::WalkTree<T, Dimension> &tree,
+          std::vector<T> &magnitudes, T *potential,
+          std::vector<std::uint64_t> *interactions) {
+  step(config, first, last, walk::WalkView<T, Dimension>(tree), magnitudes,
+       potential, interactions);
+}
+
+// update bodies one step by iterator, [first, last) are the bodies the
+// lists were built for
+template <typename T, std::size_t Dimension, typename Iter>
+void step(const config::Configuration<T> &config, Iter first, Iter last,
+          const walk::InteractionLists<T, Dimension> &lists,
+          T *potential, std::vector<std::uint64_t> *interactions) {
+  if (config.mixed_precision) {
+    step_in<float>(config, first, last, lists, potential, interactions);
+  } else {
+    step_in<T>(config, first, last, lists, potential, interactions);
+  }
+}
+
+template <typename K, typename T, std::size_t Dimension, typename Iter>
+void step_in(const config::Configuration<T> &config, Iter first, Iter last,
+             const data::BodiesView<T, Dimension> &bodies, T *potential) {
   for (; first != last; ++first) {
-    auto acceleration =
-        gravity_per_unit_mass_tree_to_position(config, tree, first->position);
+    data::Vector<T, Dimension> acceleration{};
+    T phi = 0;
+    for (const auto &body : bodies) {
+      acceleration += gravity_per_unit_mass_position_to_position<T, Dimension,
+                                                                 K>(
+          config, body.position, body.mass, first->position,
+          potential ? &phi : nullptr);
+    }
+    if (potential)
+      *potential += first->mass * phi / 2;
     first->velocity += config.time * acceleration;
     first->position += config.time * first->velocity;
   }
 }
 
-template <typename T, std::size_t Dimension>
+template <typename K, typename T, std::size_t Dimension, typename Iter>
+void step_in(const config::Configuration<T> &config, Iter first, Iter last,
+             const walk::WalkView<T, Dimension> &tree,
+             std::vector<T> &magnitudes, T *potential,
+             std::vector<std::uint64_t> *interactions) {
+  auto relative = config.opening == config::OpeningCriterion::Relative;
+  if (interactions)
+    interactions->assign(std::distance(first, last), 0);
+  auto known = relative && magnitudes.size() ==
+                               static_cast<std::size_t>(
+                                   std::distance(first, last));
+  auto scale_of = [&](std::size_t i) {
+    return known ? walk::opening_scale(config, magnitudes[i])
+                 : std::numeric_limits<T>::infinity();
+  };
+  std::vector<T> current;
+
+  if (config.method == config::ForceMethod::Packet) {
+    data::Vector<T, Dimension> positions[walk::PACKET_SIZE];
+    data::Vector<T, Dimension> accelerations[walk::PACKET_SIZE];
+    T scales[walk::PACKET_SIZE];
+    T potentials[walk::PACKET_SIZE];
+    std::size_t i = 0;
+    while (first != last) {
+      auto packet = first;
+      std::size_t count = 0;
+      for (; first != last && count < walk::PACKET_SIZE; ++first, ++count) {
+        positions[count] = first->position;
+        scales[count] = scale_of(i + count);
+      }
+      gravity_per_unit_mass_tree_to_packet<T, Dimension, K>(
+          config, tree, positions, count, accelerations, scales,
+          potential ? potentials : nullptr,
+          interactions ? interactions->data() + i : nullptr);
+      for (std::size_t l = 0; l < count; ++l, ++packet) {
+        if (potential)
+          *potential += packet->mass * potentials[l] / 2;
+        packet->velocity += config.time * accelerations[l];
+        packet->position += config.time * packet->velocity;
+        if (relative)
+          current.push_back(data::module_of(accelerations[l]));
+      }
+      i += count;
+    }
+  } else {
+    for (std::size_t i = 0; first != last; ++first, ++i) {
+      T phi = 0;
+      auto acceleration =
+          gravity_per_unit_mass_tree_to_position<T, Dimension, K>(
+              config, tree, first->position, scale_of(i),
+              interactions ? interactions->data() + i : nullptr,
+              potential ? &phi : nullptr);
+      if (potential)
+        *potential += first->mass * phi / 2;
+      first->velocity += config.time * acceleration;
+      first->position += config.time * first->velocity;
+      if (relative)
+        current.push_back(data::module_of(acceleration));
+    }
+  }
+  magnitudes.swap(current);
+}
+
+// every group is evaluated against its list lane parallel, unused lanes
+// repeat the last body of the group and their results are dropped
+// interactions are computed in K and accumulated in T
+template <typename K, typename T, std::size_t Dimension, typename Iter>
+void step_in(const config::Configuration<T> &config, Iter first, Iter last,
+             const walk::InteractionLists<T, Dimension> &lists,
+             T *potential, std::vector<std::uint64_t> *interactions) {
+  constexpr auto LANES = walk::PACKET_SIZE;
+  if (static_cast<std::size_t>(std::distance(first, last)) !=
+      lists.order.size()) {
+    throw std::invalid_argument("interaction lists of other bodies");
+  }
+  if (interactions)
+    interactions->assign(lists.order.size(), 0);
+  const auto *nodes = lists.view().data();
+  auto soften2 = static_cast<K>(config.soften_length) *
+                 static_cast<K>(config.soften_length);
+  auto G = static_cast<K>(config.G);
+
+  for (std::size_t g = 0; g < lists.groups(); ++g) {
+    auto begin = g * LANES;
+    auto count = std::min(LANES, lists.order.size() - begin);
+    T position[Dimension][LANES];
+    T sum[Dimension][LANES] = {};
+    T phi[LANES] = {};
+    std::uint32_t hits[LANES] = {};
+    for (std::size_t l = 0; l < LANES; ++l) {
+      const auto &body = first[lists.order[begin + std::min(l, count - 1)]];
+      for (std::size_t d = 0; d < Dimension; ++d) {
+        position[d][l] = body.position[d];
+      }
+    }
+
+    for (auto k = lists.offsets[g]; k < lists.offsets[g + 1]; ++k) {
+      const auto &node = nodes[lists.nodes[k]];
+      T dp[Dimension][LANES];
+      T distance2[LANES] = {};
+      for (std::size_t d = 0; d < Dimension; ++d) {
+#pragma omp simd
+        for (std::size_t l = 0; l < LANES; ++l) {
+          dp[d][l] = node.center_of_mass[d] - position[d][l];
+          distance2[l] += dp[d][l] * dp[d][l];
+        }
+      }
+      // the body itself gets a weight of 0 and divides by 1 more than r2
+      // instead of being skipped, so the loop is vectorized, the weights
+      // are computed apart or the compiler branches around the division
+      K active[LANES];
+#pragma omp simd
+      for (std::size_t l = 0; l < LANES; ++l) {
+        active[l] = distance2[l] != 0 ? K{1} : K{0};
+      }
+      K factor[LANES];
+      auto Gm = G * static_cast<K>(node.mass);
+#pragma omp simd
+      for (std::size_t l = 0; l < LANES; ++l) {
+        auto r2 = soften2 + static_cast<K>(distance2[l]);
+        auto safe_r2 = r2 + (1 - active[l]);
+        factor[l] = active[l] * Gm / (safe_r2 * std::sqrt(safe_r2));
+        // G m / r, almost free next to the force
+        phi[l] -= static_cast<T>(factor[l] * r2);
+      }
+      for (std::size_t d = 0; d < Dimension; ++d) {
+#pragma omp simd
+        for (std::size_t l = 0; l < LANES; ++l) {
+          sum[d][l] += static_cast<T>(factor[l] * static_cast<K>(dp[d][l]));
+        }
+      }
+      for (std::size_t l = 0; l < LANES; ++l) {
+        hits[l] += distance2[l] != 0;
+      }
+    }
+
+    for (std::size_t l = 0; l < count; ++l) {
+      auto &body = first[lists.order[begin + l]];
+      if (potential)
+        *potential += body.mass * phi[l] / 2;
+      if (interactions)
+        (*interactions)[lists.order[begin + l]] = hits[l];
+      for (std::size_t d = 0; d < Dimension; ++d) {
+        body.velocity[d] += config.time * sum[d][l];
+      }
+      body.position += config.time * body.velocity;
+    }
+  }
+}
+
+// iterative walk over the tree with a fixed size stack of node indices
+// a node is accepted when the position is beyond its opening radius,
+// leaves always interact, the position itself contributes nothing
+// interactions are computed in K and accumulated in T
+template <typename T, std::size_t Dimension, typename K>
 data::Vector<T, Dimension> gravity_per_unit_mass_tree_to_position(
     const config::Configuration<T> &config,
-    const data::tree::BodyTree<T, Dimension> &tree,
-    const data::Vector<T, Dimension> &position) {
-  if (tree.tree.empty())
-    return {0, 0, 0};
-  return gravity_per_unit_mass_subtree_to_position(config, tree, 0, position);
+    const walk::WalkView<T, Dimension> &tree,
+    const data::Vector<T, Dimension> &position, T scale,
+    std::uint64_t *interactions, T *potential) {
+  if (tree.empty())
+    return {};
+  const auto *nodes = tree.data();
+  auto soften2 = static_cast<K>(config.soften_length) *
+                 static_cast<K>(config.soften_length);
+  auto G = static_cast<K>(config.G);
+
+  std::uint32_t stack[walk::stack_size<Dimension>()];
+  std::size_t top = 0;
+  stack[top++] = 0;
+  data::Vector<T, Dimension> sum{};
+  T phi = 0;
+  std::uint64_t accepted = 0;
+  while (top != 0) {
+    const auto &node = nodes[stack[--top]];
+    data::Vector<T, Dimension> dp;
+    T distance2 = 0;
+    for (std::size_t d = 0; d < Dimension; ++d) {
+      dp[d] = node.center_of_mass[d] - position[d];
+      distance2 += dp[d] * dp[d];
+    }
+    if (node.children != 0 && !walk::accepts(node, distance2, scale)) {
+      for (std::uint32_t c = 0; c < node.children; ++c) {
+        stack[top++] = node.first_child + c;
+      }
+      continue;
+    }
+    if (distance2 == 0)
+      continue; // singularity
+    ++accepted;
+    auto r2 = soften2 + static_cast<K>(distance2);
+    auto factor = G * static_cast<K>(node.mass) / (r2 * std::sqrt(r2));
+    for (std::size_t d = 0; d < Dimension; ++d) {
+      sum[d] += static_cast<T>(factor * static_cast<K>(dp[d]));
+    }
+    phi -= static_cast<T>(factor * r2);
+  }
+  if (interactions)
+    *interactions += accepted;
+  if (potential)
+    *potential += phi;
+  return sum;
 }
 
-template <typename T, std::size_t Dimension>
-data::Vector<T, Dimension> gravity_per_unit_mass_subtree_to_position(
+// walk the tree once for a packet of up to PACKET_SIZE positions, like the
+// packets of rays in a renderer
+// every stack entry carries the mask of the lanes which opened its parent,
+// a node is interacted with by the lanes accepting it and opened for the
+// rest, so every lane meets the same nodes in the same order as the scalar
+// walk and gets the same result
+// lanes are stored per dimension and the loops over lanes are free of
+// branches, so they are vectorized
+template <typename T, std::size_t Dimension, typename K>
+void gravity_per_unit_mass_tree_to_packet(
     const config::Configuration<T> &config,
-    const data::tree::BodyTree<T, Dimension> &tree, std::size_t root,
-    const data::Vector<T, Dimension> &position) {
-
-  if (tree.node(root).node_type() == data::tree::NodeType::Inner) {
-    auto position_in_space = space::contains(tree.node(root).space, position);
-
-    auto space_size = space::size_of_space(tree.node(root).space);
-    auto distance = data::module_of(position - tree.node(root).center_of_mass);
-    if (!position_in_space && (space_size / distance) < config.theta) {
-      return gravity_per_unit_mass_position_to_position(
-          config, tree.node(root).center_of_mass, tree.node(root).mass,
-          position);
-    } else {
-      data::Vector<T, Dimension> sum{
-          0,
-          0,
-          0,
-      };
-      for (std::size_t i = 0;
-           i < data::tree::BodyTreeInnerNode<T, Dimension>::CHILDREN_NUMBER;
-           ++i) {
-        if (auto subtree = tree.child_of_node(root, i)) {
-          sum += gravity_per_unit_mass_subtree_to_position(config, tree,
-                                                           *subtree, position);
+    const walk::WalkView<T, Dimension> &tree,
+    const data::Vector<T, Dimension> *positions, std::size_t count,
+    data::Vector<T, Dimension> *accelerations, const T *scales,
+    T *potentials, std::uint64_t *interactions) {
+  constexpr auto LANES = walk::PACKET_SIZE;
+  static_assert(LANES <= 32, "lane masks are 32 bits wide");
+  using Mask = std::uint32_t;
+  struct Entry {
+    std::uint32_t node;
+    Mask lanes;
+  };
+
+  for (std::size_t l = 0; l < count; ++l) {
+    accelerations[l] = {};
+    if (potentials)
+      potentials[l] = 0;
+    if (interactions)
+      interactions[l] = 0;
+  }
+  if (tree.empty() || count == 0)
+    return;
+  const auto *nodes = tree.data();
+  auto soften2 = static_cast<K>(config.soften_length) *
+                 static_cast<K>(config.soften_length);
+  auto G = static_cast<K>(config.G);
+
+  // unused lanes repeat the last position and stay masked
+  T position[Dimension][LANES];
+  T scale[LANES];
+  T sum[Dimension][LANES] = {};
+  T phi[LANES] = {};
+  std::uint32_t hits[LANES] = {};
+  for (std::size_t l = 0; l < LANES; ++l) {
+    for (std::size_t d = 0; d < Dimension; ++d) {
+      position[d][l] = positions[std::min(l, count - 1)][d];
+    }
+    scale[l] = scales ? scales[std::min(l, count - 1)]
+                      : std::numeric_limits<T>::infinity();
+  }
+
+  // sse2 has no shift by a different count per lane, so the lane loops
+  // building and testing masks read the bit of every lane from a table
+  Mask lane_bit[LANES];
+  for (std::size_t l = 0; l < LANES; ++l) {
+    lane_bit[l] = Mask{1} << l;
+  }
+
+  Entry stack[walk::stack_size<Dimension>()];
+  std::size_t top = 0;
+  stack[top++] = {0, count == 32 ? ~Mask{0} : (Mask{1} << count) - 1};
+  while (top != 0) {
+    auto entry = stack[--top];
+    const auto &node = nodes[entry.node];
+
+    T dp[Dimension][LANES];
+    T distance2[LANES] = {};
+    for (std::size_t d = 0; d < Dimension; ++d) {
+#pragma omp simd
+      for (std::size_t l = 0; l < LANES; ++l) {
+        dp[d][l] = node.center_of_mass[d] - position[d][l];
+        distance2[l] += dp[d][l] * dp[d][l];
+      }
+    }
+    Mask open = 0;
+    if (node.children != 0) {
+#pragma omp simd reduction(| : open)
+      for (std::size_t l = 0; l < LANES; ++l) {
+        open |= walk::accepts(node, distance2[l], scale[l]) ? Mask{0}
+                                                             : lane_bit[l];
+      }
+      open &= entry.lanes;
+    }
+    auto accept = entry.lanes & ~open;
+
+    if (accept != 0) {
+      // masked lanes and the position itself get a weight of 0 and divide
+      // by 1 more than r2 instead of being skipped, so the loop is
+      // vectorized, the weights are computed apart or the compiler
+      // branches around the division
+      K active[LANES];
+#pragma omp simd
+      for (std::size_t l = 0; l < LANES; ++l) {
+        active[l] =
+            (accept & lane_bit[l]) != 0 && distance2[l] != 0 ? K{1} : K{0};
+      }
+      K factor[LANES];
+      auto Gm = G * static_cast<K>(node.mass);
+#pragma omp simd
+      for (std::size_t l = 0; l < LANES; ++l) {
+        auto r2 = soften2 + static_cast<K>(distance2[l]);
+        auto safe_r2 = r2 + (1 - active[l]);
+        factor[l] = active[l] * Gm / (safe_r2 * std::sqrt(safe_r2));
+        phi[l] -= static_cast<T>(factor[l] * r2);
+      }
+      for (std::size_t d = 0; d < Dimension; ++d) {
+#pragma omp simd
+        for (std::size_t l = 0; l < LANES; ++l) {
+          sum[d][l] += static_cast<T>(factor[l] * static_cast<K>(dp[d][l]));
         }
       }
-      return sum;
+      for (std::size_t l = 0; l < LANES; ++l) {
+        hits[l] += active[l] != 0;
+      }
+    }
+    if (open != 0) {
+      for (std::uint32_t c = 0; c < node.children; ++c) {
+        stack[top++] = {node.first_child + c, open};
+      }
     }
-  } else {
-    // node is a leaf
-    return gravity_per_unit_mass_position_to_position(
-        config, tree.node(root).center_of_mass, tree.node(root).mass, position);
+  }
+
+  for (std::size_t l = 0; l < count; ++l) {
+    for (std::size_t d = 0; d < Dimension; ++d) {
+      accelerations[l][d] = sum[d][l];
+    }
+    if (potentials)
+      potentials[l] = phi[l];
+    if (interactions)
+      interactions[l] = hits[l];
   }
 }
 
-template <typename T, std::size_t Dimension>
+template <typename T, std::size_t Dimension, typename K>
+data::Vector<T, Dimension> gravity_per_unit_mass_tree_to_position(
+    const config::Configuration<T> &config,
+    const walk::WalkTree<T, Dimension> &tree,
+    const data::Vector<T, Dimension> &position, T scale,
+    std::uint64_t *interactions, T *potential) {
+  return gravity_per_unit_mass_tree_to_position<T, Dimension, K>(
+      config, walk::WalkView<T, Dimension>(tree), position, scale,
+      interactions, potential);
+}
+
+template <typename T, std::size_t Dimension, typename K>
+void gravity_per_unit_mass_tree_to_packet(
+    const config::Configuration<T> &config,
+    const walk::WalkTree<T, Dimension> &tree,
+    const data::Vector<T, Dimension> *positions, std::size_t count,
+    data::Vector<T, Dimension> *accelerations, const T *scales,
+    T *potentials, std::uint64_t *interactions) {
+  gravity_per_unit_mass_tree_to_packet<T, Dimension, K>(
+      config, walk::WalkView<T, Dimension>(tree), positions, count,
+      accelerations, scales, potentials, interactions);
+}
+
+// the displacement is taken in T and converted to K, so only the relative
+// coordinates lose precision, the result is accumulated by the caller in T
+template <typename T, std::size_t Dimension, typename K>
 data::Vector<T, Dimension> gravity_per_unit_mass_position_to_position(
     const config::Configuration<T> &config,
     const data::Vector<T, Dimension> &other_position,
-    data::Scalar<T> other_mass, const data::Vector<T, Dimension> &position) {
-  auto dp = other_position - position;
-  auto distance = data::module_of(dp);
-  if (distance == 0) {
-    return {
-        0,
-        0,
-        0,
-    };
+    data::Scalar<T> other_mass, const data::Vector<T, Dimension> &position,
+    T *potential) {
+  data::Vector<K, Dimension> dp;
+  K distance2 = 0;
+  for (std::size_t d = 0; d < Dimension; ++d) {
+    dp[d] = static_cast<K>(other_position[d] - position[d]);
+    distance2 += dp[d] * dp[d];
+  }
+  if (distance2 == 0) {
+    return {};
   } // singularity
-  auto G = config.G;
-  auto soften = config.soften_length;
-  auto result = G * other_mass /
-                std::pow((soften_length * soften_length + distance * distance),
-                         static_cast<T>(3) / static_cast<T>(2)) *
-                dp;
+  auto soften = static_cast<K>(config.soften_length);
+  auto r2 = soften * soften + distance2;
+  auto factor = static_cast<K>(config.G) * static_cast<K>(other_mass) /
+                (r2 * std::sqrt(r2));
+  if (potential)
+    *potential -= static_cast<T>(factor * r2);
+  data::Vector<T, Dimension> result;
+  for (std::size_t d = 0; d < Dimension; ++d) {
+    result[d] = static_cast<T>(factor * dp[d]);
+  }
   return result;
 }
 
+// relative acceleration error of the mixed precision kernels against the
+// kernels computed in T, measured on evenly spaced local bodies
+template <typename T> struct PrecisionReport {
+  std::size_t samples;
+  T max_relative_error;
+  T rms_relative_error;
+};
+
+template <typename T, std::size_t Dimension>
+PrecisionReport<T>
+precision_report(const config::Configuration<T> &config,
+                 const boost::mpi::communicator &comm,
+                 const data::BodiesView<T, Dimension> &bodies,
+                 std::size_t samples_per_rank) {
+  communication::Division division(comm, bodies.size());
+  auto samples = std::min(samples_per_rank, division.count);
+  T max_error = 0;
+  T sum_squared_error = 0;
+  for (std::size_t k = 0; k < samples; ++k) {
+    auto &target = bodies[division.begin + k * division.count / samples];
+    data::Vector<T, Dimension> reference{};
+    data::Vector<T, Dimension> mixed{};
+    for (const auto &body : bodies) {
+      reference += gravity_per_unit_mass_position_to_position<T, Dimension, T>(
+          config, body.position, body.mass, target.position);
+      mixed += gravity_per_unit_mass_position_to_position<T, Dimension, float>(
+          config, body.position, body.mass, target.position);
+    }
+    auto norm = data::module_of(reference);
+    auto error = norm == 0 ? 0 : data::module_of(mixed - reference) / norm;
+    max_error = std::max(max_error, error);
+    sum_squared_error += error * error;
+  }
+
+  std::size_t total_samples = 0;
+  boost::mpi::all_reduce(comm, samples, total_samples, std::plus<>());
+  boost::mpi::all_reduce(comm, boost::mpi::inplace(max_error),
+                         boost::mpi::maximum<T>());
+  boost::mpi::all_reduce(comm, boost::mpi::inplace(sum_squared_error),
+                         std::plus<>());
+  return {
+      total_samples,
+      max_error,
+      total_samples == 0 ? 0 : std::sqrt(sum_squared_error / total_samples),
+  };
+}
+
 } // namespace n_body::physical
 
 #endif
@@ -0,0 +1,109 @@
+#include "profiling.hpp"
+#include <functional>
+
+namespace n_body::profiling {
+
+const char *name_of(Collective collective) {
+  switch (collective) {
+  case Collective::RootSpace:
+    return "root_space";
+  case Collective::TreeReduce:
+    return "tree_reduce";
+  case Collective::TreeBroadcast:
+    return "tree_broadcast";
+  case Collective::BodiesGather:
+    return "bodies_gather";
+  case Collective::BodiesRing:
+    return "bodies_ring";
+  case Collective::Migration:
+    return "migration";
+  case Collective::EssentialTree:
+    return "essential_tree";
+  case Collective::CostGather:
+    return "cost_gather";
+  default:
+    return "ukn";
+  }
+}
+
+std::ostream &operator<<(std::ostream &os, Collective collective) {
+  return os << name_of(collective);
+}
+
+Recorder &Recorder::instance() {
+  static Recorder recorder;
+  return recorder;
+}
+
+void Recorder::add(Collective collective, const Statistics &statistics) {
+  for (auto *all : {&this->interval, &this->run}) {
+    auto &s = (*all)[static_cast<std::size_t>(collective)];
+    s.calls += statistics.calls;
+    s.messages += statistics.messages;
+    s.raw_bytes += statistics.raw_bytes;
+    s.serialized_bytes += statistics.serialized_bytes;
+    s.serialization_time += statistics.serialization_time;
+    s.wait_time += statistics.wait_time;
+    s.mpi_time += statistics.mpi_time;
+  }
+}
+
+namespace {
+
+Summary reduce(const boost::mpi::communicator &comm, int root,
+               const std::array<Statistics, COLLECTIVES> &local) {
+  constexpr std::size_t COUNTS = 4;
+  constexpr std::size_t TIMES = 3;
+  std::array<std::uint64_t, COUNTS * COLLECTIVES> counts{};
+  std::array<double, TIMES * COLLECTIVES> times{};
+  for (std::size_t i = 0; i < COLLECTIVES; ++i) {
+    counts[COUNTS * i + 0] = local[i].calls;
+    counts[COUNTS * i + 1] = local[i].messages;
+    counts[COUNTS * i + 2] = local[i].raw_bytes;
+    counts[COUNTS * i + 3] = local[i].serialized_bytes;
+    times[TIMES * i + 0] = local[i].serialization_time;
+    times[TIMES * i + 1] = local[i].wait_time;
+    times[TIMES * i + 2] = local[i].mpi_time;
+  }
+
+  Summary summary{};
+  if (comm.rank() == root) {
+    std::array<std::uint64_t, COUNTS * COLLECTIVES> count_sums{};
+    std::array<double, TIMES * COLLECTIVES> time_maxima{};
+    boost::mpi::reduce(comm, counts.data(), counts.size(), count_sums.data(),
+                       std::plus<std::uint64_t>(), root);
+    boost::mpi::reduce(comm, times.data(), times.size(), time_maxima.data(),
+                       boost::mpi::maximum<double>(), root);
+    for (std::size_t i = 0; i < COLLECTIVES; ++i) {
+      // calls are made by every process
+      summary[i].calls = count_sums[COUNTS * i + 0] / comm.size();
+      summary[i].messages = count_sums[COUNTS * i + 1];
+      summary[i].raw_bytes = count_sums[COUNTS * i + 2];
+      summary[i].serialized_bytes = count_sums[COUNTS * i + 3];
+      summary[i].serialization_time = time_maxima[TIMES * i + 0];
+      summary[i].wait_time = time_maxima[TIMES * i + 1];
+      summary[i].mpi_time = time_maxima[TIMES * i + 2];
+    }
+  } else {
+    boost::mpi::reduce(comm, counts.data(), counts.size(),
+                       std::plus<std::uint64_t>(), root);
+    boost::mpi::reduce(comm, times.data(), times.size(),
+                       boost::mpi::maximum<double>(), root);
+  }
+  return summary;
+}
+
+} // namespace
+
+Summary reduce_interval(const boost::mpi::communicator &comm, int root) {
+  auto &recorder = Recorder::instance();
+  auto summary = reduce(comm, root, recorder.interval);
+  recorder.interval.fill(Statistics{});
+  return summary;
+}
+
+Summary reduce_run(const boost::mpi::communicator &comm, int root) {
+  return reduce(comm, root, Recorder::instance().run);
+}
+
+} // namespace n_body::profiling
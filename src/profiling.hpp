@@ -0,0 +1,313 @@
+#ifndef N_BODY_PROFILING_HPP
+#define N_BODY_PROFILING_HPP
+
+#include <array>
+#include <boost/mpi.hpp>
+#include <boost/mpi/packed_iarchive.hpp>
+#include <boost/mpi/packed_oarchive.hpp>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+// collectives which record their message counts, bytes, serialization time,
+// time waiting for the other processes and time spent inside mpi
+// types which are not mpi datatypes are serialized into packed archives
+// explicitly, so the serialization can be told apart from the transfer
+namespace n_body::profiling {
+
+enum class Collective {
+  RootSpace = 0,
+  TreeReduce = 1,
+  TreeBroadcast = 2,
+  BodiesGather = 3,
+  BodiesRing = 4,
+  Migration = 5,
+  EssentialTree = 6,
+  CostGather = 7,
+};
+
+constexpr std::size_t COLLECTIVES = 8;
+
+extern const char *name_of(Collective collective);
+extern std::ostream &operator<<(std::ostream &os, Collective collective);
+
+// everything is counted on the sending side
+struct Statistics {
+  std::uint64_t calls = 0;
+  std::uint64_t messages = 0;
+  // size of the objects in memory
+  std::uint64_t raw_bytes = 0;
+  // size on the wire, equal to raw_bytes for mpi datatypes
+  std::uint64_t serialized_bytes = 0;
+  double serialization_time = 0;
+  // time until the other processes reached the collective, measured by a
+  // barrier before it
+  double wait_time = 0;
+  // time inside the mpi calls of the collective itself
+  double mpi_time = 0;
+};
+
+// statistics of this process, profiling is off until enabled
+// only the main thread may record
+struct Recorder {
+  static Recorder &instance();
+
+  bool enabled = false;
+  // since the last reduce
+  std::array<Statistics, COLLECTIVES> interval{};
+  // since enabled
+  std::array<Statistics, COLLECTIVES> run{};
+
+  void add(Collective collective, const Statistics &statistics);
+};
+
+// counts and bytes are summed over processes, times are the maximum over
+// processes
+using Summary = std::array<Statistics, COLLECTIVES>;
+
+// reduce the statistics since the last call to root and reset them
+extern Summary reduce_interval(const boost::mpi::communicator &comm,
+                               int root);
+// reduce the statistics of the whole run to root
+extern Summary reduce_run(const boost::mpi::communicator &comm, int root);
+
+namespace detail {
+
+// the barrier is only entered while recording, which is enabled on all
+// processes alike, so an unprofiled run does not synchronize more
+inline void wait_for_all(const boost::mpi::communicator &comm,
+                         Statistics &statistics) {
+  if (!Recorder::instance().enabled)
+    return;
+  auto start = MPI_Wtime();
+  MPI_Barrier(comm);
+  statistics.wait_time = MPI_Wtime() - start;
+}
+
+template <typename T>
+void pack(boost::mpi::packed_oarchive &archive, const T *values, int n) {
+  for (int i = 0; i < n; ++i)
+    archive << values[i];
+}
+
+} // namespace detail
+
+template <typename T>
+void all_gather(const boost::mpi::communicator &comm, Collective collective,
+                const T *in_values, int n, std::vector<T> &out_values) {
+  auto &recorder = Recorder::instance();
+  Statistics statistics;
+  statistics.calls = 1;
+  statistics.messages = comm.size() - 1;
+  statistics.raw_bytes = static_cast<std::uint64_t>(n) * sizeof(T);
+  detail::wait_for_all(comm, statistics);
+
+  if constexpr (boost::mpi::is_mpi_datatype<T>::value) {
+    auto start = MPI_Wtime();
+    boost::mpi::all_gather(comm, in_values, n, out_values);
+    statistics.mpi_time = MPI_Wtime() - start;
+    statistics.serialized_bytes = statistics.raw_bytes;
+  } else {
+    auto start = MPI_Wtime();
+    boost::mpi::packed_oarchive out_archive(comm);
+    detail::pack(out_archive, in_values, n);
+    int size = static_cast<int>(out_archive.size());
+    auto packed = MPI_Wtime();
+
+    std::vector<int> sizes(comm.size());
+    MPI_Allgather(&size, 1, MPI_INT, sizes.data(), 1, MPI_INT, comm);
+    std::vector<int> displacements(comm.size());
+    int total = 0;
+    for (int r = 0; r < comm.size(); ++r) {
+      displacements[r] = total;
+      total += sizes[r];
+    }
+    std::vector<char> buffer(total);
+    MPI_Allgatherv(out_archive.address(), size, MPI_PACKED, buffer.data(),
+                   sizes.data(), displacements.data(), MPI_PACKED, comm);
+    auto transferred = MPI_Wtime();
+
+    out_values.resize(static_cast<std::size_t>(n) * comm.size());
+    for (int r = 0; r < comm.size(); ++r) {
+      boost::mpi::packed_iarchive in_archive(comm, sizes[r]);
+      in_archive.resize(sizes[r]);
+      std::memcpy(in_archive.address(), buffer.data() + displacements[r],
+                  sizes[r]);
+      for (int i = 0; i < n; ++i)
+        in_archive >> out_values[static_cast<std::size_t>(r) * n + i];
+    }
+
+    statistics.serialized_bytes = size;
+    statistics.serialization_time =
+        (packed - start) + (MPI_Wtime() - transferred);
+    statistics.mpi_time = transferred - packed;
+  }
+  if (recorder.enabled)
+    recorder.add(collective, statistics);
+}
+
+// gather vectors of different lengths, `counts` receives the length of
+// every process
+template <typename T>
+void all_gatherv(const boost::mpi::communicator &comm, Collective collective,
+                 const std::vector<T> &in_values, std::vector<T> &out_values,
+                 std::vector<int> &counts) {
+  static_assert(boost::mpi::is_mpi_datatype<T>::value,
+                "all_gatherv sends raw buffers only");
+  auto &recorder = Recorder::instance();
+  Statistics statistics;
+  statistics.calls = 1;
+  statistics.messages = comm.size() - 1;
+  statistics.raw_bytes = statistics.serialized_bytes =
+      in_values.size() * sizeof(T);
+  detail::wait_for_all(comm, statistics);
+
+  auto start = MPI_Wtime();
+  int count = static_cast<int>(in_values.size());
+  counts.resize(comm.size());
+  MPI_Allgather(&count, 1, MPI_INT, counts.data(), 1, MPI_INT, comm);
+  std::vector<int> displacements(comm.size());
+  int total = 0;
+  for (int r = 0; r < comm.size(); ++r) {
+    displacements[r] = total;
+    total += counts[r];
+  }
+  out_values.resize(total);
+  auto type = boost::mpi::get_mpi_datatype<T>(T{});
+  MPI_Allgatherv(in_values.data(), count, type, out_values.data(),
+                 counts.data(), displacements.data(), type, comm);
+  statistics.mpi_time = MPI_Wtime() - start;
+
+  if (recorder.enabled)
+    recorder.add(collective, statistics);
+}
+
+// every process already holds its own block of `values`, block r is
+// [displacements[r], displacements[r] + counts[r]) and is received from
+// process r
+template <typename T>
+void all_gatherv_in_place(const boost::mpi::communicator &comm,
+                          Collective collective, T *values,
+                          const std::vector<int> &counts,
+                          const std::vector<int> &displacements) {
+  static_assert(boost::mpi::is_mpi_datatype<T>::value,
+                "all_gatherv_in_place sends raw buffers only");
+  auto &recorder = Recorder::instance();
+  Statistics statistics;
+  statistics.calls = 1;
+  statistics.messages = comm.size() - 1;
+  statistics.raw_bytes = statistics.serialized_bytes =
+      static_cast<std::uint64_t>(counts[comm.rank()]) * sizeof(T);
+  detail::wait_for_all(comm, statistics);
+
+  auto start = MPI_Wtime();
+  auto type = boost::mpi::get_mpi_datatype<T>(T{});
+  MPI_Allgatherv(MPI_IN_PLACE, 0, MPI_DATATYPE_NULL, values, counts.data(),
+                 displacements.data(), type, comm);
+  statistics.mpi_time = MPI_Wtime() - start;
+
+  if (recorder.enabled)
+    recorder.add(collective, statistics);
+}
+
+template <typename T, typename Op>
+void all_reduce(const boost::mpi::communicator &comm, Collective collective,
+                T &value, Op op) {
+  static_assert(boost::mpi::is_mpi_datatype<T>::value,
+                "all_reduce sends raw buffers only");
+  auto &recorder = Recorder::instance();
+  Statistics statistics;
+  statistics.calls = 1;
+  statistics.messages = comm.size() - 1;
+  statistics.raw_bytes = statistics.serialized_bytes = sizeof(T);
+  detail::wait_for_all(comm, statistics);
+
+  auto start = MPI_Wtime();
+  boost::mpi::all_reduce(comm, boost::mpi::inplace(value), op);
+  statistics.mpi_time = MPI_Wtime() - start;
+
+  if (recorder.enabled)
+    recorder.add(collective, statistics);
+}
+
+// merge the vectors of all processes into `values` of rank 0 along a
+// binomial tree, a process holds the merge of the ranks [rank, rank + mask)
+// before each round, so there are log P rounds and the merges of a round run
+// in parallel
+// `op(a, b)` returns the merge of `b`, which belongs to higher ranks, into `a`
+// `values` is unspecified on the other ranks afterwards
+template <typename T, typename Op>
+void reduce(const boost::mpi::communicator &comm, Collective collective,
+            std::vector<T> &values, Op op) {
+  static_assert(boost::mpi::is_mpi_datatype<T>::value,
+                "reduce sends raw buffers only");
+  constexpr int TAG = 0;
+  auto &recorder = Recorder::instance();
+  Statistics statistics;
+  statistics.calls = 1;
+  detail::wait_for_all(comm, statistics);
+
+  auto type = boost::mpi::get_mpi_datatype<T>(T{});
+  auto rank = comm.rank();
+  for (int mask = 1; mask < comm.size(); mask <<= 1) {
+    if ((rank & mask) != 0) {
+      auto start = MPI_Wtime();
+      MPI_Send(values.data(), static_cast<int>(values.size()), type,
+               rank - mask, TAG, comm);
+      statistics.mpi_time += MPI_Wtime() - start;
+      statistics.messages += 1;
+      statistics.raw_bytes += values.size() * sizeof(T);
+      break;
+    }
+    if (rank + mask < comm.size()) {
+      auto start = MPI_Wtime();
+      MPI_Status status;
+      MPI_Probe(rank + mask, TAG, comm, &status);
+      int count = 0;
+      MPI_Get_count(&status, type, &count);
+      std::vector<T> other(count);
+      MPI_Recv(other.data(), count, type, rank + mask, TAG, comm,
+               MPI_STATUS_IGNORE);
+      statistics.mpi_time += MPI_Wtime() - start;
+      values = op(values, other);
+    }
+  }
+  statistics.serialized_bytes = statistics.raw_bytes;
+
+  if (recorder.enabled)
+    recorder.add(collective, statistics);
+}
+
+// `values` of `root` are copied to all processes
+template <typename T>
+void broadcast(const boost::mpi::communicator &comm, Collective collective,
+               std::vector<T> &values, int root) {
+  static_assert(boost::mpi::is_mpi_datatype<T>::value,
+                "broadcast sends raw buffers only");
+  auto &recorder = Recorder::instance();
+  Statistics statistics;
+  statistics.calls = 1;
+  if (comm.rank() == root) {
+    statistics.messages = comm.size() - 1;
+    statistics.raw_bytes = statistics.serialized_bytes =
+        values.size() * sizeof(T);
+  }
+  detail::wait_for_all(comm, statistics);
+
+  auto start = MPI_Wtime();
+  auto size = static_cast<std::uint64_t>(values.size());
+  MPI_Bcast(&size, 1, MPI_UINT64_T, root, comm);
+  values.resize(size);
+  auto type = boost::mpi::get_mpi_datatype<T>(T{});
+  MPI_Bcast(values.data(), static_cast<int>(size), type, root, comm);
+  statistics.mpi_time = MPI_Wtime() - start;
+
+  if (recorder.enabled)
+    recorder.add(collective, statistics);
+}
+
+} // namespace n_body::profiling
+
+#endif
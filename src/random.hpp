@@ -1,89 +1,143 @@
 #ifndef N_BODY_RANDOM_HPP
 #define N_BODY_RANDOM_HPP
 
-#include <boost/mpi/collectives.hpp>
-#include <boost/mpi/communicator.hpp>
+#include <array>
+#include <cstddef>
 #include <cstdint>
-#include <memory>
+#include <limits>
 #include <random>
 
 namespace n_body::random {
 
-template <typename UIntType, UIntType m> class Engine;
+// Philox4x32-10 counter based generator (Salmon et al., SC'11)
+// the output is a pure function of (counter, key), so any element of a
+// random sequence can be computed directly without generating the ones
+// before it
+struct Philox {
+  using counter_type = std::array<std::uint32_t, 4>;
+  using key_type = std::array<std::uint32_t, 2>;
+
+  static constexpr std::uint32_t M0 = 0xD2511F53;
+  static constexpr std::uint32_t M1 = 0xCD9E8D57;
+  static constexpr std::uint32_t W0 = 0x9E3779B9;
+  static constexpr std::uint32_t W1 = 0xBB67AE85;
+  static constexpr int ROUNDS = 10;
+
+  static counter_type generate(counter_type counter, key_type key) {
+    for (int round = 0; round < ROUNDS; ++round) {
+      auto p0 = static_cast<std::uint64_t>(M0) * counter[0];
+      auto p1 = static_cast<std::uint64_t>(M1) * counter[2];
+      counter = {
+          static_cast<std::uint32_t>(p1 >> 32u) ^ counter[1] ^ key[0],
+          static_cast<std::uint32_t>(p1),
+          static_cast<std::uint32_t>(p0 >> 32u) ^ counter[3] ^ key[1],
+          static_cast<std::uint32_t>(p0),
+      };
+      key[0] += W0;
+      key[1] += W1;
+    }
+    return counter;
+  }
+};
 
-using MinimunStandardEngine = Engine<std::uint_fast32_t, 2147483647>;
+// random streams are identified by (seed, stream, index)
+// use one stream per kind of quantity and the body index as index, then the
+// numbers of a body do not depend on how bodies are distributed over ranks
+struct Key {
+  std::uint64_t seed;
+  std::uint32_t stream;
+};
 
-// random engine for parallel random number generating
-// the engine must be construct at the same time on all mpi process
-template <typename UIntType, UIntType m> class Engine {
-public:
-  using result_type = UIntType;
-
-  Engine(const boost::mpi::communicator &comm, int root, UIntType seed) {
-    const UIntType origin_a = 48271;
-    const UIntType origin_c = 0;
-
-    const int size = comm.size();
-
-    if (comm.rank() == root) {
-      std::vector<UIntType> xs;
-      xs.reserve(size);
-      xs.push_back(seed);
-      this->a = 1;
-      this->c = 0;
-
-      for (int i = 0; i < size; ++i) {
-        if (i != 0)
-          xs.push_back(run(origin_a, origin_c, xs[i - 1]));
-        this->c += this->a;
-        this->c %= m;
-        this->a *= origin_a;
-        this->a %= m;
-      }
-      this->c *= origin_c;
-
-      boost::mpi::scatter(comm, xs, this->current, root);
-    } else {
-      boost::mpi::scatter(comm, this->current, root);
-    }
-    boost::mpi::broadcast(comm, this->a, root);
-    boost::mpi::broadcast(comm, this->c, root);
+namespace detail {
+
+inline Philox::key_type key_of(std::uint64_t seed) {
+  return {static_cast<std::uint32_t>(seed),
+          static_cast<std::uint32_t>(seed >> 32u)};
+}
+
+inline Philox::counter_type counter_of(const Key &key, std::uint64_t index,
+                                       std::uint32_t draw) {
+  return {static_cast<std::uint32_t>(index),
+          static_cast<std::uint32_t>(index >> 32u), key.stream, draw};
+}
+
+// map random bits to [0, 1)
+template <typename T> T to_unit(std::uint32_t low, std::uint32_t high) {
+  if constexpr (std::numeric_limits<T>::digits <= 32) {
+    return static_cast<T>(high >> 8u) * static_cast<T>(1.0 / (1u << 24u));
+  } else {
+    auto bits = (static_cast<std::uint64_t>(high) << 21u) ^ (low >> 11u);
+    return static_cast<T>(bits) * static_cast<T>(1.0 / (1ull << 53u));
   }
+}
 
-  Engine(const boost::mpi::communicator &comm, int root)
-      : Engine(comm, root, new_seed_in_root(comm, root)) {}
+} // namespace detail
 
-  static constexpr result_type min() { return 1; }
+// uniform random bit generator positioned at one index of a stream
+// it can be used with the standard distributions, for quantities needing a
+// varying number of draws
+class CounterEngine {
+public:
+  using result_type = std::uint32_t;
 
-  static constexpr result_type max() { return m - 1; }
+  CounterEngine(const Key &key, std::uint64_t index)
+      : key(key), philox_key(detail::key_of(key.seed)), index(index) {}
 
-  result_type operator()() {
-    this->current = run(this->a, this->c, this->current);
-    return this->current;
+  static constexpr result_type min() { return 0; }
+
+  static constexpr result_type max() {
+    return std::numeric_limits<result_type>::max();
   }
 
-private:
-  static UIntType new_seed_in_root(const boost::mpi::communicator &comm,
-                                   int root) {
-    if (comm.rank() == root) {
-      std::random_device rd;
-      std::uniform_int_distribution<UIntType> dist(min(), max());
-      return dist(rd);
-    } else {
-      return 0;
+  result_type operator()() {
+    if (this->used == this->buffer.size()) {
+      this->buffer = Philox::generate(
+          detail::counter_of(this->key, this->index, this->block),
+          this->philox_key);
+      ++this->block;
+      this->used = 0;
     }
+    return this->buffer[this->used++];
   }
 
-  UIntType run(UIntType pa, UIntType pc, UIntType x) {
-    return (pa * x + pc) % m;
+  // jump to another index in O(1)
+  void seek(std::uint64_t new_index) {
+    this->index = new_index;
+    this->block = 0;
+    this->used = this->buffer.size();
   }
 
-  UIntType a;
-  UIntType c;
-
-  UIntType current;
+private:
+  Key key;
+  Philox::key_type philox_key;
+  std::uint64_t index;
+  std::uint32_t block = 0;
+  Philox::counter_type buffer{};
+  std::size_t used = buffer.size();
 };
 
+// fill out[i] with a uniform number in [min, max) for indices
+// [first, first + count) of the stream
+// iterations are independent, so the loop can be vectorized and any part of
+// the range can be filled by another thread or rank with the same result
+template <typename T>
+void fill_uniform(const Key &key, std::uint64_t first, std::size_t count,
+                  T *out, T min, T max) {
+  const auto philox_key = detail::key_of(key.seed);
+  const auto scale = max - min;
+  for (std::size_t i = 0; i < count; ++i) {
+    auto bits =
+        Philox::generate(detail::counter_of(key, first + i, 0), philox_key);
+    out[i] = min + scale * detail::to_unit<T>(bits[0], bits[1]);
+  }
+}
+
+// a random seed, for runs without one given
+inline std::uint64_t new_seed() {
+  std::random_device rd;
+  return (static_cast<std::uint64_t>(rd()) << 32u) ^ rd();
+}
+
 } // namespace n_body::random
 
-#endif
\ No newline at end of file
+#endif
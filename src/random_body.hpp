@@ -4,38 +4,61 @@
 #include "communication.hpp"
 #include "data.hpp"
 #include "logging.hpp"
+#include "profiling.hpp"
+#include "random.hpp"
 #include <boost/mpi/collectives.hpp>
 #include <cstddef>
-#include <functional>
+#include <cstdint>
+#include <vector>
 
 namespace n_body::random::body {
 
-template <typename T, std::size_t Dimension>
-using BodyGenerator = std::function<data::Body<T, Dimension>(std::size_t)>;
+// streams used for the components of uniform bodies
+// stream d is the position along dimension d
+inline std::uint32_t mass_stream(std::size_t dimension) {
+  return static_cast<std::uint32_t>(dimension);
+}
 
+// generate bodies [first, first + count) with positions uniform in
+// [min, max)^Dimension, zero velocity and mass uniform in
+// [mass_min, mass_max)
+// every component is filled as a whole array, then assembled into bodies
 template <typename T, std::size_t Dimension>
-data::Body<T, Dimension> random_body(BodyGenerator<T, Dimension> &generator) {
-  return generator(0);
+void uniform_bodies(std::uint64_t seed, std::size_t first, std::size_t count,
+                    T min, T max, T mass_min, T mass_max,
+                    data::Bodies<T, Dimension> &bodies) {
+  std::vector<T> component(count);
+  bodies.assign(count, data::Body<T, Dimension>{});
+  for (std::size_t d = 0; d < Dimension; ++d) {
+    fill_uniform(Key{seed, static_cast<std::uint32_t>(d)}, first, count,
+                 component.data(), min, max);
+    for (std::size_t i = 0; i < count; ++i) {
+      bodies[i].position[d] = component[i];
+    }
+  }
+  fill_uniform(Key{seed, mass_stream(Dimension)}, first, count,
+               component.data(), mass_min, mass_max);
+  for (std::size_t i = 0; i < count; ++i) {
+    bodies[i].mass = component[i];
+  }
 }
 
+// generate all uniform bodies, every rank generates its own division and the
+// results are gathered
+// the bodies only depend on the seed, not on the number of ranks
 template <typename T, std::size_t Dimension>
-void random_bodies(const boost::mpi::communicator &comm,
-                   BodyGenerator<T, Dimension> &generator,
-                   data::Bodies<T, Dimension> &bodies, std::size_t number) {
+void uniform_bodies(const boost::mpi::communicator &comm, std::uint64_t seed,
+                    std::size_t number, T min, T max, T mass_min, T mass_max,
+                    data::Bodies<T, Dimension> &bodies) {
   communication::Division division(comm, number);
   data::Bodies<T, Dimension> local_bodies;
+  uniform_bodies(seed, division.begin, division.count, min, max, mass_min,
+                 mass_max, local_bodies);
 
-  // generate all data in local bodies
-  for (std::size_t i = 0; i < division.count; ++i) {
-    local_bodies.push_back(generator(i + division.begin));
-  }
-
-  logging::logger(logging::Level::Debug)
-      << "random_bodies() main task done, about to gather" << std::endl;
-
-  // send and receive all data
-  logging::logger(logging::Level::Debug) << "gathering masses" << std::endl;
-  boost::mpi::all_gather(comm, &local_bodies[0], division.count, bodies);
+  N_BODY_LOG(Debug)
+      << "uniform_bodies() main task done, about to gather" << std::endl;
+  profiling::all_gather(comm, profiling::Collective::BodiesGather,
+                        local_bodies.data(), division.count, bodies);
 }
 
 } // namespace n_body::random::body
@@ -0,0 +1,48 @@
+#include "shared.hpp"
+#include "logging.hpp"
+#include <boost/mpi.hpp>
+#include <iostream>
+#include <vector>
+
+namespace n_body::shared {
+
+Topology::Topology(const boost::mpi::communicator &world) : world(world) {
+  MPI_Comm node_comm;
+  MPI_Comm_split_type(world, MPI_COMM_TYPE_SHARED, world.rank(),
+                      MPI_INFO_NULL, &node_comm);
+  this->node =
+      boost::mpi::communicator(node_comm, boost::mpi::comm_take_ownership);
+
+  // slices of a node are exchanged as one block
+  std::vector<int> world_ranks;
+  boost::mpi::all_gather(this->node, world.rank(), world_ranks);
+  bool consecutive = true;
+  for (int r = 0; r < this->node.size(); ++r) {
+    consecutive = consecutive && world_ranks[r] == world_ranks[0] + r;
+  }
+  if (!consecutive) {
+    logging::logger(logging::Level::Error)
+        << "shared memory needs consecutive ranks on every node, place "
+           "processes by core"
+        << std::endl;
+    world.abort(MPI_ERR_ARG);
+  }
+
+  MPI_Comm leaders_comm;
+  MPI_Comm_split(world, this->is_leader() ? 0 : MPI_UNDEFINED, world.rank(),
+                 &leaders_comm);
+  if (this->is_leader()) {
+    this->leaders = boost::mpi::communicator(leaders_comm,
+                                             boost::mpi::comm_take_ownership);
+    boost::mpi::all_gather(this->leaders, world.rank(),
+                           this->node_first_ranks);
+    boost::mpi::all_gather(this->leaders, this->node.size(),
+                           this->node_sizes);
+  }
+
+  N_BODY_LOG(Debug)
+      << "node rank " << this->node.rank() << " of " << this->node.size()
+      << std::endl;
+}
+
+} // namespace n_body::shared
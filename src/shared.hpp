@@ -0,0 +1,183 @@
+#ifndef N_BODY_SHARED_HPP
+#define N_BODY_SHARED_HPP
+
+#include "profiling.hpp"
+#include <algorithm>
+#include <boost/mpi.hpp>
+#include <cstddef>
+#include <type_traits>
+#include <vector>
+
+// arrays living in one mpi shared memory window per node, so the processes
+// of a node keep a single copy of replicated data
+// processes only write their own slices, writes become visible to the rest
+// of the node after a fence
+namespace n_body::shared {
+
+// the processes of a node must have consecutive ranks
+struct Topology {
+  boost::mpi::communicator world;
+  // processes sharing memory with this one
+  boost::mpi::communicator node;
+  // node rank 0 of every node, ordered by rank in world
+  // invalid on processes which are not leaders
+  boost::mpi::communicator leaders;
+  // first rank in world and number of processes of every node, only known
+  // by leaders
+  std::vector<int> node_first_ranks;
+  std::vector<int> node_sizes;
+
+  explicit Topology(const boost::mpi::communicator &world);
+
+  bool is_leader() const { return this->node.rank() == 0; }
+};
+
+// trivially copyable values allocated in the memory of the node leader
+// resize, fence and all_gather are collective over the node
+template <typename T> class SharedArray {
+  static_assert(std::is_trivially_copyable<T>::value,
+                "shared arrays are copied as raw memory");
+
+public:
+  using value_type = T;
+  using iterator = T *;
+  using const_iterator = const T *;
+
+  explicit SharedArray(const Topology &topology, std::size_t size = 0)
+      : topology(topology) {
+    this->resize(size);
+  }
+
+  SharedArray(const SharedArray &) = delete;
+  SharedArray &operator=(const SharedArray &) = delete;
+
+  ~SharedArray() { this->release(this->window); }
+
+  // values up to the smaller size are kept, the storage grows
+  // geometrically so arrays changing size every step are rarely reallocated
+  void resize(std::size_t new_size) {
+    if (new_size > this->capacity) {
+      auto new_capacity = std::max(new_size, this->capacity * 3 / 2);
+      MPI_Win new_window = MPI_WIN_NULL;
+      T *new_values = this->allocate(new_capacity, new_window);
+      if (this->topology.is_leader()) {
+        std::copy(this->values, this->values + this->count, new_values);
+      }
+      // the old window must not be freed before the copy is done
+      this->topology.node.barrier();
+      this->release(this->window);
+      this->window = new_window;
+      this->values = new_values;
+      this->capacity = new_capacity;
+    }
+    this->count = new_size;
+    this->fence();
+  }
+
+  // make the writes of every process of the node visible to the others
+  void fence() {
+    if (this->window != MPI_WIN_NULL)
+      MPI_Win_sync(this->window);
+    this->topology.node.barrier();
+    if (this->window != MPI_WIN_NULL)
+      MPI_Win_sync(this->window);
+  }
+
+  // every process of world writes `count` values at rank * count, then the
+  // leaders exchange the slices of their nodes
+  void all_gather(profiling::Collective collective, const T *slice,
+                  std::size_t slice_count) {
+    // nobody reads the previous values any more
+    this->fence();
+    std::copy(slice, slice + slice_count,
+              this->values + this->topology.world.rank() * slice_count);
+    this->fence();
+    if (this->topology.is_leader()) {
+      const auto &first_ranks = this->topology.node_first_ranks;
+      const auto &sizes = this->topology.node_sizes;
+      std::vector<int> counts(sizes.size());
+      std::vector<int> displacements(sizes.size());
+      for (std::size_t n = 0; n < sizes.size(); ++n) {
+        counts[n] = static_cast<int>(sizes[n] * slice_count);
+        displacements[n] = static_cast<int>(first_ranks[n] * slice_count);
+      }
+      profiling::all_gatherv_in_place(this->topology.leaders, collective,
+                                      this->values, counts, displacements);
+    }
+    this->fence();
+  }
+
+  // like all_gather with slices of different sizes, the slice of process r
+  // is [offsets[r], offsets[r + 1])
+  void all_gather(profiling::Collective collective, const T *slice,
+                  const std::vector<std::size_t> &offsets) {
+    const auto rank = this->topology.world.rank();
+    this->fence();
+    std::copy(slice, slice + (offsets[rank + 1] - offsets[rank]),
+              this->values + offsets[rank]);
+    this->fence();
+    if (this->topology.is_leader()) {
+      const auto &first_ranks = this->topology.node_first_ranks;
+      const auto &sizes = this->topology.node_sizes;
+      std::vector<int> counts(sizes.size());
+      std::vector<int> displacements(sizes.size());
+      for (std::size_t n = 0; n < sizes.size(); ++n) {
+        auto first = offsets[first_ranks[n]];
+        counts[n] =
+            static_cast<int>(offsets[first_ranks[n] + sizes[n]] - first);
+        displacements[n] = static_cast<int>(first);
+      }
+      profiling::all_gatherv_in_place(this->topology.leaders, collective,
+                                      this->values, counts, displacements);
+    }
+    this->fence();
+  }
+
+  T *data() { return this->values; }
+  const T *data() const { return this->values; }
+  std::size_t size() const { return this->count; }
+  bool empty() const { return this->count == 0; }
+  iterator begin() { return this->values; }
+  iterator end() { return this->values + this->count; }
+  const_iterator begin() const { return this->values; }
+  const_iterator end() const { return this->values + this->count; }
+  T &operator[](std::size_t i) { return this->values[i]; }
+  const T &operator[](std::size_t i) const { return this->values[i]; }
+
+private:
+  // only the leader allocates memory, the others map its segment
+  T *allocate(std::size_t size, MPI_Win &new_window) const {
+    T *base = nullptr;
+    auto bytes = this->topology.is_leader()
+                     ? static_cast<MPI_Aint>(size * sizeof(T))
+                     : MPI_Aint{0};
+    MPI_Win_allocate_shared(bytes, sizeof(T), MPI_INFO_NULL,
+                            this->topology.node, &base, &new_window);
+    if (!this->topology.is_leader()) {
+      MPI_Aint leader_bytes = 0;
+      int unit = 0;
+      MPI_Win_shared_query(new_window, 0, &leader_bytes, &unit, &base);
+    }
+    // passive target epoch for the whole lifetime, processes synchronize
+    // with MPI_Win_sync and barriers
+    MPI_Win_lock_all(MPI_MODE_NOCHECK, new_window);
+    return base;
+  }
+
+  static void release(MPI_Win &old_window) {
+    if (old_window == MPI_WIN_NULL)
+      return;
+    MPI_Win_unlock_all(old_window);
+    MPI_Win_free(&old_window);
+  }
+
+  const Topology &topology;
+  MPI_Win window = MPI_WIN_NULL;
+  T *values = nullptr;
+  std::size_t count = 0;
+  std::size_t capacity = 0;
+};
+
+} // namespace n_body::shared
+
+#endif
@@ -4,6 +4,7 @@
 #include "communication.hpp"
 #include "data.hpp"
 #include "logging.hpp"
+#include "profiling.hpp"
 #include <algorithm>
 #include <boost/mpi.hpp>
 #include <cstddef>
@@ -12,8 +13,9 @@
 namespace n_body::space {
 
 template <typename T, std::size_t Dimension>
-data::Space<T, Dimension> root_space(const boost::mpi::communicator &comm,
-                                     const data::Bodies<T, Dimension> &bodies) {
+data::Space<T, Dimension>
+root_space(const boost::mpi::communicator &comm,
+           const data::BodiesView<T, Dimension> &bodies) {
   communication::Division division(comm, bodies.size());
 
   T min = std::numeric_limits<T>::max();
@@ -29,10 +31,10 @@ data::Space<T, Dimension> root_space(const boost::mpi::communicator &comm,
   }
 
   for (std::size_t d = 0; d < Dimension; ++d) {
-    boost::mpi::all_reduce(comm, boost::mpi::inplace(min),
-                           boost::mpi::minimum<T>());
-    boost::mpi::all_reduce(comm, boost::mpi::inplace(max),
-                           boost::mpi::maximum<T>());
+    profiling::all_reduce(comm, profiling::Collective::RootSpace, min,
+                          boost::mpi::minimum<T>());
+    profiling::all_reduce(comm, profiling::Collective::RootSpace, max,
+                          boost::mpi::maximum<T>());
   }
   data::Space<T, Dimension> space{};
   for (std::size_t d = 0; d < Dimension; ++d) {
@@ -43,6 +45,12 @@ data::Space<T, Dimension> root_space(const boost::mpi::communicator &comm,
   return space;
 }
 
+template <typename T, std::size_t Dimension>
+data::Space<T, Dimension> root_space(const boost::mpi::communicator &comm,
+                                     const data::Bodies<T, Dimension> &bodies) {
+  return root_space(comm, data::BodiesView<T, Dimension>(bodies));
+}
+
 // TODO infer T and Dimension
 template <typename T, std::size_t Dimension, typename Iter>
 data::Space<T, Dimension> root_space(Iter first, Iter last) {
@@ -123,8 +131,9 @@ std::size_t part_of_space(const data::Space<T, Dimension> &space,
   return result;
 }
 
+// spaces are cubes, the edge along any dimension is the size
 template <typename T, std::size_t Dimension>
-std::size_t size_of_space(const data::Space<T, Dimension> &space) {
+T size_of_space(const data::Space<T, Dimension> &space) {
   return space.max[0] - space.min[0];
 }
 
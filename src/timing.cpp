@@ -0,0 +1,65 @@
+#include "timing.hpp"
+#include <functional>
+
+namespace n_body::timing {
+
+const char *name_of(Phase phase) {
+  switch (phase) {
+  case Phase::RootSpace:
+    return "root_space";
+  case Phase::TreeBuild:
+    return "tree_build";
+  case Phase::TreeMerge:
+    return "tree_merge";
+  case Phase::Force:
+    return "force";
+  case Phase::Gather:
+    return "gather";
+  case Phase::Output:
+    return "output";
+  case Phase::Migrate:
+    return "migrate";
+  case Phase::Reorder:
+    return "reorder";
+  default:
+    return "ukn";
+  }
+}
+
+std::ostream &operator<<(std::ostream &os, Phase phase) {
+  return os << name_of(phase);
+}
+
+Recorder &Recorder::instance() {
+  static Recorder recorder;
+  return recorder;
+}
+
+Summary reduce(const boost::mpi::communicator &comm, int root) {
+  auto &recorder = Recorder::instance();
+  Summary summary{};
+  std::array<double, PHASES> sum{};
+  if (comm.rank() == root) {
+    boost::mpi::reduce(comm, recorder.elapsed.data(), PHASES,
+                       summary.min.data(), boost::mpi::minimum<double>(),
+                       root);
+    boost::mpi::reduce(comm, recorder.elapsed.data(), PHASES,
+                       summary.max.data(), boost::mpi::maximum<double>(),
+                       root);
+    boost::mpi::reduce(comm, recorder.elapsed.data(), PHASES, sum.data(),
+                       std::plus<double>(), root);
+    for (std::size_t i = 0; i < PHASES; ++i)
+      summary.avg[i] = sum[i] / comm.size();
+  } else {
+    boost::mpi::reduce(comm, recorder.elapsed.data(), PHASES,
+                       boost::mpi::minimum<double>(), root);
+    boost::mpi::reduce(comm, recorder.elapsed.data(), PHASES,
+                       boost::mpi::maximum<double>(), root);
+    boost::mpi::reduce(comm, recorder.elapsed.data(), PHASES, std::plus<double>(),
+                       root);
+  }
+  recorder.reset();
+  return summary;
+}
+
+} // namespace n_body::timing
@@ -0,0 +1,82 @@
+#ifndef N_BODY_TIMING_HPP
+#define N_BODY_TIMING_HPP
+
+#include "trace.hpp"
+#include <array>
+#include <boost/mpi.hpp>
+#include <cstddef>
+#include <iostream>
+
+namespace n_body::timing {
+
+// phases of a step of the main loop
+enum class Phase {
+  RootSpace = 0,
+  TreeBuild = 1,
+  TreeMerge = 2,
+  Force = 3,
+  Gather = 4,
+  Output = 5,
+  Migrate = 6,
+  Reorder = 7,
+};
+
+constexpr std::size_t PHASES = 8;
+
+extern const char *name_of(Phase phase);
+extern std::ostream &operator<<(std::ostream &os, Phase phase);
+
+// seconds spent in every phase by this process since the last reset
+// timing is off until enabled, then a scope costs two MPI_Wtime calls
+// only the main thread may record
+struct Recorder {
+  static Recorder &instance();
+
+  bool enabled = false;
+  std::array<double, PHASES> elapsed{};
+
+  void reset() { this->elapsed.fill(0); }
+};
+
+// add the lifetime of the scope to a phase, and to the trace if tracing
+class Scope {
+public:
+  explicit Scope(Phase phase) : phase(phase) {
+    if (Recorder::instance().enabled || trace::enabled())
+      this->start = MPI_Wtime();
+  }
+
+  Scope(const Scope &) = delete;
+  Scope &operator=(const Scope &) = delete;
+
+  ~Scope() {
+    auto &recorder = Recorder::instance();
+    if (!recorder.enabled && !trace::enabled())
+      return;
+    auto end = MPI_Wtime();
+    if (recorder.enabled)
+      recorder.elapsed[static_cast<std::size_t>(this->phase)] +=
+          end - this->start;
+    if (trace::enabled())
+      trace::record(name_of(this->phase), this->start, end);
+  }
+
+private:
+  Phase phase;
+  double start = 0;
+};
+
+// phase times over all processes
+struct Summary {
+  std::array<double, PHASES> min;
+  std::array<double, PHASES> avg;
+  std::array<double, PHASES> max;
+};
+
+// reduce the recorded times to root and reset them, the result is only
+// meaningful in root
+extern Summary reduce(const boost::mpi::communicator &comm, int root);
+
+} // namespace n_body::timing
+
+#endif
@@ -0,0 +1,108 @@
+#include "trace.hpp"
+#include "logging.hpp"
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <memory>
+#include <mutex>
+
+namespace n_body::trace {
+
+namespace {
+
+std::atomic<bool> tracing{false};
+std::atomic<std::uint64_t> current_step{0};
+double origin = 0;
+// steady clock at the origin, for now()
+std::chrono::steady_clock::time_point steady_origin;
+std::size_t buffer_capacity = 0;
+
+// buffers are only registered once per thread
+std::mutex registry_mutex;
+std::vector<std::unique_ptr<Buffer>> registry;
+
+Buffer &local_buffer() {
+  thread_local Buffer *buffer = nullptr;
+  if (buffer == nullptr) {
+    std::lock_guard<std::mutex> lock(registry_mutex);
+    registry.push_back(
+        std::make_unique<Buffer>(buffer_capacity, registry.size()));
+    buffer = registry.back().get();
+  }
+  return *buffer;
+}
+
+} // namespace
+
+std::vector<Event> Buffer::snapshot(std::uint64_t &dropped) const {
+  auto head = this->head.load(std::memory_order_acquire);
+  auto capacity = this->events.size();
+  auto count = std::min<std::uint64_t>(head, capacity);
+  dropped = head - count;
+  std::vector<Event> result;
+  result.reserve(count);
+  for (auto i = head - count; i < head; ++i) {
+    result.push_back(this->events[i % capacity]);
+  }
+  return result;
+}
+
+void enable(const boost::mpi::communicator &comm, std::size_t capacity) {
+  buffer_capacity = capacity;
+  // the enabling thread is thread 0
+  local_buffer();
+  comm.barrier();
+  origin = MPI_Wtime();
+  steady_origin = std::chrono::steady_clock::now();
+  tracing.store(true, std::memory_order_release);
+}
+
+double now() {
+  std::chrono::duration<double> since =
+      std::chrono::steady_clock::now() - steady_origin;
+  return origin + since.count();
+}
+
+bool enabled() { return tracing.load(std::memory_order_relaxed); }
+
+void set_step(std::uint64_t step) {
+  current_step.store(step, std::memory_order_relaxed);
+}
+
+void record(const char *name, double begin, double end, std::uint64_t bytes) {
+  local_buffer().push(Event{name, begin, end,
+                            current_step.load(std::memory_order_relaxed),
+                            bytes});
+}
+
+void write(const std::filesystem::path &path, int rank) {
+  std::ofstream os(path);
+  os << "[\n";
+  bool first = true;
+  std::lock_guard<std::mutex> lock(registry_mutex);
+  for (const auto &buffer : registry) {
+    std::uint64_t dropped = 0;
+    auto events = buffer->snapshot(dropped);
+    if (dropped != 0) {
+      logging::logger(logging::Level::Warn)
+          << "trace buffer of thread " << buffer->thread_index()
+          << " overflowed, " << dropped << " oldest events dropped"
+          << std::endl;
+    }
+    for (const auto &event : events) {
+      if (!first)
+        os << ",\n";
+      first = false;
+      // timestamps are in microseconds
+      os << "{\"name\":\"" << event.name << "\",\"ph\":\"X\",\"ts\":"
+         << std::fixed << (event.begin - origin) * 1e6
+         << ",\"dur\":" << (event.end - event.begin) * 1e6
+         << ",\"pid\":" << rank << ",\"tid\":" << buffer->thread_index()
+         << ",\"args\":{\"step\":" << event.step
+         << ",\"bytes\":" << event.bytes << "}}";
+    }
+  }
+  os << "\n]\n";
+}
+
+} // namespace n_body::trace
@@ -0,0 +1,95 @@
+#ifndef N_BODY_TRACE_HPP
+#define N_BODY_TRACE_HPP
+
+#include <atomic>
+#include <boost/mpi.hpp>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <vector>
+
+// timeline of begin/end events in the chrome trace format
+// every thread records into its own ring buffer without locking, when a
+// buffer is full the oldest events are overwritten
+namespace n_body::trace {
+
+struct Event {
+  // must point to a string literal
+  const char *name;
+  double begin;
+  double end;
+  std::uint64_t step;
+  std::uint64_t bytes;
+};
+
+// single producer ring buffer, read only after the producer is done
+class Buffer {
+public:
+  Buffer(std::size_t capacity, std::size_t thread)
+      : events(capacity), thread(thread) {}
+
+  void push(const Event &event) {
+    auto head = this->head.load(std::memory_order_relaxed);
+    this->events[head % this->events.size()] = event;
+    this->head.store(head + 1, std::memory_order_release);
+  }
+
+  // events in recording order and the number of overwritten events
+  std::vector<Event> snapshot(std::uint64_t &dropped) const;
+
+  std::size_t thread_index() const { return this->thread; }
+
+private:
+  std::vector<Event> events;
+  std::size_t thread;
+  std::atomic<std::uint64_t> head{0};
+};
+
+// tracing is off until enabled
+// enabling synchronizes the ranks, so their timelines share an origin
+// `capacity` is the number of events per thread and must not be 0
+extern void enable(const boost::mpi::communicator &comm,
+                   std::size_t capacity);
+extern bool enabled();
+
+// step attached to events recorded from now on, by any thread
+extern void set_step(std::uint64_t step);
+
+extern void record(const char *name, double begin, double end,
+                   std::uint64_t bytes = 0);
+
+// seconds on the MPI_Wtime timeline without calling mpi, so any thread may
+// read it, mpi is initialized for calls from the main thread only
+extern double now();
+
+// record the lifetime of the scope, from any thread
+class Span {
+public:
+  explicit Span(const char *name, std::uint64_t bytes = 0)
+      : name(name), bytes(bytes) {
+    if (enabled())
+      this->begin = now();
+  }
+
+  Span(const Span &) = delete;
+  Span &operator=(const Span &) = delete;
+
+  ~Span() {
+    if (enabled())
+      record(this->name, this->begin, now(), this->bytes);
+  }
+
+private:
+  const char *name;
+  std::uint64_t bytes;
+  double begin = 0;
+};
+
+// write the events of all threads of this rank as a chrome trace array,
+// the events of the ranks can be merged with util/merge_traces.sh
+// all recording threads must be done
+extern void write(const std::filesystem::path &path, int rank);
+
+} // namespace n_body::trace
+
+#endif
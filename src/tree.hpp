@@ -4,7 +4,12 @@
 #include "data.hpp"
 #include "logging.hpp"
 #include "overloaded.hpp"
+#include "profiling.hpp"
+#include "shared.hpp"
 #include "space.hpp"
+#include "timing.hpp"
+#include "trace.hpp"
+#include <algorithm>
 #include <array>
 #include <boost/mpi.hpp>
 #include <boost/optional.hpp>
@@ -16,9 +21,12 @@
 #include <boost/variant.hpp>
 #include <cmath>
 #include <cstddef>
+#include <cstdint>
 #include <iostream>
+#include <limits>
 #include <memory>
 #include <tuple>
+#include <utility>
 #include <vector>
 
 namespace n_body::data::tree {
@@ -37,7 +45,7 @@ enum class NodeType {
   Leaf = 1,
 };
 
-std::ostream &operator<<(std::ostream &os, NodeType node_type) {
+inline std::ostream &operator<<(std::ostream &os, NodeType node_type) {
   switch (node_type) {
   case NodeType::Inner:
     return os << "Inner";
@@ -104,12 +112,38 @@ private:
   }
 };
 
+// fixed layout copy of a node, trees are sent as arrays of flat nodes
+// absent children and the body of inner nodes are NONE
+template <typename T, std::size_t Dimension> struct FlatNode {
+  static constexpr std::uint64_t NONE =
+      std::numeric_limits<std::uint64_t>::max();
+
+  Space<T, Dimension> space;
+  Scalar<T> mass;
+  Vector<T, Dimension> center_of_mass;
+  std::array<std::uint64_t, BodyTreeInnerNode<T, Dimension>::CHILDREN_NUMBER>
+      children;
+  std::uint64_t body;
+
+private:
+  /* serialization */
+  friend class boost::serialization::access;
+  template <typename Archive>
+  void serialize(Archive &ar, const unsigned int /* version */) {
+    ar &BOOST_SERIALIZATION_NVP(space);
+    ar &BOOST_SERIALIZATION_NVP(mass);
+    ar &BOOST_SERIALIZATION_NVP(center_of_mass);
+    ar &BOOST_SERIALIZATION_NVP(children);
+    ar &BOOST_SERIALIZATION_NVP(body);
+  }
+};
+
 template <typename T, std::size_t Dimension> struct BodyTree {
   using node_type = BodyTreeNode<T, Dimension>;
   using inner_node_type = typename node_type::inner_node_type;
   using leaf_node_type = typename node_type::leaf_node_type;
 
-  using bodies_type = Bodies<T, Dimension>;
+  using bodies_type = BodiesView<T, Dimension>;
   using space_type = Space<T, Dimension>;
 
   std::vector<node_type> tree;
@@ -128,7 +162,7 @@ template <typename T, std::size_t Dimension> struct BodyTree {
   void push(std::size_t subtree, const bodies_type &bodies, std::size_t body) {
     switch (this->node(subtree).node_type()) {
     case NodeType::Inner: {
-      logging::logger(logging::Level::Trace)
+      N_BODY_LOG(Trace)
           << "push body " << body << " to "
           << "inner node " << subtree << std::endl;
       data::average_position_by_mass_in_place(
@@ -150,7 +184,7 @@ template <typename T, std::size_t Dimension> struct BodyTree {
       break;
     }
     case NodeType::Leaf: {
-      logging::logger(logging::Level::Trace)
+      N_BODY_LOG(Trace)
           << "push body " << body << " to "
           << "leaf node " << subtree << std::endl;
       if (this->node(subtree).center_of_mass == bodies[body].position) {
@@ -183,12 +217,55 @@ template <typename T, std::size_t Dimension> struct BodyTree {
     this->variant_part_of_node(leaf) =
         inner_node; // finally change the leaf into inner
 
-    logging::logger(logging::Level::Trace)
+    N_BODY_LOG(Trace)
         << "expand leaf " << leaf << " to " << new_leaf_node << std::endl;
   }
 
+  std::vector<FlatNode<T, Dimension>> flatten() const {
+    std::vector<FlatNode<T, Dimension>> flat(this->tree.size());
+    for (std::size_t n = 0; n < this->tree.size(); ++n) {
+      auto &f = flat[n];
+      f.space = this->node(n).space;
+      f.mass = this->node(n).mass;
+      f.center_of_mass = this->node(n).center_of_mass;
+      f.children.fill(FlatNode<T, Dimension>::NONE);
+      f.body = FlatNode<T, Dimension>::NONE;
+      if (this->node(n).node_type() == NodeType::Inner) {
+        for (std::size_t i = 0; i < inner_node_type::CHILDREN_NUMBER; ++i) {
+          if (auto child = this->child_of_node(n, i))
+            f.children[i] = *child;
+        }
+      } else {
+        f.body = this->body_of_node(n);
+      }
+    }
+    return flat;
+  }
+
+  static BodyTree<T, Dimension> from_flat(const FlatNode<T, Dimension> *nodes,
+                                          std::size_t count) {
+    BodyTree<T, Dimension> result;
+    result.tree.reserve(count);
+    for (std::size_t n = 0; n < count; ++n) {
+      const auto &f = nodes[n];
+      if (f.body == FlatNode<T, Dimension>::NONE) {
+        inner_node_type inner;
+        for (std::size_t i = 0; i < inner_node_type::CHILDREN_NUMBER; ++i) {
+          if (f.children[i] != FlatNode<T, Dimension>::NONE)
+            inner.children[i] = f.children[i];
+        }
+        result.tree.push_back(
+            node_type{f.space, f.mass, f.center_of_mass, inner});
+      } else {
+        result.tree.push_back(node_type{f.space, f.mass, f.center_of_mass,
+                                        leaf_node_type{f.body}});
+      }
+    }
+    return result;
+  }
+
   void merge_tree(const BodyTree<T, Dimension> &other,
-                  const Bodies<T, Dimension> &bodies) {
+                  const bodies_type &bodies) {
     if (this->tree.empty()) {
       this->tree = other.tree;
     } else if (other.tree.empty()) {
@@ -199,7 +276,7 @@ template <typename T, std::size_t Dimension> struct BodyTree {
   }
 
   void merge_tree(std::size_t root, const BodyTree<T, Dimension> &other,
-                  std::size_t other_root, const Bodies<T, Dimension> &bodies) {
+                  std::size_t other_root, const bodies_type &bodies) {
     if (other.tree[other_root].node_type() == NodeType::Leaf) {
       // if merging a leaf node
       // just push the body into the place and return
@@ -308,7 +385,7 @@ private:
             body, // body
         },
     });
-    logging::logger(logging::Level::Trace)
+    N_BODY_LOG(Trace)
         << "create new leaf node " << new_node << " for body " << body
         << std::endl;
     return new_node;
@@ -340,31 +417,202 @@ BodyTree<T, Dimension> merge_tree(const BodyTree<T, Dimension> &t1,
   return result;
 }
 
-// the root space fo t1 and t2 must be same
+// shape and memory of a merged tree
+// the local fields are filled by build_tree, they are 0 for a tree built in
+// a single process
+struct TreeStatistics {
+  std::uint64_t nodes = 0;
+  std::uint64_t inner = 0;
+  std::uint64_t leaves = 0;
+  // the root is at depth 0
+  std::uint64_t max_depth = 0;
+  double average_depth = 0; // of the leaves
+  // held by the node vector, not counting the unused capacity
+  std::uint64_t bytes = 0;
+  // nodes of the local trees of all processes, and of the largest one
+  std::uint64_t local_nodes = 0;
+  std::uint64_t max_local_nodes = 0;
+  // size of the local trees as flat nodes
+  std::uint64_t serialized_bytes = 0;
+
+  // nodes of the merged tree per node of the local trees, below 1 when the
+  // local trees share their top levels
+  double merge_ratio() const {
+    return local_nodes == 0 ? 0 : static_cast<double>(nodes) / local_nodes;
+  }
+};
+
+template <typename T, std::size_t Dimension>
+TreeStatistics statistics_of(const BodyTree<T, Dimension> &tree) {
+  TreeStatistics result;
+  result.nodes = tree.tree.size();
+  result.bytes = tree.tree.size() * sizeof(BodyTreeNode<T, Dimension>);
+  if (tree.tree.empty())
+    return result;
+  std::uint64_t depth_sum = 0;
+  std::vector<std::pair<std::size_t, std::uint64_t>> stack{{0, 0}};
+  while (!stack.empty()) {
+    auto [node, depth] = stack.back();
+    stack.pop_back();
+    result.max_depth = std::max(result.max_depth, depth);
+    if (tree.node(node).node_type() == NodeType::Leaf) {
+      ++result.leaves;
+      depth_sum += depth;
+      continue;
+    }
+    ++result.inner;
+    constexpr auto CHILDREN = BodyTreeInnerNode<T, Dimension>::CHILDREN_NUMBER;
+    for (std::size_t i = 0; i < CHILDREN; ++i) {
+      if (auto child = tree.child_of_node(node, i))
+        stack.emplace_back(*child, depth + 1);
+    }
+  }
+  result.average_depth = static_cast<double>(depth_sum) / result.leaves;
+  return result;
+}
+
+// merge of the flat trees `t1` and `t2` of the same root space, `t2` belongs
+// to higher ranks
+template <typename T, std::size_t Dimension>
+std::vector<FlatNode<T, Dimension>>
+merge_flat(const std::vector<FlatNode<T, Dimension>> &t1,
+           const std::vector<FlatNode<T, Dimension>> &t2,
+           const BodiesView<T, Dimension> &bodies) {
+  trace::Span span("merge_tree",
+                   (t1.size() + t2.size()) * sizeof(FlatNode<T, Dimension>));
+  auto merged = BodyTree<T, Dimension>::from_flat(t1.data(), t1.size());
+  merged.merge_tree(BodyTree<T, Dimension>::from_flat(t2.data(), t2.size()),
+                    bodies);
+  return merged.flatten();
+}
+
+// fill the local fields of `statistics` with the node counts of the local
+// trees of all processes
+inline void add_local_statistics(const std::vector<std::uint64_t> &counts,
+                                 std::size_t node_size,
+                                 TreeStatistics &statistics) {
+  for (auto count : counts) {
+    statistics.local_nodes += count;
+    statistics.max_local_nodes =
+        std::max<std::uint64_t>(statistics.max_local_nodes, count);
+  }
+  statistics.serialized_bytes = statistics.local_nodes * node_size;
+}
+
+// the local trees are merged pairwise in log P rounds as flat nodes, see
+// profiling::reduce, then the merged tree is broadcast, so all ranks get the
+// same tree
+// `statistics` receives the statistics of the merged tree if not null
 template <typename T, std::size_t Dimension>
 BodyTree<T, Dimension> build_tree(const boost::mpi::communicator &comm,
                                   const Space<T, Dimension> &root_space,
-                                  const Bodies<T, Dimension> &bodies) {
+                                  const BodiesView<T, Dimension> &bodies,
+                                  TreeStatistics *statistics = nullptr) {
   communication::Division division(comm, bodies.size());
 
   BodyTree<T, Dimension> tree;
-  for (auto i = division.begin; i < division.end; ++i) {
-    tree.push(bodies, root_space, i);
+  {
+    timing::Scope scope(timing::Phase::TreeBuild);
+    for (auto i = division.begin; i < division.end; ++i) {
+      tree.push(bodies, root_space, i);
+    }
   }
 
-  // merge local trees
-  logging::logger(logging::Level::Trace)
+  N_BODY_LOG(Trace)
       << "start merging local trees" << std::endl;
-  boost::mpi::all_reduce(comm, boost::mpi::inplace(tree),
-                         [&bodies](const auto &t1, const auto &t2) {
-                           logging::logger(logging::Level::Trace)
-                               << "merge tree " << &t1 << " and " << &t2
-                               << std::endl;
-                           return merge_tree(t1, t2, bodies);
-                         });
-  return tree;
+  timing::Scope scope(timing::Phase::TreeMerge);
+  auto flat = tree.flatten();
+  std::vector<std::uint64_t> counts;
+  if (statistics) {
+    boost::mpi::all_gather(comm, static_cast<std::uint64_t>(flat.size()),
+                           counts);
+  }
+  profiling::reduce(comm, profiling::Collective::TreeReduce, flat,
+                    [&bodies](const auto &t1, const auto &t2) {
+                      return merge_flat(t1, t2, bodies);
+                    });
+  profiling::broadcast(comm, profiling::Collective::TreeBroadcast, flat, 0);
+
+  auto merged = BodyTree<T, Dimension>::from_flat(flat.data(), flat.size());
+  if (statistics) {
+    *statistics = statistics_of(merged);
+    add_local_statistics(counts, sizeof(FlatNode<T, Dimension>), *statistics);
+  }
+  return merged;
+}
+
+template <typename T, std::size_t Dimension>
+BodyTree<T, Dimension> build_tree(const boost::mpi::communicator &comm,
+                                  const Space<T, Dimension> &root_space,
+                                  const Bodies<T, Dimension> &bodies,
+                                  TreeStatistics *statistics = nullptr) {
+  return build_tree(comm, root_space, BodiesView<T, Dimension>(bodies),
+                    statistics);
+}
+
+// build the merged tree once per node instead of once per process
+// the local trees of all processes are merged like in build_tree, the merged
+// tree is broadcast to the leaders only, which write it into `nodes` as flat
+// nodes
+// `statistics` is filled like in build_tree on the leaders only
+template <typename T, std::size_t Dimension>
+void build_shared_tree(const shared::Topology &topology,
+                       const Space<T, Dimension> &root_space,
+                       const BodiesView<T, Dimension> &bodies,
+                       shared::SharedArray<FlatNode<T, Dimension>> &nodes,
+                       TreeStatistics *statistics = nullptr) {
+  communication::Division division(topology.world, bodies.size());
+
+  BodyTree<T, Dimension> tree;
+  {
+    timing::Scope scope(timing::Phase::TreeBuild);
+    for (auto i = division.begin; i < division.end; ++i) {
+      tree.push(bodies, root_space, i);
+    }
+  }
+
+  timing::Scope scope(timing::Phase::TreeMerge);
+  auto flat = tree.flatten();
+  std::vector<std::uint64_t> counts;
+  if (statistics) {
+    boost::mpi::all_gather(topology.world,
+                           static_cast<std::uint64_t>(flat.size()), counts);
+  }
+  profiling::reduce(topology.world, profiling::Collective::TreeReduce, flat,
+                    [&bodies](const auto &t1, const auto &t2) {
+                      return merge_flat(t1, t2, bodies);
+                    });
+
+  // rank 0 of the world is the first leader
+  std::uint64_t merged_size = 0;
+  if (topology.is_leader()) {
+    profiling::broadcast(topology.leaders,
+                         profiling::Collective::TreeBroadcast, flat, 0);
+    merged_size = flat.size();
+    if (statistics) {
+      *statistics = statistics_of(
+          BodyTree<T, Dimension>::from_flat(flat.data(), flat.size()));
+      add_local_statistics(counts, sizeof(FlatNode<T, Dimension>),
+                           *statistics);
+    }
+  }
+
+  boost::mpi::broadcast(topology.node, merged_size, 0);
+  nodes.resize(merged_size);
+  if (topology.is_leader()) {
+    std::copy(flat.begin(), flat.end(), nodes.begin());
+  }
+  nodes.fence();
 }
 
 } // namespace n_body::data::tree
 
+namespace boost::mpi {
+
+template <typename T, std::size_t Dimension>
+struct is_mpi_datatype<n_body::data::tree::FlatNode<T, Dimension>>
+    : public is_mpi_datatype<T> {};
+
+} // namespace boost::mpi
+
 #endif
@@ -0,0 +1,551 @@
+#ifndef N_BODY_WALK_HPP
+#define N_BODY_WALK_HPP
+
+#include "config.hpp"
+#include "data.hpp"
+#include "morton.hpp"
+#include "shared.hpp"
+#include "space.hpp"
+#include "tree.hpp"
+#include <algorithm>
+#include <array>
+#include <boost/mpi.hpp>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+// the tree laid out for the force walk: the children of a node are
+// contiguous and every inner node carries its squared opening radius, so
+// deciding whether to open a node is one compare, the relative criterion
+// adds a second one
+namespace n_body::walk {
+
+template <typename T, std::size_t Dimension> struct WalkNode {
+  data::Vector<T, Dimension> center_of_mass;
+  data::Scalar<T> mass;
+  // the node is accepted as a whole for positions farther than this from
+  // its center of mass
+  data::Scalar<T> opening_radius2;
+  // and, for the relative criterion, where distance^4 times the scale of
+  // the position exceeds this, 0 otherwise
+  data::Scalar<T> opening_weight;
+  std::uint32_t first_child;
+  // 0 for leaves
+  std::uint32_t children;
+};
+
+// deepest tree the fixed size stack of the walk can hold
+constexpr std::size_t MAX_DEPTH = 128;
+
+template <std::size_t Dimension> constexpr std::size_t stack_size() {
+  constexpr auto CHILDREN =
+      data::tree::BodyTreeInnerNode<double, Dimension>::CHILDREN_NUMBER;
+  // every level on the path holds at most its unvisited siblings
+  return MAX_DEPTH * (CHILDREN - 1) + 1;
+}
+
+// bodies walking the tree together in the packet walk
+constexpr std::size_t PACKET_SIZE = 8;
+
+// scale of a position for the relative criterion: tolerance times the
+// acceleration of the body in the previous step, infinite if unknown or for
+// the other criteria, so the opening weight never decides
+template <typename T>
+T opening_scale(const config::Configuration<T> &config, T acceleration) {
+  return config.opening == config::OpeningCriterion::Relative
+             ? config.opening_tolerance * acceleration
+             : std::numeric_limits<T>::infinity();
+}
+
+// whether an inner node is accepted as a whole for a position at squared
+// distance `distance2` from its center of mass with opening scale `scale`
+// distance^4 overflows float for distant nodes, so the relative test is
+// done in double
+template <typename T, std::size_t Dimension>
+bool accepts(const WalkNode<T, Dimension> &node, T distance2, T scale) {
+  return distance2 > node.opening_radius2 &&
+         static_cast<double>(distance2) * distance2 * scale >
+             node.opening_weight;
+}
+
+// squared distance from the center of mass to the farthest corner of the
+// space, no position inside the space is farther
+template <typename T, std::size_t Dimension>
+T corner_distance2(const data::Space<T, Dimension> &space,
+                   const data::Vector<T, Dimension> &center_of_mass) {
+  T corner2 = 0;
+  for (std::size_t d = 0; d < Dimension; ++d) {
+    auto extent = std::max(center_of_mass[d] - space.min[d],
+                           space.max[d] - center_of_mass[d]);
+    corner2 += extent * extent;
+  }
+  return corner2;
+}
+
+// squared distance from the center of mass of the root within which the
+// leaves hold half of the mass, unlike the size of the root it does not
+// grow with a few distant bodies
+template <typename T, std::size_t Dimension>
+T half_mass_radius2(const std::vector<WalkNode<T, Dimension>> &nodes) {
+  if (nodes.empty())
+    return 0;
+  const auto &center = nodes.front().center_of_mass;
+  // squared distance and mass of every leaf
+  std::vector<std::pair<T, T>> leaves;
+  T mass = 0;
+  for (const auto &node : nodes) {
+    if (node.children != 0)
+      continue;
+    T distance2 = 0;
+    for (std::size_t d = 0; d < Dimension; ++d) {
+      auto offset = node.center_of_mass[d] - center[d];
+      distance2 += offset * offset;
+    }
+    leaves.emplace_back(distance2, node.mass);
+    mass += node.mass;
+  }
+  std::sort(leaves.begin(), leaves.end());
+  T enclosed = 0;
+  for (const auto &[distance2, leaf_mass] : leaves) {
+    enclosed += leaf_mass;
+    if (2 * enclosed >= mass)
+      return distance2;
+  }
+  return leaves.back().first;
+}
+
+// recompute masses and centers of mass of `count` walk nodes from the moved
+// bodies, `bodies` holds the body of every leaf, the shape of the tree and
+// the opening radii and weights are kept
+// children come after their parent, so the nodes are summed backwards
+template <typename T, std::size_t Dimension>
+void refresh(WalkNode<T, Dimension> *nodes, const std::uint64_t *bodies,
+             std::size_t count,
+             const data::BodiesView<T, Dimension> &all_bodies) {
+  for (std::size_t n = count; n > 0; --n) {
+    auto &node = nodes[n - 1];
+    if (node.children == 0) {
+      const auto &body = all_bodies[bodies[n - 1]];
+      node.center_of_mass = body.position;
+      node.mass = body.mass;
+      continue;
+    }
+    data::Vector<T, Dimension> moment{};
+    T mass = 0;
+    for (std::uint32_t c = 0; c < node.children; ++c) {
+      const auto &child = nodes[node.first_child + c];
+      for (std::size_t d = 0; d < Dimension; ++d) {
+        moment[d] += child.mass * child.center_of_mass[d];
+      }
+      mass += child.mass;
+    }
+    for (std::size_t d = 0; d < Dimension; ++d) {
+      node.center_of_mass[d] = moment[d] / mass;
+    }
+    node.mass = mass;
+  }
+}
+
+template <typename T, std::size_t Dimension> struct WalkTree {
+  std::vector<WalkNode<T, Dimension>> nodes;
+  // body of every leaf, NONE for inner nodes
+  std::vector<std::uint64_t> bodies;
+
+  // lay out `count` flat nodes rooted at the first one breadth first and
+  // set the opening radii of the criterion of `config`
+  // geometric:     size / theta
+  // salmon-warren: the distance d where the error bound of the monopole,
+  //                3 G B2 / ((d - bmax)^2 d^2) with B2 the second moment of
+  //                the node, falls to the tolerance times G M / r^2, the
+  //                acceleration at the half mass radius r of the root
+  // relative:      size / theta as a safety, and the node is accepted only
+  //                where G M size^2 / d^4 is below the tolerance times the
+  //                acceleration of the position
+  // no radius is less than the distance to the farthest corner, so a node
+  // is never accepted for a position inside it
+  static WalkTree<T, Dimension>
+  from_flat(const data::tree::FlatNode<T, Dimension> *flat, std::size_t count,
+            const config::Configuration<T> &config) {
+    using Flat = data::tree::FlatNode<T, Dimension>;
+    if (count > std::numeric_limits<std::uint32_t>::max()) {
+      throw std::length_error("too many tree nodes for the walk");
+    }
+
+    WalkTree<T, Dimension> result;
+    if (count == 0)
+      return result;
+    result.nodes.reserve(count);
+    result.bodies.reserve(count);
+    // flat index and depth of every walk node
+    std::vector<std::uint64_t> order{0};
+    std::vector<std::size_t> depths{0};
+    order.reserve(count);
+    depths.reserve(count);
+    for (std::size_t w = 0; w < order.size(); ++w) {
+      const auto &f = flat[order[w]];
+      WalkNode<T, Dimension> node{f.center_of_mass, f.mass, 0, 0,
+                                  static_cast<std::uint32_t>(order.size()), 0};
+      if (f.body == Flat::NONE) {
+        if (depths[w] + 1 >= MAX_DEPTH) {
+          throw std::length_error("tree is too deep for the walk stack");
+        }
+        for (auto child : f.children) {
+          if (child != Flat::NONE) {
+            order.push_back(child);
+            depths.push_back(depths[w] + 1);
+            ++node.children;
+          }
+        }
+      }
+      result.nodes.push_back(node);
+      result.bodies.push_back(f.body);
+    }
+
+    // second moments about the centers of mass, by the parallel axis
+    // theorem from the children up
+    std::vector<T> moments2(result.nodes.size());
+    if (config.opening == config::OpeningCriterion::SalmonWarren) {
+      for (std::size_t n = result.nodes.size(); n > 0; --n) {
+        const auto &node = result.nodes[n - 1];
+        for (std::uint32_t c = 0; c < node.children; ++c) {
+          const auto &child = result.nodes[node.first_child + c];
+          T offset2 = 0;
+          for (std::size_t d = 0; d < Dimension; ++d) {
+            auto offset = child.center_of_mass[d] - node.center_of_mass[d];
+            offset2 += offset * offset;
+          }
+          moments2[n - 1] +=
+              moments2[node.first_child + c] + child.mass * offset2;
+        }
+      }
+    }
+
+    T tolerance = 0;
+    if (config.opening == config::OpeningCriterion::SalmonWarren) {
+      tolerance = config.opening_tolerance * config.G * flat[0].mass /
+                  half_mass_radius2(result.nodes);
+    }
+    for (std::size_t w = 0; w < result.nodes.size(); ++w) {
+      auto &node = result.nodes[w];
+      if (node.children == 0)
+        continue;
+      const auto &f = flat[order[w]];
+      auto size = space::size_of_space(f.space);
+      auto corner2 = corner_distance2(f.space, f.center_of_mass);
+      T radius;
+      if (config.opening == config::OpeningCriterion::SalmonWarren) {
+        auto bmax = std::sqrt(corner2);
+        auto product = tolerance > 0
+                           ? std::sqrt(3 * config.G * moments2[w] / tolerance)
+                           : std::numeric_limits<T>::infinity();
+        radius = bmax / 2 + std::sqrt(bmax * bmax / 4 + product);
+      } else {
+        radius = size / config.theta;
+      }
+      node.opening_radius2 = std::max(radius * radius, corner2);
+      if (config.opening == config::OpeningCriterion::Relative) {
+        node.opening_weight = config.G * node.mass * size * size;
+      }
+    }
+    return result;
+  }
+
+  static WalkTree<T, Dimension>
+  from_flat(const std::vector<data::tree::FlatNode<T, Dimension>> &flat,
+            const config::Configuration<T> &config) {
+    return from_flat(flat.data(), flat.size(), config);
+  }
+
+  // recompute masses and centers of mass from the moved bodies
+  void refresh(const data::BodiesView<T, Dimension> &all_bodies) {
+    walk::refresh(this->nodes.data(), this->bodies.data(),
+                  this->nodes.size(), all_bodies);
+  }
+
+  std::size_t bytes() const {
+    return this->nodes.size() * sizeof(WalkNode<T, Dimension>) +
+           this->bodies.size() * sizeof(std::uint64_t);
+  }
+};
+
+// nodes of a walk tree held elsewhere, like data::BodiesView, so a tree in
+// the memory shared by the processes of a node is walked in place
+template <typename T, std::size_t Dimension> class WalkView {
+public:
+  using value_type = WalkNode<T, Dimension>;
+
+  WalkView() = default;
+  WalkView(const value_type *first, std::size_t count)
+      : first(first), count(count) {}
+  WalkView(const WalkTree<T, Dimension> &tree)
+      : first(tree.nodes.data()), count(tree.nodes.size()) {}
+
+  const value_type *data() const { return this->first; }
+  std::size_t size() const { return this->count; }
+  bool empty() const { return this->count == 0; }
+  const value_type &operator[](std::size_t i) const { return this->first[i]; }
+
+private:
+  const value_type *first = nullptr;
+  std::size_t count = 0;
+};
+
+// a walk tree kept once per node, the leader lays it out from the flat tree
+// and the other processes of the node map it
+// build and refresh are collective over the node
+template <typename T, std::size_t Dimension> class SharedWalkTree {
+public:
+  explicit SharedWalkTree(const shared::Topology &topology)
+      : topology(topology), nodes(topology), bodies(topology) {}
+
+  void build(const shared::SharedArray<data::tree::FlatNode<T, Dimension>>
+                 &flat,
+             const config::Configuration<T> &config) {
+    // every flat node is reached from the root, so the walk has as many
+    this->nodes.resize(flat.size());
+    this->bodies.resize(flat.size());
+    if (this->topology.is_leader()) {
+      auto tree = WalkTree<T, Dimension>::from_flat(flat.data(), flat.size(),
+                                                    config);
+      std::copy(tree.nodes.begin(), tree.nodes.end(), this->nodes.begin());
+      std::copy(tree.bodies.begin(), tree.bodies.end(),
+                this->bodies.begin());
+    }
+    this->nodes.fence();
+  }
+
+  void refresh(const data::BodiesView<T, Dimension> &all_bodies) {
+    if (this->topology.is_leader()) {
+      walk::refresh(this->nodes.data(), this->bodies.data(),
+                    this->nodes.size(), all_bodies);
+    }
+    this->nodes.fence();
+  }
+
+  WalkView<T, Dimension> view() const {
+    return {this->nodes.data(), this->nodes.size()};
+  }
+
+  std::size_t bytes() const {
+    return this->nodes.size() * sizeof(WalkNode<T, Dimension>) +
+           this->bodies.size() * sizeof(std::uint64_t);
+  }
+
+private:
+  const shared::Topology &topology;
+  shared::SharedArray<WalkNode<T, Dimension>> nodes;
+  shared::SharedArray<std::uint64_t> bodies;
+};
+
+// nodes every group of local bodies interacts with, kept over steps like
+// verlet lists
+// a group is PACKET_SIZE local bodies consecutive in morton order, a node is
+// accepted for a group only if it is farther than its opening radius plus a
+// margin from every body of the group, so the lists stay valid while no
+// body moves more than half of the margin, the moments of the nodes are
+// refreshed in the meantime
+template <typename T, std::size_t Dimension> struct InteractionLists {
+  // the tree the lists index, unless it is shared by the node
+  WalkTree<T, Dimension> tree;
+  SharedWalkTree<T, Dimension> *shared = nullptr;
+  // local index of the bodies of every group
+  std::vector<std::uint32_t> order;
+  // the list of group g is nodes[offsets[g], offsets[g + 1])
+  std::vector<std::size_t> offsets;
+  std::vector<std::uint32_t> nodes;
+  // first local body and the positions of the local bodies when the lists
+  // were built
+  std::size_t first = 0;
+  std::vector<data::Vector<T, Dimension>> positions;
+  T margin;
+
+  // lists of the local bodies [first, first + count) of `all_bodies`
+  static InteractionLists<T, Dimension>
+  build(WalkTree<T, Dimension> tree, const data::Space<T, Dimension> &space,
+        const data::BodiesView<T, Dimension> &all_bodies, std::size_t first,
+        std::size_t count, T margin) {
+    auto result = index(tree, space, all_bodies, first, count, margin);
+    result.tree = std::move(tree);
+    return result;
+  }
+
+  // lists into a tree shared by the node, which must outlive them
+  static InteractionLists<T, Dimension>
+  build(SharedWalkTree<T, Dimension> &tree,
+        const data::Space<T, Dimension> &space,
+        const data::BodiesView<T, Dimension> &all_bodies, std::size_t first,
+        std::size_t count, T margin) {
+    auto result = index(tree.view(), space, all_bodies, first, count, margin);
+    result.shared = &tree;
+    return result;
+  }
+
+  WalkView<T, Dimension> view() const {
+    return this->shared ? this->shared->view()
+                        : WalkView<T, Dimension>(this->tree);
+  }
+
+  std::size_t groups() const { return this->offsets.size() - 1; }
+
+  // whether a local body moved more than half of the margin since the
+  // build, the lists of all processes stay valid until one of them expires
+  bool expired(const data::BodiesView<T, Dimension> &all_bodies) const {
+    if (this->first + this->positions.size() > all_bodies.size())
+      return true;
+    auto limit2 = this->margin * this->margin / 4;
+    for (std::size_t i = 0; i < this->positions.size(); ++i) {
+      T distance2 = 0;
+      for (std::size_t d = 0; d < Dimension; ++d) {
+        auto dp = all_bodies[this->first + i].position[d] -
+                  this->positions[i][d];
+        distance2 += dp * dp;
+      }
+      if (distance2 > limit2)
+        return true;
+    }
+    return false;
+  }
+
+  // collective over the node if the tree is shared
+  void refresh(const data::BodiesView<T, Dimension> &all_bodies) {
+    if (this->shared) {
+      this->shared->refresh(all_bodies);
+    } else {
+      this->tree.refresh(all_bodies);
+    }
+  }
+
+  // the tree included
+  std::size_t bytes() const {
+    return (this->shared ? this->shared->bytes() : this->tree.bytes()) +
+           this->order.size() * sizeof(std::uint32_t) +
+           this->offsets.size() * sizeof(std::size_t) +
+           this->nodes.size() * sizeof(std::uint32_t) +
+           this->positions.size() * sizeof(data::Vector<T, Dimension>);
+  }
+
+private:
+  static InteractionLists<T, Dimension>
+  index(const WalkView<T, Dimension> &tree,
+        const data::Space<T, Dimension> &space,
+        const data::BodiesView<T, Dimension> &all_bodies, std::size_t first,
+        std::size_t count, T margin) {
+    InteractionLists<T, Dimension> result;
+    result.margin = margin;
+    result.first = first;
+    result.positions.reserve(count);
+    for (std::size_t i = 0; i < count; ++i) {
+      result.positions.push_back(all_bodies[first + i].position);
+    }
+
+    std::vector<std::pair<std::uint64_t, std::uint32_t>> keys(count);
+    for (std::size_t i = 0; i < count; ++i) {
+      keys[i] = {morton::key_of(space, all_bodies[first + i].position),
+                 static_cast<std::uint32_t>(i)};
+    }
+    std::sort(keys.begin(), keys.end());
+    result.order.reserve(count);
+    for (const auto &key : keys) {
+      result.order.push_back(key.second);
+    }
+
+    result.offsets.push_back(0);
+    std::uint32_t stack[stack_size<Dimension>()];
+    for (std::size_t begin = 0; begin < count; begin += PACKET_SIZE) {
+      auto end = std::min(begin + PACKET_SIZE, count);
+      // bounding sphere of the group
+      data::Vector<T, Dimension> low, high, center;
+      low = high = all_bodies[first + result.order[begin]].position;
+      for (auto k = begin; k < end; ++k) {
+        const auto &position = all_bodies[first + result.order[k]].position;
+        for (std::size_t d = 0; d < Dimension; ++d) {
+          low[d] = std::min(low[d], position[d]);
+          high[d] = std::max(high[d], position[d]);
+        }
+      }
+      T radius2 = 0;
+      for (std::size_t d = 0; d < Dimension; ++d) {
+        center[d] = (low[d] + high[d]) / 2;
+        radius2 += (high[d] - center[d]) * (high[d] - center[d]);
+      }
+      auto slack = std::sqrt(radius2) + margin;
+
+      std::size_t top = 0;
+      if (!tree.empty())
+        stack[top++] = 0;
+      while (top != 0) {
+        auto index = stack[--top];
+        const auto &node = tree[index];
+        T distance2 = 0;
+        for (std::size_t d = 0; d < Dimension; ++d) {
+          auto dp = node.center_of_mass[d] - center[d];
+          distance2 += dp * dp;
+        }
+        auto reach = std::sqrt(node.opening_radius2) + slack;
+        if (node.children == 0 || distance2 > reach * reach) {
+          result.nodes.push_back(index);
+        } else {
+          for (std::uint32_t c = 0; c < node.children; ++c) {
+            stack[top++] = node.first_child + c;
+          }
+        }
+      }
+      result.offsets.push_back(result.nodes.size());
+    }
+    return result;
+  }
+};
+
+// nodes the bodies of one step interacted with, over all processes
+struct InteractionSummary {
+  std::uint64_t bodies = 0;
+  std::uint64_t total = 0;
+  std::uint64_t min = 0;
+  std::uint64_t max = 0;
+
+  double mean() const {
+    return bodies == 0 ? 0 : static_cast<double>(total) / bodies;
+  }
+};
+
+// reduce the interactions of the local bodies, meaningful in root only
+inline InteractionSummary
+summarize(const boost::mpi::communicator &comm, int root,
+          const std::vector<std::uint64_t> &interactions) {
+  std::array<std::uint64_t, 2> sums{interactions.size(), 0};
+  std::uint64_t min = std::numeric_limits<std::uint64_t>::max();
+  std::uint64_t max = 0;
+  for (auto count : interactions) {
+    sums[1] += count;
+    min = std::min(min, count);
+    max = std::max(max, count);
+  }
+  InteractionSummary result;
+  if (comm.rank() != root) {
+    boost::mpi::reduce(comm, sums.data(), 2, std::plus<std::uint64_t>(), root);
+    boost::mpi::reduce(comm, min, boost::mpi::minimum<std::uint64_t>(), root);
+    boost::mpi::reduce(comm, max, boost::mpi::maximum<std::uint64_t>(), root);
+    return result;
+  }
+  std::array<std::uint64_t, 2> total;
+  boost::mpi::reduce(comm, sums.data(), 2, total.data(),
+                     std::plus<std::uint64_t>(), root);
+  boost::mpi::reduce(comm, min, result.min,
+                     boost::mpi::minimum<std::uint64_t>(), root);
+  boost::mpi::reduce(comm, max, result.max,
+                     boost::mpi::maximum<std::uint64_t>(), root);
+  result.bodies = total[0];
+  result.total = total[1];
+  if (result.bodies == 0)
+    result.min = 0;
+  return result;
+}
+
+} // namespace n_body::walk
+
+#endif
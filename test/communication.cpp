@@ -0,0 +1,50 @@
+#include "../src/communication.hpp"
+#include <boost/test/unit_test.hpp>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace communication = n_body::communication;
+
+BOOST_AUTO_TEST_SUITE(n_body_communication_test)
+
+BOOST_AUTO_TEST_CASE(equal_partition_divides_counts) {
+  auto partition = communication::equal(12, 3);
+  BOOST_TEST(partition == (communication::Partition{0, 4, 8, 12}),
+             boost::test_tools::per_element());
+  std::vector<std::uint64_t> costs(12, 5);
+  BOOST_TEST(communication::imbalance(costs, partition) == 1);
+}
+
+BOOST_AUTO_TEST_CASE(balance_equalizes_costs) {
+  // a dense cluster at the front costs as much as the rest
+  std::vector<std::uint64_t> costs(100, 1);
+  for (std::size_t i = 0; i < 10; ++i) {
+    costs[i] = 10;
+  }
+  auto equal = communication::equal(costs.size(), 4);
+  BOOST_TEST(communication::imbalance(costs, equal) > 2);
+
+  auto partition = communication::balance(costs, 4);
+  BOOST_TEST(partition.size() == 5);
+  BOOST_TEST(partition.front() == 0);
+  BOOST_TEST(partition.back() == costs.size());
+  for (std::size_t r = 0; r < 4; ++r) {
+    BOOST_TEST(partition[r] <= partition[r + 1]);
+  }
+  // no division exceeds its share by more than one body
+  BOOST_TEST(communication::imbalance(costs, partition) <= 1 + 10.0 * 4 / 190);
+}
+
+BOOST_AUTO_TEST_CASE(balance_leaves_no_gaps) {
+  // fewer bodies than divisions
+  std::vector<std::uint64_t> costs{7, 1};
+  auto partition = communication::balance(costs, 4);
+  BOOST_TEST(partition.size() == 5);
+  BOOST_TEST(partition.back() == costs.size());
+  for (std::size_t r = 0; r < 4; ++r) {
+    BOOST_TEST(partition[r] <= partition[r + 1]);
+  }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,124 @@
+#include "../src/diagnostics.hpp"
+#include "../src/physical.hpp"
+#include "../src/walk.hpp"
+#include "fixture.hpp"
+#include <boost/test/unit_test.hpp>
+#include <cmath>
+#include <cstddef>
+#include <vector>
+
+namespace nbd = n_body::data;
+namespace nbw = n_body::walk;
+namespace diagnostics = n_body::diagnostics;
+namespace physical = n_body::physical;
+namespace space = n_body::space;
+using fixture::Number;
+using fixture::DIMENSION;
+using fixture::walk_tree_of;
+
+namespace {
+
+nbd::Bodies<Number, DIMENSION> random_bodies(std::size_t number) {
+  return fixture::random_bodies(number, 5, true);
+}
+
+// sum over pairs, the reference of the potentials of the force methods
+Number pair_potential(const n_body::config::Configuration<Number> &config,
+                      const nbd::Bodies<Number, DIMENSION> &bodies) {
+  Number potential = 0;
+  for (std::size_t i = 0; i < bodies.size(); ++i) {
+    for (std::size_t j = i + 1; j < bodies.size(); ++j) {
+      auto r2 = config.soften_length * config.soften_length;
+      for (std::size_t d = 0; d < DIMENSION; ++d) {
+        auto dp = bodies[i].position[d] - bodies[j].position[d];
+        r2 += dp * dp;
+      }
+      potential -= config.G * bodies[i].mass * bodies[j].mass / std::sqrt(r2);
+    }
+  }
+  return potential;
+}
+
+n_body::config::Configuration<Number> configuration(Number theta) {
+  auto config = fixture::configuration(theta);
+  config.G = 2;
+  config.soften_length = 0.1;
+  config.time = 0;
+  return config;
+}
+
+} // namespace
+
+BOOST_AUTO_TEST_SUITE(n_body_diagnostics_test)
+
+BOOST_AUTO_TEST_CASE(bodies_give_energy_and_momenta) {
+  nbd::Bodies<Number, DIMENSION> bodies{
+      {{1, 0, 0}, {0, 2, 0}, 3},
+      {{0, 0, 1}, {1, 0, 0}, 1},
+  };
+  auto d = diagnostics::of_bodies<Number, DIMENSION>(bodies.begin(),
+                                                     bodies.end());
+  BOOST_TEST(d.kinetic == 3 * 4 / 2.0 + 1 / 2.0);
+  BOOST_TEST(d.momentum[0] == 1);
+  BOOST_TEST(d.momentum[1] == 6);
+  BOOST_TEST(d.momentum[2] == 0);
+  // r x v: (1, 0, 0) x (0, 6, 0) + (0, 0, 1) x (1, 0, 0)
+  BOOST_TEST(d.angular_momentum[0] == 0);
+  BOOST_TEST(d.angular_momentum[1] == 1);
+  BOOST_TEST(d.angular_momentum[2] == 6);
+
+  d.potential = -2 * d.kinetic;
+  BOOST_TEST(d.virial_ratio() == 1);
+  BOOST_TEST(d.total() == -d.kinetic);
+}
+
+BOOST_AUTO_TEST_CASE(plane_has_only_z_angular_momentum) {
+  nbd::Bodies<Number, 2> bodies{{{2, 0}, {0, 1}, 2}};
+  auto d = diagnostics::of_bodies<Number, 2>(bodies.begin(), bodies.end());
+  BOOST_TEST(d.angular_momentum[0] == 0);
+  BOOST_TEST(d.angular_momentum[1] == 0);
+  BOOST_TEST(d.angular_momentum[2] == 4);
+}
+
+BOOST_AUTO_TEST_CASE(force_methods_give_the_potential) {
+  auto bodies = random_bodies(203);
+  auto exact_config = configuration(1e-6);
+  auto reference = pair_potential(exact_config, bodies);
+
+  // a zero time step leaves the bodies where they are
+  Number direct = 0;
+  auto still = bodies;
+  physical::step(exact_config, still.begin(), still.end(), bodies, &direct);
+  BOOST_TEST(direct == reference, boost::test_tools::tolerance(1e-12));
+  BOOST_TEST(still[42].position[0] == bodies[42].position[0]);
+
+  // nothing is accepted with a tiny theta, the walk is a direct sum
+  std::vector<Number> magnitudes;
+  Number walked = 0;
+  physical::step(exact_config, still.begin(), still.end(),
+                 walk_tree_of(bodies, exact_config), magnitudes, &walked);
+  BOOST_TEST(walked == reference, boost::test_tools::tolerance(1e-12));
+
+  // the packets give the same as the scalar walk, the lists stay close
+  auto config = configuration(0.5);
+  auto walk_tree = walk_tree_of(bodies, config);
+  Number scalar = 0;
+  physical::step(config, still.begin(), still.end(), walk_tree, magnitudes,
+                 &scalar);
+  config.method = n_body::config::ForceMethod::Packet;
+  Number packet = 0;
+  physical::step(config, still.begin(), still.end(), walk_tree, magnitudes,
+                 &packet);
+  BOOST_TEST(packet == scalar, boost::test_tools::tolerance(1e-12));
+  BOOST_TEST(scalar == reference, boost::test_tools::tolerance(1e-3));
+
+  auto lists = nbw::InteractionLists<Number, DIMENSION>::build(
+      walk_tree,
+      space::root_space<Number, DIMENSION>(bodies.begin(), bodies.end()),
+      nbd::BodiesView<Number, DIMENSION>(bodies), 0, bodies.size(), 0.5);
+  Number listed = 0;
+  physical::step(config, still.begin(), still.end(), lists, &listed);
+  BOOST_TEST(listed == reference, boost::test_tools::tolerance(1e-3));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,63 @@
+#ifndef N_BODY_TEST_FIXTURE_HPP
+#define N_BODY_TEST_FIXTURE_HPP
+
+#include "../src/config.hpp"
+#include "../src/data.hpp"
+#include "../src/space.hpp"
+#include "../src/tree.hpp"
+#include "../src/walk.hpp"
+#include <cstddef>
+#include <random>
+
+// bodies, configurations and trees shared by the tests of the force methods
+namespace fixture {
+
+using Number = double;
+constexpr std::size_t DIMENSION = 3;
+
+// bodies in a cube of side 20 with masses in [1, 2), at rest unless
+// `moving`, then with velocities in [-1, 1)
+inline n_body::data::Bodies<Number, DIMENSION>
+random_bodies(std::size_t number, unsigned seed, bool moving = false) {
+  n_body::data::Bodies<Number, DIMENSION> bodies;
+  std::mt19937 engine(seed);
+  auto position = std::uniform_real_distribution<Number>(-10, 10);
+  auto velocity = std::uniform_real_distribution<Number>(-1, 1);
+  auto mass = std::uniform_real_distribution<Number>(1, 2);
+  for (std::size_t i = 0; i < number; ++i) {
+    n_body::data::Body<Number, DIMENSION> body{
+        {position(engine), position(engine), position(engine)}, {}, 0};
+    if (moving)
+      body.velocity = {velocity(engine), velocity(engine), velocity(engine)};
+    body.mass = mass(engine);
+    bodies.push_back(body);
+  }
+  return bodies;
+}
+
+// unit G without softening
+inline n_body::config::Configuration<Number> configuration(Number theta) {
+  n_body::config::Configuration<Number> config;
+  config.G = 1;
+  config.theta = theta;
+  config.opening_tolerance = 0.0025;
+  config.soften_length = 0;
+  return config;
+}
+
+inline n_body::walk::WalkTree<Number, DIMENSION>
+walk_tree_of(const n_body::data::Bodies<Number, DIMENSION> &bodies,
+             const n_body::config::Configuration<Number> &config) {
+  auto root_space = n_body::space::root_space<Number, DIMENSION>(
+      bodies.begin(), bodies.end());
+  n_body::data::tree::BodyTree<Number, DIMENSION> tree;
+  for (std::size_t i = 0; i < bodies.size(); ++i) {
+    tree.push(bodies, root_space, i);
+  }
+  return n_body::walk::WalkTree<Number, DIMENSION>::from_flat(tree.flatten(),
+                                                              config);
+}
+
+} // namespace fixture
+
+#endif
@@ -0,0 +1,62 @@
+#include "../src/logging.hpp"
+#include <boost/test/unit_test.hpp>
+#include <cstddef>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <ostream>
+#include <string>
+
+namespace logging = n_body::logging;
+namespace fs = std::filesystem;
+
+namespace {
+
+std::string content_of(const fs::path &path) {
+  std::ifstream is(path);
+  return {std::istreambuf_iterator<char>(is), std::istreambuf_iterator<char>()};
+}
+
+} // namespace
+
+BOOST_AUTO_TEST_SUITE(n_body_logging_test)
+
+BOOST_AUTO_TEST_CASE(disabled_messages_are_not_evaluated) {
+  auto &configuration = logging::Configuration::instance();
+  auto min_level = configuration.min_level;
+  configuration.min_level = logging::Level::Warn;
+
+  int evaluated = 0;
+  auto count = [&evaluated]() { return ++evaluated; };
+  N_BODY_LOG(Info) << count() << std::endl;
+  BOOST_TEST(evaluated == 0);
+  // no dangling else
+  if (evaluated == 0)
+    N_BODY_LOG(Debug) << count() << std::endl;
+  else
+    ++evaluated;
+  BOOST_TEST(evaluated == 0);
+
+  configuration.min_level = min_level;
+}
+
+BOOST_AUTO_TEST_CASE(file_sink_writes_blocks) {
+  auto path = fs::temp_directory_path() / "n_body_logging_test.txt";
+  std::string line(100, 'x');
+  std::size_t lines = logging::FileSink::CAPACITY / (line.size() + 1) + 1;
+  {
+    logging::FileSink sink(path);
+    std::ostream os(&sink);
+    os << line << std::endl;
+    // flushed lines stay in memory until the block is full
+    BOOST_TEST(content_of(path).empty());
+    for (std::size_t i = 1; i < lines; ++i) {
+      os << line << std::endl;
+    }
+    BOOST_TEST(content_of(path).size() == logging::FileSink::CAPACITY);
+  }
+  BOOST_TEST(content_of(path).size() == lines * (line.size() + 1));
+  fs::remove(path);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,60 @@
+#include "../src/morton.hpp"
+#include <boost/test/unit_test.hpp>
+#include <cstddef>
+#include <cstdint>
+#include <numeric>
+#include <vector>
+
+namespace nbd = n_body::data;
+namespace nbm = n_body::morton;
+using Number = double;
+
+BOOST_AUTO_TEST_SUITE(n_body_morton_test)
+
+BOOST_AUTO_TEST_CASE(key_follows_z_order) {
+  nbd::Space<Number, 2> space{{0, 0}, {4, 4}, {2, 2}};
+  // the four quadrants in z order: x bit below y bit
+  auto low = nbm::key_of(space, nbd::Vector<Number, 2>{1, 1});
+  auto right = nbm::key_of(space, nbd::Vector<Number, 2>{3, 1});
+  auto up = nbm::key_of(space, nbd::Vector<Number, 2>{1, 3});
+  auto high = nbm::key_of(space, nbd::Vector<Number, 2>{3, 3});
+  BOOST_TEST(low < right);
+  BOOST_TEST(right < up);
+  BOOST_TEST(up < high);
+
+  // the boundary and positions outside are clamped
+  BOOST_TEST(nbm::key_of(space, nbd::Vector<Number, 2>{0, 0}) == 0u);
+  BOOST_TEST(nbm::key_of(space, nbd::Vector<Number, 2>{4, 4}) ==
+             nbm::key_of(space, nbd::Vector<Number, 2>{5, 9}));
+}
+
+BOOST_AUTO_TEST_CASE(reorder_keeps_ids) {
+  nbd::Space<Number, 3> space{{0, 0, 0}, {8, 8, 8}, {4, 4, 4}};
+  nbd::Bodies<Number, 3> bodies;
+  for (std::size_t i = 0; i < 64; ++i) {
+    auto x = static_cast<Number>((i * 37) % 8);
+    auto y = static_cast<Number>((i * 11) % 8);
+    auto z = static_cast<Number>((i * 5) % 8);
+    bodies.push_back({{x, y, z}, {0, 0, 0}, static_cast<Number>(i)});
+  }
+  std::vector<std::uint64_t> ids(bodies.size());
+  std::iota(ids.begin(), ids.end(), 0);
+
+  auto original = bodies;
+  nbm::reorder(space, bodies.data(), ids.data(), bodies.size());
+  for (std::size_t i = 1; i < bodies.size(); ++i) {
+    BOOST_TEST(nbm::key_of(space, bodies[i - 1].position) <=
+               nbm::key_of(space, bodies[i].position));
+  }
+  for (std::size_t i = 0; i < bodies.size(); ++i) {
+    BOOST_TEST(bodies[i].mass == original[ids[i]].mass);
+  }
+
+  auto restored = nbm::in_id_order(nbd::BodiesView<Number, 3>(bodies),
+                                   ids.data());
+  for (std::size_t i = 0; i < bodies.size(); ++i) {
+    BOOST_TEST(restored[i].mass == original[i].mass);
+  }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
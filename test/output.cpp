@@ -0,0 +1,73 @@
+#include "../src/input.hpp"
+#include "../src/output.hpp"
+#include <boost/test/unit_test.hpp>
+#include <cstddef>
+#include <sstream>
+#include <vector>
+
+namespace data = n_body::data;
+namespace input = n_body::input;
+namespace output = n_body::output;
+using Number = double;
+
+BOOST_AUTO_TEST_SUITE(n_body_output_test)
+
+BOOST_AUTO_TEST_CASE(quantized_positions_round_trip) {
+  constexpr std::size_t DIMENSION = 3;
+  constexpr Number PRECISION = 0.01;
+  std::vector<data::Vector<Number, DIMENSION>> positions{
+      {1, 2, 3},
+      {-1, -2.5, 0.123},
+      {10, 0, -7},
+  };
+
+  output::PositionsQuantizer<Number, DIMENSION> quantizer(PRECISION);
+  input::PositionsDequantizer<Number, DIMENSION> dequantizer;
+  for (std::size_t frame = 0; frame < 4; ++frame) {
+    std::stringstream ss;
+    quantizer.write(ss, positions);
+
+    std::vector<data::Vector<Number, DIMENSION>> decoded;
+    BOOST_TEST(dequantizer.read(ss, decoded));
+    BOOST_TEST(decoded.size() == positions.size());
+    for (std::size_t i = 0; i < positions.size(); ++i) {
+      for (std::size_t d = 0; d < DIMENSION; ++d) {
+        BOOST_TEST(std::abs(decoded[i][d] - positions[i][d]) <=
+                   PRECISION / 2 + 1e-9);
+      }
+    }
+
+    // move bodies for the next delta frame
+    for (auto &position : positions) {
+      position[0] += 0.37;
+      position[2] -= 1.01;
+    }
+  }
+}
+
+BOOST_AUTO_TEST_CASE(quantized_positions_keep_the_origin) {
+  constexpr std::size_t DIMENSION = 3;
+  constexpr Number PRECISION = 0.001;
+  // the origin has more significant digits than a stream writes by default
+  std::vector<data::Vector<Number, DIMENSION>> positions{
+      {-123456.789, 98765.4321, -0.000123456789},
+      {-123000.5, 98766.25, 1},
+  };
+
+  output::PositionsQuantizer<Number, DIMENSION> quantizer(PRECISION);
+  input::PositionsDequantizer<Number, DIMENSION> dequantizer;
+  std::stringstream ss;
+  quantizer.write(ss, positions);
+
+  std::vector<data::Vector<Number, DIMENSION>> decoded;
+  BOOST_TEST(dequantizer.read(ss, decoded));
+  BOOST_TEST(decoded.size() == positions.size());
+  for (std::size_t i = 0; i < positions.size(); ++i) {
+    for (std::size_t d = 0; d < DIMENSION; ++d) {
+      BOOST_TEST(std::abs(decoded[i][d] - positions[i][d]) <=
+                 PRECISION / 2 + 1e-9);
+    }
+  }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
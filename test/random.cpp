@@ -0,0 +1,64 @@
+#include "../src/random.hpp"
+#include <boost/test/unit_test.hpp>
+#include <cstddef>
+#include <vector>
+
+namespace nbr = n_body::random;
+using Number = double;
+
+BOOST_AUTO_TEST_SUITE(n_body_random_test)
+
+BOOST_AUTO_TEST_CASE(philox_known_answer) {
+  // known answer vectors of the Random123 reference implementation
+  auto zero = nbr::Philox::generate({0, 0, 0, 0}, {0, 0});
+  BOOST_TEST(zero[0] == 0x6627e8d5u);
+  BOOST_TEST(zero[1] == 0xe169c58du);
+  BOOST_TEST(zero[2] == 0xbc57ac4cu);
+  BOOST_TEST(zero[3] == 0x9b00dbd8u);
+
+  auto pi = nbr::Philox::generate(
+      {0x243f6a88, 0x85a308d3, 0x13198a2e, 0x03707344},
+      {0xa4093822, 0x299f31d0});
+  BOOST_TEST(pi[0] == 0xd16cfe09u);
+  BOOST_TEST(pi[1] == 0x94fdccebu);
+  BOOST_TEST(pi[2] == 0x5001e420u);
+  BOOST_TEST(pi[3] == 0x24126ea1u);
+}
+
+BOOST_AUTO_TEST_CASE(fill_uniform_is_independent_of_partition) {
+  constexpr std::size_t NUMBER = 1000;
+  const nbr::Key key{42, 3};
+  std::vector<Number> whole(NUMBER);
+  nbr::fill_uniform(key, 0, NUMBER, whole.data(), -1., 1.);
+
+  for (std::size_t parts : {2, 3, 7}) {
+    std::vector<Number> pieces(NUMBER);
+    for (std::size_t p = 0; p < parts; ++p) {
+      auto begin = NUMBER * p / parts;
+      auto end = NUMBER * (p + 1) / parts;
+      nbr::fill_uniform(key, begin, end - begin, pieces.data() + begin,
+                           -1., 1.);
+    }
+    BOOST_TEST(pieces == whole);
+  }
+  for (auto x : whole) {
+    BOOST_TEST((x >= -1. && x < 1.));
+  }
+}
+
+BOOST_AUTO_TEST_CASE(counter_engine_seek) {
+  const nbr::Key key{7, 0};
+  nbr::CounterEngine engine(key, 5);
+  std::vector<nbr::CounterEngine::result_type> first(10);
+  for (auto &x : first) {
+    x = engine();
+  }
+  engine.seek(100);
+  engine();
+  engine.seek(5);
+  for (auto x : first) {
+    BOOST_TEST(engine() == x);
+  }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,32 @@
+# a run restarted from the checkpoint of its middle step has to end with the
+# same bodies as the uninterrupted run
+# N_BODY:    the simulation
+# DIRECTORY: where the outputs are written
+# ARGUMENTS: options of the runs besides the steps and the outputs
+
+set(STEPS 12)
+set(HALF 6)
+
+file(REMOVE_RECURSE ${DIRECTORY})
+
+function(run)
+  execute_process(COMMAND ${N_BODY} ${ARGN} RESULT_VARIABLE result
+          OUTPUT_QUIET ERROR_QUIET)
+  if (NOT result EQUAL 0)
+    message(FATAL_ERROR "${N_BODY} ${ARGN} failed: ${result}")
+  endif ()
+endfunction()
+
+run(-n 256 --seed 7 ${ARGUMENTS} -s ${STEPS} -o ${DIRECTORY}/whole)
+run(-n 256 --seed 7 ${ARGUMENTS} -s ${HALF} --checkpoint-interval ${HALF}
+        -o ${DIRECTORY}/half)
+run(${ARGUMENTS} -s ${STEPS} -r ${DIRECTORY}/half/_checkpoint.bin
+        -o ${DIRECTORY}/restarted)
+
+execute_process(COMMAND ${CMAKE_COMMAND} -E compare_files
+        ${DIRECTORY}/whole/_bodies_finished.xml
+        ${DIRECTORY}/restarted/_bodies_finished.xml
+        RESULT_VARIABLE different)
+if (different)
+  message(FATAL_ERROR "the restarted run ends with other bodies")
+endif ()
@@ -114,6 +114,36 @@ BOOST_AUTO_TEST_CASE(simple_tree_build) {
   }
 }
 
+BOOST_AUTO_TEST_CASE(statistics_of_tree) {
+
+  constexpr std::size_t DIMENSION = 2;
+  data::Bodies<Number, DIMENSION> bodies;
+  // two bodies in every quadrant, one level down
+  for (Number scale : {1.f, 0.1f}) {
+    for (Number x : {-scale, scale}) {
+      for (Number y : {-scale, scale}) {
+        bodies.push_back({.position = {x, y}, .velocity = {}, .mass = 1});
+      }
+    }
+  }
+  data::Space<Number, DIMENSION> root_space{
+      .min = {-1, -1}, .max = {1, 1}, .center = {0, 0}};
+  data::tree::BodyTree<Number, DIMENSION> tree;
+  for (std::size_t i = 0; i < bodies.size(); ++i) {
+    tree.push(bodies, root_space, i);
+  }
+
+  auto statistics = data::tree::statistics_of(tree);
+  BOOST_TEST(statistics.nodes == 13);
+  BOOST_TEST(statistics.inner == 5);
+  BOOST_TEST(statistics.leaves == bodies.size());
+  BOOST_TEST(statistics.max_depth == 2);
+  BOOST_TEST(statistics.average_depth == 2);
+  BOOST_TEST(statistics.bytes ==
+             13 * sizeof(data::tree::BodyTreeNode<Number, DIMENSION>));
+  BOOST_TEST(statistics.local_nodes == 0);
+}
+
 BOOST_AUTO_TEST_CASE(simple_merge) {
   constexpr std::size_t DIMENSION = 2;
   data::Bodies<Number, DIMENSION> bodies;
@@ -314,4 +344,42 @@ BOOST_AUTO_TEST_CASE(huge_merge) {
   }
 }
 
+BOOST_AUTO_TEST_CASE(flat_round_trip) {
+
+  constexpr std::size_t DIMENSION = 3;
+  constexpr std::size_t NUMBER = 100;
+  data::Bodies<Number, DIMENSION> bodies;
+  std::mt19937 engine(1);
+  auto dist_pos = std::normal_distribution<Number>(0.f, 1000.f);
+  for (std::size_t i = 0; i < NUMBER; ++i) {
+    bodies.push_back({
+        .position =
+            {
+                dist_pos(engine),
+                dist_pos(engine),
+                dist_pos(engine),
+            },
+        .velocity = {},
+        .mass = 1,
+    });
+  }
+
+  data::Space<Number, DIMENSION> root_space =
+      space::root_space<Number, DIMENSION>(bodies.begin(), bodies.end());
+  data::tree::BodyTree<Number, DIMENSION> tree;
+  for (std::size_t i = 0; i < bodies.size(); ++i) {
+    tree.push(bodies, root_space, i);
+  }
+
+  auto flat = tree.flatten();
+  BOOST_TEST(flat.size() == tree.tree.size());
+  auto restored = data::tree::BodyTree<Number, DIMENSION>::from_flat(
+      flat.data(), flat.size());
+  compare_tree(tree, restored);
+  for (std::size_t n = 0; n < tree.tree.size(); ++n) {
+    BOOST_TEST(restored.node(n).mass == tree.node(n).mass);
+    BOOST_TEST(restored.node(n).center_of_mass == tree.node(n).center_of_mass);
+  }
+}
+
 BOOST_AUTO_TEST_SUITE_END()
\ No newline at end of file
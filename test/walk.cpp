@@ -0,0 +1,366 @@
+#include "../src/distributed.hpp"
+#include "../src/physical.hpp"
+#include "../src/walk.hpp"
+#include "fixture.hpp"
+#include <boost/test/unit_test.hpp>
+#include <algorithm>
+#include <cfenv>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+namespace nbd = n_body::data;
+namespace nbw = n_body::walk;
+namespace physical = n_body::physical;
+namespace space = n_body::space;
+using namespace n_body::data;
+using fixture::Number;
+using fixture::configuration;
+using fixture::DIMENSION;
+using fixture::walk_tree_of;
+
+namespace {
+
+nbd::Bodies<Number, DIMENSION> random_bodies(std::size_t number) {
+  return fixture::random_bodies(number, 3);
+}
+
+} // namespace
+
+BOOST_AUTO_TEST_SUITE(n_body_walk_test)
+
+BOOST_AUTO_TEST_CASE(size_of_space_keeps_fractions) {
+  nbd::Space<Number, 2> space{{0, 0}, {0.5, 0.5}, {0.25, 0.25}};
+  BOOST_TEST(space::size_of_space(space) == 0.5);
+}
+
+BOOST_AUTO_TEST_CASE(layout_keeps_children_contiguous) {
+  auto bodies = random_bodies(200);
+  auto walk_tree = walk_tree_of(bodies, configuration(1));
+
+  // every node but the root is the child of exactly one node, the leaves
+  // hold all the mass
+  std::vector<int> parents(walk_tree.nodes.size());
+  Number leaf_mass = 0;
+  std::size_t leaves = 0;
+  for (const auto &node : walk_tree.nodes) {
+    for (std::uint32_t c = 0; c < node.children; ++c) {
+      ++parents[node.first_child + c];
+    }
+    if (node.children == 0) {
+      leaf_mass += node.mass;
+      ++leaves;
+    }
+  }
+  BOOST_TEST(parents[0] == 0);
+  for (std::size_t n = 1; n < parents.size(); ++n) {
+    BOOST_TEST(parents[n] == 1);
+  }
+  BOOST_TEST(leaves == bodies.size());
+  BOOST_TEST(leaf_mass == walk_tree.nodes[0].mass,
+             boost::test_tools::tolerance(1e-12));
+}
+
+BOOST_AUTO_TEST_CASE(walk_matches_direct_sum) {
+  auto bodies = random_bodies(300);
+  nbd::BodiesView<Number, DIMENSION> view(bodies);
+
+  // nothing is accepted with a tiny theta, the walk is a direct sum
+  auto exact_config = configuration(1e-6);
+  auto exact_tree = walk_tree_of(bodies, exact_config);
+  // the approximation stays close with the usual theta
+  auto approximate_config = configuration(0.5);
+  auto approximate_tree = walk_tree_of(bodies, approximate_config);
+
+  Number sum_squared_error = 0;
+  for (const auto &target : bodies) {
+    nbd::Vector<Number, DIMENSION> direct{};
+    for (const auto &body : view) {
+      direct += physical::gravity_per_unit_mass_position_to_position(
+          exact_config, body.position, body.mass, target.position);
+    }
+    auto exact = physical::gravity_per_unit_mass_tree_to_position(
+        exact_config, exact_tree, target.position);
+    auto approximate = physical::gravity_per_unit_mass_tree_to_position(
+        approximate_config, approximate_tree, target.position);
+
+    auto norm = nbd::module_of(direct);
+    BOOST_TEST(nbd::module_of(exact - direct) / norm < 1e-12);
+    auto error = nbd::module_of(approximate - direct) / norm;
+    sum_squared_error += error * error;
+  }
+  BOOST_TEST(std::sqrt(sum_squared_error / bodies.size()) < 0.02);
+}
+
+BOOST_AUTO_TEST_CASE(essential_tree_keeps_the_walk_error) {
+  auto bodies = random_bodies(400);
+  auto config = configuration(0.5);
+  auto root_space =
+      space::root_space<Number, DIMENSION>(bodies.begin(), bodies.end());
+  // two slabs, the tree of the one below x = 0 is sent to the other one
+  n_body::distributed::Owned<Number, DIMENSION> lower, upper;
+  for (const auto &body : bodies) {
+    (body.position[0] < 0 ? lower : upper).bodies.push_back(body);
+  }
+  nbd::tree::BodyTree<Number, DIMENSION> lower_tree;
+  for (std::size_t i = 0; i < lower.bodies.size(); ++i) {
+    lower_tree.push(lower.bodies, root_space, i);
+  }
+  auto lower_walk = nbw::WalkTree<Number, DIMENSION>::from_flat(
+      lower_tree.flatten(), config);
+  nbd::Bodies<Number, DIMENSION> combined = upper.bodies;
+  n_body::distributed::append_essential(
+      lower_walk, n_body::distributed::bounds_of(upper), combined);
+
+  BOOST_TEST(combined.size() < bodies.size());
+  Number mass = 0;
+  for (const auto &body : combined) {
+    mass += body.mass;
+  }
+  BOOST_TEST(mass == walk_tree_of(bodies, config).nodes[0].mass,
+             boost::test_tools::tolerance(1e-12));
+
+  nbd::tree::BodyTree<Number, DIMENSION> combined_tree;
+  for (std::size_t i = 0; i < combined.size(); ++i) {
+    combined_tree.push(combined, root_space, i);
+  }
+  auto combined_walk = nbw::WalkTree<Number, DIMENSION>::from_flat(
+      combined_tree.flatten(), config);
+  Number sum_squared_error = 0;
+  for (const auto &target : upper.bodies) {
+    nbd::Vector<Number, DIMENSION> direct{};
+    for (const auto &body : bodies) {
+      direct += physical::gravity_per_unit_mass_position_to_position(
+          config, body.position, body.mass, target.position);
+    }
+    auto walked = physical::gravity_per_unit_mass_tree_to_position(
+        config, combined_walk, target.position);
+    auto error = nbd::module_of(walked - direct) / nbd::module_of(direct);
+    sum_squared_error += error * error;
+  }
+  // the bound of walk_matches_direct_sum
+  BOOST_TEST(std::sqrt(sum_squared_error / upper.bodies.size()) < 0.02);
+}
+
+BOOST_AUTO_TEST_CASE(criteria_bound_the_error) {
+  auto bodies = random_bodies(400);
+  auto config = configuration(1);
+  config.time = 1e-3;
+  auto direct = bodies;
+  physical::step(config, direct.begin(), direct.end(), bodies);
+  std::vector<Number> magnitudes;
+  for (std::size_t i = 0; i < bodies.size(); ++i) {
+    magnitudes.push_back(nbd::module_of(direct[i].velocity) / config.time);
+  }
+
+  auto rms_error = [&](const n_body::config::Configuration<Number> &c,
+                       std::vector<Number> previous) {
+    auto walked = bodies;
+    physical::step(c, walked.begin(), walked.end(), walk_tree_of(bodies, c),
+                   previous);
+    Number sum = 0;
+    for (std::size_t i = 0; i < bodies.size(); ++i) {
+      auto error = nbd::module_of(walked[i].velocity - direct[i].velocity) /
+                   nbd::module_of(direct[i].velocity);
+      sum += error * error;
+    }
+    return std::sqrt(sum / bodies.size());
+  };
+
+  auto geometric = rms_error(config, {});
+  config.opening = n_body::config::OpeningCriterion::SalmonWarren;
+  auto salmon_warren = rms_error(config, {});
+  config.opening = n_body::config::OpeningCriterion::Relative;
+  auto relative = rms_error(config, magnitudes);
+  // without accelerations the relative criterion is the geometric one
+  auto fallback = rms_error(config, {});
+  BOOST_TEST_MESSAGE("geometric " << geometric << " salmon-warren "
+                                  << salmon_warren << " relative "
+                                  << relative);
+  BOOST_TEST(salmon_warren < 0.01);
+  BOOST_TEST(relative < 0.01);
+  BOOST_TEST(fallback == geometric);
+}
+
+BOOST_AUTO_TEST_CASE(salmon_warren_ignores_distant_bodies) {
+  auto bodies = random_bodies(400);
+  auto config = configuration(1);
+  config.opening = n_body::config::OpeningCriterion::SalmonWarren;
+  auto interactions_of = [&](const nbd::Bodies<Number, DIMENSION> &all) {
+    auto walk_tree = walk_tree_of(all, config);
+    std::uint64_t count = 0;
+    for (const auto &body : bodies) {
+      physical::gravity_per_unit_mass_tree_to_position(
+          config, walk_tree, body.position,
+          std::numeric_limits<Number>::infinity(), &count);
+    }
+    return count;
+  };
+
+  // a light body far away widens the root a hundredfold, the tolerance
+  // follows the half mass radius, which it leaves where it was
+  auto compact = interactions_of(bodies);
+  auto widened = bodies;
+  widened.push_back({{2000, 0, 0}, {}, 1e-6});
+  auto distant = interactions_of(widened);
+  BOOST_TEST_MESSAGE("interactions " << compact << " with a distant body "
+                                     << distant);
+  BOOST_TEST(distant < compact * 5 / 4);
+}
+
+BOOST_AUTO_TEST_CASE(relative_test_does_not_overflow_float) {
+  // distance^4 of a distant node is beyond the range of float
+  nbw::WalkNode<float, DIMENSION> node{};
+  node.opening_radius2 = 1;
+  node.opening_weight = 1e30f;
+  std::feclearexcept(FE_OVERFLOW);
+  BOOST_TEST(nbw::accepts(node, 1e30f, 1.0f));
+  BOOST_TEST(!std::fetestexcept(FE_OVERFLOW));
+  BOOST_TEST(!nbw::accepts(node, 1e3f, 1.0f));
+}
+
+BOOST_AUTO_TEST_CASE(packet_matches_scalar_walk) {
+  auto bodies = random_bodies(301);
+  auto config = configuration(0.7);
+  config.soften_length = 0.01;
+  auto walk_tree = walk_tree_of(bodies, config);
+
+  // the last packet is partial
+  for (std::size_t first = 0; first < bodies.size();
+       first += nbw::PACKET_SIZE) {
+    auto count = std::min(nbw::PACKET_SIZE, bodies.size() - first);
+    nbd::Vector<Number, DIMENSION> positions[nbw::PACKET_SIZE];
+    nbd::Vector<Number, DIMENSION> accelerations[nbw::PACKET_SIZE];
+    for (std::size_t l = 0; l < count; ++l) {
+      positions[l] = bodies[first + l].position;
+    }
+    physical::gravity_per_unit_mass_tree_to_packet(config, walk_tree,
+                                                   positions, count,
+                                                   accelerations);
+    for (std::size_t l = 0; l < count; ++l) {
+      auto scalar = physical::gravity_per_unit_mass_tree_to_position(
+          config, walk_tree, positions[l]);
+      BOOST_TEST(nbd::module_of(accelerations[l] - scalar) <=
+                 1e-14 * nbd::module_of(scalar));
+    }
+  }
+}
+
+BOOST_AUTO_TEST_CASE(steps_count_interactions_per_body) {
+  auto bodies = random_bodies(203);
+  auto config = configuration(0.5);
+  auto walk_tree = walk_tree_of(bodies, config);
+  std::vector<std::uint64_t> expected;
+  for (const auto &body : bodies) {
+    std::uint64_t count = 0;
+    physical::gravity_per_unit_mass_tree_to_position(
+        config, walk_tree, body.position,
+        std::numeric_limits<Number>::infinity(), &count);
+    expected.push_back(count);
+  }
+
+  // the packets meet the same nodes as the scalar walk
+  Number *no_potential = nullptr;
+  std::vector<Number> magnitudes;
+  std::vector<std::uint64_t> scalar;
+  auto still = bodies;
+  physical::step(config, still.begin(), still.end(), walk_tree, magnitudes,
+                 no_potential, &scalar);
+  BOOST_TEST(scalar == expected, boost::test_tools::per_element());
+  config.method = n_body::config::ForceMethod::Packet;
+  std::vector<std::uint64_t> packet;
+  physical::step(config, still.begin(), still.end(), walk_tree, magnitudes,
+                 no_potential, &packet);
+  BOOST_TEST(packet == expected, boost::test_tools::per_element());
+
+  // the lists accept for a whole group, so they interact at least as often
+  auto lists = nbw::InteractionLists<Number, DIMENSION>::build(
+      walk_tree,
+      space::root_space<Number, DIMENSION>(bodies.begin(), bodies.end()),
+      nbd::BodiesView<Number, DIMENSION>(bodies), 0, bodies.size(), 0.5);
+  std::vector<std::uint64_t> listed;
+  physical::step(config, still.begin(), still.end(), lists, no_potential,
+                 &listed);
+  BOOST_TEST(listed.size() == bodies.size());
+  for (std::size_t i = 0; i < bodies.size(); ++i) {
+    BOOST_TEST(listed[i] >= expected[i]);
+  }
+}
+
+BOOST_AUTO_TEST_CASE(lists_cover_every_body_once) {
+  auto bodies = random_bodies(203);
+  auto config = configuration(0.5);
+  config.time = 1e-3;
+  auto root_space =
+      space::root_space<Number, DIMENSION>(bodies.begin(), bodies.end());
+  auto walk_tree = walk_tree_of(bodies, config);
+  auto lists = nbw::InteractionLists<Number, DIMENSION>::build(
+      walk_tree, root_space, nbd::BodiesView<Number, DIMENSION>(bodies), 0,
+      bodies.size(), 0.5);
+
+  // the nodes of a list partition the bodies
+  BOOST_TEST(lists.groups() == (bodies.size() + 7) / 8);
+  for (std::size_t g = 0; g < lists.groups(); ++g) {
+    Number mass = 0;
+    for (auto k = lists.offsets[g]; k < lists.offsets[g + 1]; ++k) {
+      mass += lists.tree.nodes[lists.nodes[k]].mass;
+    }
+    BOOST_TEST(mass == walk_tree.nodes[0].mass,
+               boost::test_tools::tolerance(1e-12));
+  }
+
+  // the lists open at least the nodes the walk opens
+  auto by_lists = bodies;
+  physical::step(config, by_lists.begin(), by_lists.end(), lists);
+  auto by_walk = bodies;
+  physical::step(config, by_walk.begin(), by_walk.end(), walk_tree);
+  auto direct = bodies;
+  physical::step(config, direct.begin(), direct.end(), bodies);
+  Number lists_error = 0;
+  Number walk_error = 0;
+  for (std::size_t i = 0; i < bodies.size(); ++i) {
+    auto norm = nbd::module_of(direct[i].velocity);
+    lists_error += nbd::module_of(by_lists[i].velocity - direct[i].velocity) /
+                   norm;
+    walk_error +=
+        nbd::module_of(by_walk[i].velocity - direct[i].velocity) / norm;
+  }
+  BOOST_TEST(lists_error <= walk_error);
+}
+
+BOOST_AUTO_TEST_CASE(lists_expire_after_half_the_margin) {
+  auto bodies = random_bodies(100);
+  auto root_space =
+      space::root_space<Number, DIMENSION>(bodies.begin(), bodies.end());
+  auto lists = nbw::InteractionLists<Number, DIMENSION>::build(
+      walk_tree_of(bodies, configuration(0.5)), root_space,
+      nbd::BodiesView<Number, DIMENSION>(bodies), 0, bodies.size(), 1);
+  auto center_of_mass = lists.tree.nodes[0].center_of_mass;
+
+  // the moments follow the moved bodies
+  for (auto &body : bodies) {
+    body.position[0] += 0.4;
+  }
+  nbd::BodiesView<Number, DIMENSION> view(bodies);
+  BOOST_TEST(!lists.expired(view));
+  lists.refresh(view);
+  BOOST_TEST(lists.tree.nodes[0].center_of_mass[0] ==
+                 center_of_mass[0] + 0.4,
+             boost::test_tools::tolerance(1e-12));
+
+  bodies[42].position[1] += 0.4;
+  BOOST_TEST(lists.expired(view));
+
+  // only the bodies the lists were built for are checked
+  auto first_half = nbw::InteractionLists<Number, DIMENSION>::build(
+      walk_tree_of(bodies, configuration(0.5)), root_space, view, 0, 50, 1);
+  BOOST_TEST(first_half.positions.size() == 50u);
+  bodies[80].position[1] += 0.6;
+  BOOST_TEST(!first_half.expired(view));
+  bodies[20].position[1] += 0.6;
+  BOOST_TEST(first_half.expired(view));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,22 @@
+#!/bin/bash
+
+# run n-body-bench for several rank counts and collect the results in one csv
+# usage: bench.sh <n-body-bench> <output.csv> "<rank counts>" [bench options]
+
+BENCH=$1
+OUTPUT=$2
+RANKS=$3
+shift 3
+
+rm -f "$OUTPUT"
+for r in $RANKS
+do
+	mpirun -np "$r" "$BENCH" --format csv --output "$OUTPUT.$r" "$@" || exit 1
+	if [ ! -f "$OUTPUT" ]
+	then
+		cat "$OUTPUT.$r" > "$OUTPUT"
+	else
+		tail -n +2 "$OUTPUT.$r" >> "$OUTPUT"
+	fi
+	rm "$OUTPUT.$r"
+done
@@ -0,0 +1,11 @@
+#!/bin/bash
+
+# merge the per rank chrome traces of a run into one file
+# usage: merge_traces.sh _trace.*.json > trace.json
+
+echo "["
+for f in "$@"
+do
+	sed '1d;$d' "$f" | sed 's/,$//'
+done | sed '/^$/d;$!s/$/,/'
+echo "]"